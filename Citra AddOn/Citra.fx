@@ -5,6 +5,7 @@
 
   Preprocess depth map textures from Citra so they can be used by other add-ons
   - pre-swap (un-rotate) depth buffer xy coordinates
+  - optionally reconstruct normals from the processed depth in a second pass (available to other effects as "texture NormalsTex : NORMALS;", see CITRA_NORMALS)
 
 */
 
@@ -141,18 +142,47 @@ uniform float4 Color <
 	ui_type = "color";
 > = float4(0.027, 0.027, 0.027, 0.17);
 
-// uniform int iUIPresentType <
-//   ui_type = "combo";
-//   ui_label = "Present type";
-//   ui_items = "Depth map\0"
-//              "Normal map\0"
-//              "Show both (Vertical 50/50)\0";
-// > = 2;
+uniform int iUIPresentType <
+  ui_type = "combo";
+  ui_label = "Present type";
+  ui_category = "Preview Depth Buffer";
+  ui_tooltip = "The normal map needs CITRA_NORMALS set to 1.";
+  ui_items = "Depth map\0"
+             "Normal map\0"
+             "Show both (Vertical 50/50)\0";
+> = 0;
 
 texture OrigDepthTex : ORIG_DEPTH;
 sampler OrigDepth{ Texture = OrigDepthTex; };
 
+// set by the add-on's quality governor to normalize depth at a lower resolution when frames take too long (1, 2 or 4)
+// only the passes of that resolution draw anything, so switching does not recompile the effect
+uniform int iCitraDepthResolutionDivisor <
+  hidden = true;
+> = 1;
+
+// set to 1 when an effect reads "texture NormalsTex : NORMALS;", which costs another pass and an RGBA8 texture
+#ifndef CITRA_NORMALS
+  #define CITRA_NORMALS 0
+#endif
+
+// the add-on binds the one of the current resolution to the DEPTH semantic
 texture ModifiedDepthTex{ Width = BUFFER_WIDTH; Height = BUFFER_HEIGHT; Format = R32F; };
+texture ModifiedDepthHalfTex{ Width = BUFFER_WIDTH / 2; Height = BUFFER_HEIGHT / 2; Format = R32F; };
+texture ModifiedDepthQuarterTex{ Width = BUFFER_WIDTH / 4; Height = BUFFER_HEIGHT / 4; Format = R32F; };
+
+#if CITRA_NORMALS
+sampler ModifiedDepth{ Texture = ModifiedDepthTex; MagFilter = POINT; MinFilter = POINT; MipFilter = POINT; };
+sampler ModifiedDepthHalf{ Texture = ModifiedDepthHalfTex; MagFilter = POINT; MinFilter = POINT; MipFilter = POINT; };
+sampler ModifiedDepthQuarter{ Texture = ModifiedDepthQuarterTex; MagFilter = POINT; MinFilter = POINT; MipFilter = POINT; };
+// normals (encoded as n * 0.5 + 0.5), bound to the NORMALS semantic by the add-on
+texture ModifiedNormalTex{ Width = BUFFER_WIDTH; Height = BUFFER_HEIGHT; Format = RGBA8; };
+texture ModifiedNormalHalfTex{ Width = BUFFER_WIDTH / 2; Height = BUFFER_HEIGHT / 2; Format = RGBA8; };
+texture ModifiedNormalQuarterTex{ Width = BUFFER_WIDTH / 4; Height = BUFFER_HEIGHT / 4; Format = RGBA8; };
+sampler ModifiedNormal{ Texture = ModifiedNormalTex; };
+sampler ModifiedNormalHalf{ Texture = ModifiedNormalHalfTex; };
+sampler ModifiedNormalQuarter{ Texture = ModifiedNormalQuarterTex; };
+#endif
 
 // float3 AspectRatioPS(
 // 	float4 pos : SV_Position,
@@ -413,10 +443,73 @@ float4 MyPS(float4 pos : SV_POSITION, float2 tex : TEXCOORD) : SV_TARGET {
 	return float4(depth.xxx,1.0);
 }
 
+// fullscreen triangle for the passes of the current resolution, and a degenerate one that covers no pixels for the others
+void ResolutionVS(uint id, int divisor, out float4 position, out float2 texcoord) {
+  PostProcessVS(id, position, texcoord);
+  if (iCitraDepthResolutionDivisor != divisor)
+    position = float4(0.0, 0.0, 0.0, 1.0);
+}
+void FullResolutionVS(in uint id : SV_VertexID, out float4 position : SV_Position, out float2 texcoord : TEXCOORD) {
+  ResolutionVS(id, 1, position, texcoord);
+}
+void HalfResolutionVS(in uint id : SV_VertexID, out float4 position : SV_Position, out float2 texcoord : TEXCOORD) {
+  ResolutionVS(id, 2, position, texcoord);
+}
+void QuarterResolutionVS(in uint id : SV_VertexID, out float4 position : SV_Position, out float2 texcoord : TEXCOORD) {
+  ResolutionVS(id, 4, position, texcoord);
+}
+
+#if CITRA_NORMALS
+// position of a pixel with the normalized depth as distance, corrected for the aspect ratio of the screen
+// the field of view of the game is not known, so this assumes 90 degrees vertically, and normals are only view-space normals up to that
+float3 GetPosition(float2 tex, float depth) {
+  return float3((tex * 2.0 - 1.0) * float2(BUFFER_ASPECT_RATIO, 1.0) * depth, depth);
+}
+
+// reads the depth the first pass wrote, so each neighbor costs a single fetch (encoder/normals-check.cpp has the same math on the CPU)
+float3 GetNormal(sampler depthSampler, float2 tex) {
+  // use the neighbor with the smaller depth difference on each axis, so normals don't smear across object edges
+  float2 texel = 1.0 / tex2Dsize(depthSampler);
+  float3 center = GetPosition(tex, tex2Dlod(depthSampler, float4(tex, 0, 0)).x);
+  float3 left = GetPosition(tex - float2(texel.x, 0), tex2Dlod(depthSampler, float4(tex - float2(texel.x, 0), 0, 0)).x);
+  float3 right = GetPosition(tex + float2(texel.x, 0), tex2Dlod(depthSampler, float4(tex + float2(texel.x, 0), 0, 0)).x);
+  float3 up = GetPosition(tex - float2(0, texel.y), tex2Dlod(depthSampler, float4(tex - float2(0, texel.y), 0, 0)).x);
+  float3 down = GetPosition(tex + float2(0, texel.y), tex2Dlod(depthSampler, float4(tex + float2(0, texel.y), 0, 0)).x);
+
+  // fetches past the border are clamped and look like a neighbor at the same depth, so always use the one inside there
+  bool use_right = tex.x + texel.x < 1.0 && (tex.x - texel.x < 0.0 || abs(right.z - center.z) < abs(center.z - left.z));
+  bool use_down = tex.y + texel.y < 1.0 && (tex.y - texel.y < 0.0 || abs(down.z - center.z) < abs(center.z - up.z));
+  float3 dx = use_right ? right - center : center - left;
+  float3 dy = use_down ? down - center : center - up;
+
+  return normalize(cross(dy, dx));
+}
+
+float4 NormalPS(float4 pos : SV_POSITION, float2 tex : TEXCOORD) : SV_TARGET {
+	return float4(GetNormal(ModifiedDepth, tex) * 0.5 + 0.5, 1.0);
+}
+float4 NormalHalfPS(float4 pos : SV_POSITION, float2 tex : TEXCOORD) : SV_TARGET {
+	return float4(GetNormal(ModifiedDepthHalf, tex) * 0.5 + 0.5, 1.0);
+}
+float4 NormalQuarterPS(float4 pos : SV_POSITION, float2 tex : TEXCOORD) : SV_TARGET {
+	return float4(GetNormal(ModifiedDepthQuarter, tex) * 0.5 + 0.5, 1.0);
+}
+#endif
+
 float4 PreviewDepth(float4 pos : SV_POSITION, float2 tex : TEXCOORD) : SV_TARGET {
 	if(bUIPreviewDepth){
-		float depth = GetModDepth(tex);
-		return lerp(tex2D(ReShade::BackBuffer, tex), float4(depth.xxx,1.0), bUIPreviewAlpha);
+		float4 preview;
+#if CITRA_NORMALS
+		if(iUIPresentType == 1 || (iUIPresentType == 2 && tex.x > 0.5)){
+			float3 normal = iCitraDepthResolutionDivisor == 4 ? tex2D(ModifiedNormalQuarter, tex).rgb : iCitraDepthResolutionDivisor == 2 ? tex2D(ModifiedNormalHalf, tex).rgb : tex2D(ModifiedNormal, tex).rgb;
+			preview = float4(normal, 1.0);
+		} else
+#endif
+		{
+			float depth = GetModDepth(tex);
+			preview = float4(depth.xxx,1.0);
+		}
+		return lerp(tex2D(ReShade::BackBuffer, tex), preview, bUIPreviewAlpha);
 	}
 	return tex2D(ReShade::BackBuffer, tex);
 }
@@ -425,10 +518,37 @@ float4 PreviewDepth(float4 pos : SV_POSITION, float2 tex : TEXCOORD) : SV_TARGET
 // FullscreenVS
 technique Citra {
 	pass {
-		VertexShader = PostProcessVS;
+		VertexShader = FullResolutionVS;
 		PixelShader = MyPS;
 		RenderTarget = ModifiedDepthTex;
 	}
+	pass {
+		VertexShader = HalfResolutionVS;
+		PixelShader = MyPS;
+		RenderTarget = ModifiedDepthHalfTex;
+	}
+	pass {
+		VertexShader = QuarterResolutionVS;
+		PixelShader = MyPS;
+		RenderTarget = ModifiedDepthQuarterTex;
+	}
+#if CITRA_NORMALS
+	pass {
+		VertexShader = FullResolutionVS;
+		PixelShader = NormalPS;
+		RenderTarget = ModifiedNormalTex;
+	}
+	pass {
+		VertexShader = HalfResolutionVS;
+		PixelShader = NormalHalfPS;
+		RenderTarget = ModifiedNormalHalfTex;
+	}
+	pass {
+		VertexShader = QuarterResolutionVS;
+		PixelShader = NormalQuarterPS;
+		RenderTarget = ModifiedNormalQuarterTex;
+	}
+#endif
 	pass {
 		VertexShader = PostProcessVS;
 		PixelShader = PreviewDepth;
@@ -0,0 +1,53 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Minimal benchmark framework for the add-on core, which runs a single benchmark per process (see 'main.cpp')
+ */
+
+#pragma once
+
+#include <mock_host.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+struct benchmark
+{
+	const char *name;
+	void(*function)(unsigned int iterations);
+	const benchmark *next;
+
+	benchmark(const char *name, void(*function)(unsigned int iterations));
+
+	static const benchmark *first;
+};
+
+// The function receives the number of iterations to run, which is small when benchmarks only run to check that they still work ('--quick')
+#define BENCHMARK(name) \
+	static void benchmark_##name(unsigned int iterations); \
+	static const benchmark benchmark_##name##_registration(#name, benchmark_##name); \
+	static void benchmark_##name(unsigned int iterations)
+
+// Benchmarks also check that what they measure is still doing the same work, since numbers of code that broke are meaningless
+#define BENCH_CHECK(expression) \
+	do { \
+		if (!(expression)) \
+		{ \
+			std::fprintf(stderr, "%s(%d): check failed: %s\n", __FILE__, __LINE__, #expression); \
+			std::exit(1); \
+		} \
+	} while (false)
+
+// Returns the time 'callback' took in nanoseconds
+template <typename F>
+inline double measure(F &&callback)
+{
+	const auto start = std::chrono::steady_clock::now();
+	callback();
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline void report(const char *what, double nanoseconds, double count, const char *unit)
+{
+	std::printf("%-48s %10.1f ns/%s\n", what, nanoseconds / count, unit);
+}
@@ -0,0 +1,90 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Cost of rebinding depth to effects with a large effect stack, which only uses the handles cached when effects were reloaded (see 'on_reloaded_effects' in 'citra.cpp')
+ */
+
+#include "bench.hpp"
+#include <string>
+
+using namespace reshade::api;
+
+namespace
+{
+	// Uniforms of a large effect stack, a few of which ask whether depth is available like the ones in 'ReShade.fxh' do
+	void add_effect_stack(mock::effect_runtime &runtime, unsigned int uniforms_per_effect)
+	{
+		for (const char *effect : { "MXAO.fx", "CinematicDOF.fx", "RTGI.fx", "ReGlass.fx" })
+		{
+			for (unsigned int i = 0; i < uniforms_per_effect; ++i)
+				runtime.add_uniform_variable(effect, ("fUniform" + std::to_string(i)).c_str(), i % 3 == 0 ? "timer" : "");
+			runtime.add_uniform_variable(effect, "bHasDepth", "bufready_depth");
+		}
+	}
+
+	// Renders frames in which the selected depth-stencil changes every frame ('switch_every_frame') or never, and returns the time spent presenting
+	double render_frames(mock::context &context, unsigned int frames, bool switch_every_frame)
+	{
+		const auto [first, first_dsv] = context.device->create_depth_stencil(1200, 720);
+		const auto [second, second_dsv] = context.device->create_depth_stencil(1200, 720);
+
+		double present_time = 0.0;
+		for (unsigned int frame = 0; frame < frames; ++frame)
+		{
+			const bool first_wins = !switch_every_frame || frame % 2 == 0;
+			context.immediate().bind_depth_stencil(first_dsv);
+			for (unsigned int i = 0; i < (first_wins ? 60u : 20u); ++i)
+				context.immediate().draw(300);
+			context.immediate().bind_depth_stencil(second_dsv);
+			for (unsigned int i = 0; i < (first_wins ? 20u : 60u); ++i)
+				context.immediate().draw(300);
+
+			present_time += measure([&context]() {
+				context.runtime->present();
+			});
+		}
+
+		context.device->destroy_application_resource(first);
+		context.device->destroy_application_resource(second);
+		return present_time;
+	}
+}
+
+BENCHMARK(effect_handles)
+{
+	const unsigned int uniforms_per_effect = 100;
+
+	mock::set_config("DEPTH", "DepthSelectionHysteresisFrames", "0");
+	register_addon_depth();
+	{
+		mock::context context(device_api::d3d11);
+		add_effect_stack(*context.runtime, uniforms_per_effect);
+
+		const double reload_time = measure([&context]() {
+			context.runtime->reload_effects();
+		});
+
+		const double steady_time = render_frames(context, iterations, false);
+
+		const size_t enumerations_before = context.runtime->uniform_enumerations;
+		const size_t lookups_before = context.runtime->variable_lookups;
+		const size_t binding_updates_before = context.runtime->binding_updates;
+
+		const double switching_time = render_frames(context, iterations, true);
+
+		const size_t binding_updates = context.runtime->binding_updates - binding_updates_before;
+
+		std::printf("%-48s %10u\n", "uniforms", 4 * (uniforms_per_effect + 1) + 4);
+		report("reload effects (gathers the handles)", reload_time, 1, "reload");
+		report("present, same depth-stencil", steady_time, iterations, "frame");
+		report("present, depth-stencil changes every frame", switching_time, iterations, "frame");
+		// Without the cache, every rebinding enumerated all uniforms and looked up the depth textures and linearization uniforms by name
+		std::printf("%-48s %10zu\n", "uniform enumerations while switching", context.runtime->uniform_enumerations - enumerations_before);
+		std::printf("%-48s %10zu\n", "variable lookups while switching", context.runtime->variable_lookups - lookups_before);
+
+		BENCH_CHECK(binding_updates >= iterations);
+		BENCH_CHECK(context.runtime->uniform_enumerations == enumerations_before);
+		BENCH_CHECK(context.runtime->variable_lookups == lookups_before);
+	}
+	unregister_addon_depth();
+}
@@ -0,0 +1,235 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Cost of the events the add-on handles, measured against the same frames with the add-on not registered
+ */
+
+#include "bench.hpp"
+#include <algorithm>
+#include <limits>
+
+using namespace reshade::api;
+
+namespace
+{
+	struct event_times
+	{
+		double bind = 0.0;
+		double draw = 0.0;
+		double clear = 0.0;
+		double present = 0.0;
+	};
+
+	// Renders frames like Citra does, with the top and bottom screen each drawn to their own depth-stencil
+	event_times render_frames(unsigned int frames, unsigned int draws_per_screen)
+	{
+		mock::context context(device_api::d3d11);
+		mock::command_list &cmd_list = context.immediate();
+
+		const auto [top_screen, top_screen_dsv] = context.device->create_depth_stencil(1200, 720);
+		const auto [bottom_screen, bottom_screen_dsv] = context.device->create_depth_stencil(960, 720);
+
+		event_times times;
+		for (unsigned int frame = 0; frame < frames; ++frame)
+		{
+			for (const resource_view dsv : { top_screen_dsv, bottom_screen_dsv })
+			{
+				times.bind += measure([&cmd_list, dsv = dsv]() {
+					cmd_list.bind_depth_stencil(dsv);
+				});
+				times.draw += measure([&cmd_list, draws_per_screen]() {
+					for (unsigned int i = 0; i < draws_per_screen; ++i)
+						cmd_list.draw(300);
+				});
+				times.clear += measure([&cmd_list, dsv = dsv]() {
+					cmd_list.clear_depth(dsv);
+				});
+			}
+
+			times.present += measure([&context]() {
+				context.runtime->present();
+			});
+		}
+
+		return times;
+	}
+}
+
+BENCHMARK(event_overhead)
+{
+	const unsigned int draws_per_screen = 500;
+
+	const event_times baseline = render_frames(iterations, draws_per_screen);
+
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+	register_addon_depth();
+	const event_times addon = render_frames(iterations, draws_per_screen);
+	unregister_addon_depth();
+
+	const double frames = iterations;
+	report("bind_render_targets_and_depth_stencil", addon.bind - baseline.bind, frames * 2, "bind");
+	report("draw", addon.draw - baseline.draw, frames * 2 * draws_per_screen, "draw");
+	report("clear_depth_stencil_view", addon.clear - baseline.clear, frames * 2, "clear");
+	report("present + begin/finish effects", addon.present - baseline.present, frames, "frame");
+}
+
+namespace
+{
+	enum class event_mode
+	{
+		// Draw calls are counted to select a depth-stencil, which is copied before effects
+		automatic,
+		// Clear operations and render pass boundaries are handled as well, to copy before clears
+		copy_before_clears,
+		// The depth-stencil is pinned, so neither draw calls nor clears are handled
+		pinned,
+	};
+
+	// Renders frames with render passes like the Vulkan renderer of Citra does, and returns the time all of them took on the application side
+	double render_frames_in_mode(event_mode mode, unsigned int frames, unsigned int draws_per_screen, bool addon)
+	{
+		mock::context context(device_api::vulkan);
+		mock::command_list &cmd_list = context.immediate();
+
+		const auto [top_screen, top_screen_dsv] = context.device->create_depth_stencil(1200, 720);
+		const auto [bottom_screen, bottom_screen_dsv] = context.device->create_depth_stencil(960, 720);
+
+		const auto render_frame = [&, top_screen_dsv = top_screen_dsv, bottom_screen_dsv = bottom_screen_dsv]() {
+			for (const resource_view dsv : { top_screen_dsv, bottom_screen_dsv })
+			{
+				cmd_list.begin_render_pass(dsv, render_pass_load_op::clear);
+				for (unsigned int i = 0; i < draws_per_screen; ++i)
+					cmd_list.draw(300);
+				cmd_list.end_render_pass();
+			}
+		};
+
+		if (addon && mode == event_mode::pinned)
+		{
+			// Draw calls have to be counted for one frame, so that the depth-stencil shows up in the list it is pinned from
+			render_frame();
+			context.runtime->present();
+
+			char label[32] = "";
+			std::snprintf(label, sizeof(label), "> 0x%016llx", static_cast<unsigned long long>(top_screen.handle));
+			mock::draw_overlay(context.runtime.get(), label);
+			BENCH_CHECK(mock::registered_callbacks(reshade::addon_event::draw) == 0);
+		}
+
+		if (addon)
+		{
+			// A render pass has to end wherever it began, or its state would stay set
+			BENCH_CHECK(mock::registered_callbacks(reshade::addon_event::begin_render_pass) == mock::registered_callbacks(reshade::addon_event::end_render_pass));
+			BENCH_CHECK((mock::registered_callbacks(reshade::addon_event::clear_depth_stencil_view) != 0) == (mode == event_mode::copy_before_clears));
+		}
+
+		double time = 0.0;
+		for (unsigned int frame = 0; frame < frames; ++frame)
+		{
+			time += measure(render_frame);
+			context.runtime->present();
+		}
+		return time;
+	}
+}
+
+BENCHMARK(event_overhead_per_mode)
+{
+	const unsigned int draws_per_screen = 500;
+	const double draws = static_cast<double>(iterations) * 2 * draws_per_screen;
+
+	// Draw calls of the mock host itself take about as long as the add-on adds, so take the best of several runs to keep noise out of the difference
+	const auto best_of_runs = [&](auto &&run) {
+		double best = std::numeric_limits<double>::max();
+		for (int i = 0; i < 5; ++i)
+			best = std::min(best, run());
+		return best;
+	};
+
+	const double baseline = best_of_runs([&]() { return render_frames_in_mode(event_mode::automatic, iterations, draws_per_screen, false); });
+	report("without the add-on", baseline, draws, "draw");
+
+	const std::pair<event_mode, const char *> modes[] = {
+		{ event_mode::automatic, "automatic selection" },
+		{ event_mode::copy_before_clears, "copy before clears" },
+		{ event_mode::pinned, "pinned depth-stencil" },
+	};
+	for (const auto &[mode, name] : modes)
+	{
+		const double addon = best_of_runs([&, mode = mode]() {
+			mock::reset_config();
+			mock::set_config("DEPTH", "DepthCopyBeforeClears", mode == event_mode::copy_before_clears ? "1" : "0");
+
+			register_addon_depth();
+			const double time = render_frames_in_mode(mode, iterations, draws_per_screen, true);
+			unregister_addon_depth();
+			return time;
+		});
+
+		report(name, addon - baseline, draws, "draw added");
+	}
+}
+
+namespace
+{
+	// Returns the best time of several runs of drawing 'draws_per_frame' draw calls per frame to 'context', since the difference between instantiations is small compared to the noise of a single run
+	double draw_frames(mock::context &context, resource_view dsv, unsigned int frames, unsigned int draws_per_frame)
+	{
+		mock::command_list &cmd_list = context.immediate();
+
+		double best = std::numeric_limits<double>::max();
+		for (int run = 0; run < 5; ++run)
+		{
+			double time = 0.0;
+			for (unsigned int frame = 0; frame < frames; ++frame)
+			{
+				cmd_list.bind_depth_stencil(dsv);
+				time += measure([&cmd_list, draws_per_frame]() {
+					for (unsigned int i = 0; i < draws_per_frame; ++i)
+						cmd_list.draw(300);
+				});
+				context.runtime->present();
+			}
+			best = std::min(best, time);
+		}
+		return best;
+	}
+}
+
+// Draw calls with the callbacks instantiated for the API of the only device, compared to the generic ones that ask the device for its API on every call, which are used once there are devices of different APIs
+BENCHMARK(event_dispatch_per_api)
+{
+	const unsigned int draws_per_frame = 1000;
+	const double draws = static_cast<double>(iterations) * draws_per_frame;
+
+	double baseline = 0.0;
+	{
+		mock::context context(device_api::d3d11);
+		baseline = draw_frames(context, context.device->create_depth_stencil(1200, 720).second, iterations, draws_per_frame);
+	}
+	report("without the add-on", baseline, draws, "draw");
+
+	register_addon_depth();
+	{
+		mock::context context(device_api::d3d11);
+		const resource_view dsv = context.device->create_depth_stencil(1200, 720).second;
+
+		const double specialized = draw_frames(context, dsv, iterations, draws_per_frame);
+		BENCH_CHECK(mock::registered_callbacks(reshade::addon_event::draw) == 1);
+
+		double generic = 0.0;
+		{
+			mock::context other_context(device_api::vulkan);
+
+			// Switching to the generic instantiation replaces the specialized one, instead of running both
+			BENCH_CHECK(mock::registered_callbacks(reshade::addon_event::draw) == 1);
+			BENCH_CHECK(mock::registered_callbacks(reshade::addon_event::create_resource) == 1);
+
+			generic = draw_frames(context, dsv, iterations, draws_per_frame);
+		}
+
+		report("specialized for D3D11", specialized - baseline, draws, "draw added");
+		report("generic (D3D11 and Vulkan devices)", generic - baseline, draws, "draw added");
+	}
+	unregister_addon_depth();
+}
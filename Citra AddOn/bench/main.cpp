@@ -0,0 +1,40 @@
+/*
+ * 2022 Jake Downs
+ */
+
+#include "bench.hpp"
+#include <cstring>
+
+const benchmark *benchmark::first = nullptr;
+
+benchmark::benchmark(const char *name, void(*function)(unsigned int iterations)) :
+	name(name), function(function), next(first)
+{
+	first = this;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		std::fprintf(stderr, "usage: %s <benchmark> [--quick]\n\nbenchmarks:\n", argv[0]);
+		for (const benchmark *bench = benchmark::first; bench != nullptr; bench = bench->next)
+			std::fprintf(stderr, "  %s\n", bench->name);
+		return 2;
+	}
+
+	const bool quick = argc > 2 && std::strcmp(argv[2], "--quick") == 0;
+
+	for (const benchmark *bench = benchmark::first; bench != nullptr; bench = bench->next)
+	{
+		if (std::strcmp(bench->name, argv[1]) != 0)
+			continue;
+
+		mock::reset_config();
+		bench->function(quick ? 10 : 1000);
+		return 0;
+	}
+
+	std::fprintf(stderr, "unknown benchmark '%s'\n", argv[1]);
+	return 2;
+}
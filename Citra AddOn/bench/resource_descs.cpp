@@ -0,0 +1,100 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Device calls saved by the description cache (see 'resource_desc_cache' in 'citra.cpp')
+ */
+
+#include "bench.hpp"
+
+using namespace reshade::api;
+
+BENCHMARK(resource_desc_queries)
+{
+	const unsigned int candidates = 8;
+
+	register_addon_depth();
+	{
+		mock::context context(device_api::d3d11);
+
+		std::vector<resource_view> dsvs;
+		for (unsigned int i = 0; i < candidates; ++i)
+			dsvs.push_back(context.device->create_depth_stencil(1200, 720).second);
+
+		const size_t queries_before = context.device->get_resource_desc_calls;
+
+		double frame_time = 0.0;
+		for (unsigned int frame = 0; frame < iterations; ++frame)
+		{
+			for (unsigned int i = 0; i < candidates; ++i)
+			{
+				context.immediate().bind_depth_stencil(dsvs[i]);
+				for (unsigned int draw = 0; draw < 20 + i; ++draw)
+					context.immediate().draw(300);
+			}
+
+			frame_time += measure([&context]() {
+				context.runtime->present();
+				mock::draw_overlay(context.runtime.get());
+			});
+		}
+
+		const double queries = static_cast<double>(context.device->get_resource_desc_calls - queries_before);
+		// Without the cache, selection and the depth buffer list in the settings each queried every candidate once per frame
+		const double uncached_queries = 2.0 * candidates * iterations;
+
+		std::printf("%-48s %10.2f (%u candidates)\n", "device queries per frame", queries / iterations, candidates);
+		std::printf("%-48s %10.2f\n", "device queries per frame saved", (uncached_queries - queries) / iterations);
+		report("present + effects + settings overlay", frame_time, iterations, "frame");
+
+		BENCH_CHECK(queries == 0.0);
+	}
+	unregister_addon_depth();
+}
+
+// Citra destroys lots of textures every frame, which the filter in front of the description cache lets through without taking any lock
+BENCHMARK(destroy_overhead)
+{
+	const unsigned int resources_per_iteration = 256;
+
+	register_addon_depth();
+	{
+		mock::context context(device_api::vulkan);
+
+		const size_t queries_before = context.device->get_resource_desc_calls;
+
+		double untracked_time = 0.0, tracked_time = 0.0;
+		std::vector<resource> resources(resources_per_iteration);
+		for (unsigned int iteration = 0; iteration < iterations; ++iteration)
+		{
+			// Only the event is measured, not the mock destroying the resource afterwards
+			const auto destroy_all = [&context, &resources]() {
+				return measure([&context, &resources]() {
+					for (const resource resource : resources)
+						mock::invoke<reshade::addon_event::destroy_resource>(static_cast<device *>(context.device.get()), resource);
+				});
+			};
+
+			for (resource &resource : resources)
+				resource = context.device->create_application_resource(resource_desc(400, 240, 1, 1, format::r8g8b8a8_unorm, 1, memory_heap::gpu_only, resource_usage::render_target | resource_usage::shader_resource));
+			untracked_time += destroy_all();
+			for (const resource resource : resources)
+				context.device->destroy_resource(resource);
+
+			for (resource &resource : resources)
+				resource = context.device->create_depth_stencil(1200, 720).first;
+			tracked_time += destroy_all();
+			for (const resource resource : resources)
+				context.device->destroy_resource(resource);
+
+			// Presenting forgets the destroyed depth-stencils again, so that every iteration starts from the same state
+			context.runtime->present();
+		}
+
+		report("destroy untracked texture", untracked_time, static_cast<double>(iterations) * resources_per_iteration, "resource");
+		report("destroy tracked depth-stencil", tracked_time, static_cast<double>(iterations) * resources_per_iteration, "resource");
+
+		// Neither has to ask the device what was destroyed
+		BENCH_CHECK(context.device->get_resource_desc_calls == queries_before);
+	}
+	unregister_addon_depth();
+}
@@ -11,12 +11,41 @@
 
 #include <imgui.h>
 #include <reshade.hpp>
+#include "citra_capture.hpp"
+#include "quality_governor.hpp"
+#include <cassert>
 #include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <type_traits>
 #include <algorithm>
 #include <vector>
+#include <mutex>
 #include <shared_mutex>
+#include <string>
 #include <unordered_map>
+#include <utility>
+
+#ifdef _WIN32
+#define CITRA_EXPORT extern "C" __declspec(dllexport)
+#else
+// Outside of Windows the add-on core is linked into the host directly, which then calls 'register_addon_depth' and 'unregister_addon_depth' itself
+#define CITRA_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+// Private data types are identified by their UUID in MSVC builds, other compilers use the address of a per-type key instead (see 'api_object::get_private_data')
+#ifdef _MSC_VER
+#define CITRA_UUID(value) __declspec(uuid(value))
+#else
+#define CITRA_UUID(value)
+#endif
 
 using namespace reshade::api;
 
@@ -27,6 +56,51 @@ static bool s_disable_intz = false;
 static unsigned int s_preserve_depth_buffers = 0;
 // Enable or disable the aspect ratio check from 'check_aspect_ratio' in the detection heuristic
 static unsigned int s_use_aspect_ratio_heuristics = 0;
+// Number of consecutive frames another depth-stencil has to clearly beat the selected one before the selection changes (zero to select the best one every frame)
+static unsigned int s_selection_hysteresis_frames = 30;
+// Enable or disable learning which clear operation wins each frame, so that only a single backup copy is made per frame
+static unsigned int s_predict_clear_index = 1;
+// Enable or disable copying only the area of the last viewport rendered to into backup textures, instead of the whole depth-stencil
+// Only has an effect in OpenGL and Vulkan, since D3D9-12 cannot copy part of a depth-stencil (the copy keeps the depth-stencil format either way, there is no conversion to a smaller color format)
+static unsigned int s_copy_depth_region = 0;
+// Write the frame telemetry ring to disk when the device is destroyed (0 = disabled, 1 = CSV, 2 = binary)
+static unsigned int s_dump_telemetry_on_exit = 0;
+// Enable or disable ignoring depth-stencils that do not have the shape of a 3DS screen, which leaves them unmodified and untracked
+static unsigned int s_citra_surfaces_only = 0;
+// Internal resolution scale of Citra that admitted depth-stencils must match (zero to accept any integer scale)
+static unsigned int s_citra_resolution_scale = 0;
+
+// Frame rate the quality governor tries to hold by reducing the cost of depth processing (zero to disable it)
+static unsigned int s_governor_target_frame_rate = 0;
+
+// Number of effect runtimes, and how many of them have a depth-stencil pinned in the settings (which makes draw call tracking unnecessary for them)
+// Runtimes change these on their own threads, while 'update_hot_path_events' may read them from the present of another runtime
+static std::atomic<unsigned int> s_effect_runtimes = 0;
+static std::atomic<unsigned int> s_pinned_effect_runtimes = 0;
+// Whether the events called for every draw call, state change and clear operation are currently registered
+static bool s_resource_events_registered = false;
+static bool s_draw_events_registered = false;
+static bool s_clear_events_registered = false;
+
+// Hot callbacks are instantiated once per graphics API, so that they do not have to query the device for it on every call (see 'set_hot_path_events')
+// This instantiation queries it instead, for processes that use devices of different APIs at the same time
+static constexpr device_api any_api = static_cast<device_api>(0);
+
+// Graphics API of all devices in the process (or 'any_api'), and the instantiation of the hot callbacks that is currently registered
+static device_api s_device_api = any_api;
+static unsigned int s_devices = 0;
+static device_api s_hot_path_api = any_api;
+
+template <device_api specialized_api>
+static inline device_api get_api(device *device)
+{
+	if constexpr (specialized_api != any_api)
+		return specialized_api;
+	else
+		return device->get_api();
+}
+
+static void update_hot_path_events();
 
 enum class clear_op
 {
@@ -44,8 +118,12 @@ struct draw_stats
 };
 struct clear_stats : public draw_stats
 {
-	clear_op clear_op = clear_op::clear_depth_stencil_view;
+	::clear_op clear_op = ::clear_op::clear_depth_stencil_view;
 	bool copied_during_frame = false;
+	// Set when the clear was inside a render pass, so that the copy was only made once the render pass ended
+	bool copied_after_render_pass = false;
+	// Number of the command list submission this clear was executed in (zero when recorded directly on a queue), to restore submission order after merging the state of several threads
+	uint64_t submission = 0;
 };
 
 struct depth_stencil_info
@@ -54,6 +132,8 @@ struct depth_stencil_info
 	draw_stats current_stats; // Stats since last clear operation
 	std::vector<clear_stats> clears;
 	bool copied_during_frame = false;
+	// Set when the clear operations recorded so far did not match the prediction, in which case all suitable clears are copied again
+	bool prediction_missed = false;
 };
 
 struct depth_stencil_hash
@@ -65,7 +145,15 @@ struct depth_stencil_hash
 	}
 };
 
-struct __declspec(uuid("ad059cc1-c3ad-4cef-a4a9-401f672c6c37")) state_tracking
+// Tracked state of a secondary command list flattened into a list, which stays the same until the command list is reset
+struct state_summary
+{
+	resource current_depth_stencil = { 0 };
+	draw_stats best_copy_stats;
+	std::vector<std::pair<resource, depth_stencil_info>> depth_stencils;
+};
+
+struct CITRA_UUID("ad059cc1-c3ad-4cef-a4a9-401f672c6c37") state_tracking
 {
 	viewport current_viewport = {};
 	resource current_depth_stencil = { 0 };
@@ -73,6 +161,14 @@ struct __declspec(uuid("ad059cc1-c3ad-4cef-a4a9-401f672c6c37")) state_tracking
 	bool first_draw_since_bind = true;
 	draw_stats best_copy_stats;
 
+	// Copies are not allowed inside a render pass (Vulkan and D3D12), so they are deferred to the next point outside of one
+	bool render_pass_active = false;
+	resource pending_copy_depth_stencil = { 0 };
+	viewport pending_copy_region = {};
+
+	// Built the first time this is executed as a secondary command list (see 'on_execute_secondary'), accessed atomically since bundles may be executed from several threads
+	mutable std::shared_ptr<const state_summary> summary;
+
 	state_tracking()
 	{
 		// Reserve some space upfront to avoid rehashing during command recording
@@ -83,6 +179,9 @@ struct __declspec(uuid("ad059cc1-c3ad-4cef-a4a9-401f672c6c37")) state_tracking
 	{
 		reset_on_present();
 		current_depth_stencil = { 0 };
+		render_pass_active = false;
+		pending_copy_depth_stencil = { 0 };
+		std::atomic_store(&summary, std::shared_ptr<const state_summary>());
 	}
 	void reset_on_present()
 	{
@@ -90,7 +189,7 @@ struct __declspec(uuid("ad059cc1-c3ad-4cef-a4a9-401f672c6c37")) state_tracking
 		counters_per_used_depth_stencil.clear();
 	}
 
-	void merge(const state_tracking &source)
+	void merge(const state_tracking &source, uint64_t submission = 0)
 	{
 		// Executing a command list in a different command list inherits state
 		current_depth_stencil = source.current_depth_stencil;
@@ -103,23 +202,117 @@ struct __declspec(uuid("ad059cc1-c3ad-4cef-a4a9-401f672c6c37")) state_tracking
 
 		counters_per_used_depth_stencil.reserve(source.counters_per_used_depth_stencil.size());
 		for (const auto &[depth_stencil_handle, snapshot] : source.counters_per_used_depth_stencil)
-		{
-			depth_stencil_info &target_snapshot = counters_per_used_depth_stencil[depth_stencil_handle];
-			target_snapshot.total_stats.vertices += snapshot.total_stats.vertices;
-			target_snapshot.total_stats.drawcalls += snapshot.total_stats.drawcalls;
-			target_snapshot.total_stats.drawcalls_indirect += snapshot.total_stats.drawcalls_indirect;
-			target_snapshot.current_stats.vertices += snapshot.current_stats.vertices;
-			target_snapshot.current_stats.drawcalls += snapshot.current_stats.drawcalls;
-			target_snapshot.current_stats.drawcalls_indirect += snapshot.current_stats.drawcalls_indirect;
+			merge(depth_stencil_handle, snapshot, submission);
+	}
+	void merge(const state_summary &source)
+	{
+		// Same as merging the state the summary was built from
+		current_depth_stencil = source.current_depth_stencil;
 
-			target_snapshot.clears.insert(target_snapshot.clears.end(), snapshot.clears.begin(), snapshot.clears.end());
+		if (source.best_copy_stats.vertices >= best_copy_stats.vertices)
+			best_copy_stats = source.best_copy_stats;
 
-			target_snapshot.copied_during_frame |= snapshot.copied_during_frame;
-		}
+		for (const auto &[depth_stencil_handle, snapshot] : source.depth_stencils)
+			merge(depth_stencil_handle, snapshot);
+	}
+	void merge(resource depth_stencil_handle, const depth_stencil_info &snapshot, uint64_t submission = 0)
+	{
+		depth_stencil_info &target_snapshot = counters_per_used_depth_stencil[depth_stencil_handle];
+		target_snapshot.total_stats.vertices += snapshot.total_stats.vertices;
+		target_snapshot.total_stats.drawcalls += snapshot.total_stats.drawcalls;
+		target_snapshot.total_stats.drawcalls_indirect += snapshot.total_stats.drawcalls_indirect;
+		target_snapshot.current_stats.vertices += snapshot.current_stats.vertices;
+		target_snapshot.current_stats.drawcalls += snapshot.current_stats.drawcalls;
+		target_snapshot.current_stats.drawcalls_indirect += snapshot.current_stats.drawcalls_indirect;
+
+		// Keep the viewport of whatever was executed last
+		if (snapshot.total_stats.last_viewport.width != 0)
+			target_snapshot.total_stats.last_viewport = snapshot.total_stats.last_viewport;
+		if (snapshot.current_stats.last_viewport.width != 0)
+			target_snapshot.current_stats.last_viewport = snapshot.current_stats.last_viewport;
+
+		const auto first_inserted = target_snapshot.clears.insert(target_snapshot.clears.end(), snapshot.clears.begin(), snapshot.clears.end());
+		if (submission != 0)
+			for (auto it = first_inserted; it != target_snapshot.clears.end(); ++it)
+				it->submission = submission;
+
+		target_snapshot.copied_during_frame |= snapshot.copied_during_frame;
+	}
+
+	std::shared_ptr<const state_summary> summarize() const
+	{
+		auto result = std::make_shared<state_summary>();
+		result->current_depth_stencil = current_depth_stencil;
+		result->best_copy_stats = best_copy_stats;
+		result->depth_stencils.assign(counters_per_used_depth_stencil.begin(), counters_per_used_depth_stencil.end());
+		return result;
+	}
+};
+
+// State of the command lists executed by a single thread, double-buffered so that present can take what was executed for the last frame without blocking submissions of the next one
+struct submission_shard
+{
+	// Set while the owning thread merges into one of the buffers
+	std::atomic<bool> writing = false;
+	state_tracking states[2];
+};
+
+// Distinguishes device instances that were created at the same address, for the cache of submission shards per thread
+static std::atomic<uint64_t> s_next_device_instance = 1;
+
+// Identifies a depth-stencil independent of its handle, so that a surface the application recreated with the same description is recognized as the same one
+// Only the description is used, since the number of clear operations and the viewports change from frame to frame (e.g. with the screen layout or in menus)
+struct surface_signature
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	reshade::api::format format = reshade::api::format::unknown;
+
+	surface_signature() = default;
+	explicit surface_signature(const resource_desc &desc) :
+		width(desc.texture.width),
+		height(desc.texture.height),
+		format(desc.texture.format) {}
+
+	bool operator==(const surface_signature &other) const
+	{
+		return width == other.width && height == other.height && format == other.format;
 	}
 };
 
-struct __declspec(uuid("7c6363c7-f94e-437a-9160-141782c44a98")) generic_depth_data
+// Workload used to compare depth-stencils during selection
+static uint32_t selection_score(const depth_stencil_info &snapshot)
+{
+	// Vertices may not be accurate if application is using indirect draw calls, so use draw calls in that case
+	return snapshot.total_stats.drawcalls_indirect < (snapshot.total_stats.drawcalls / 3) ? snapshot.total_stats.vertices : snapshot.total_stats.drawcalls;
+}
+
+// Records the back buffer and the normalized depth of 'Citra.fx' to a file (see 'citra_capture.hpp')
+// Both are copied into staging textures that are only read back 'ring_size' frames later, when the GPU has normally finished them, so that mapping does not stall
+// Mapping does not wait for the GPU in D3D12 and Vulkan, so anything read back earlier than that has to wait for the queue first (see 'stop_capture')
+struct frame_capture
+{
+	static constexpr size_t ring_size = 3;
+
+	struct slot
+	{
+		resource color = { 0 };
+		resource depth = { 0 };
+		resource_desc color_desc;
+		resource_desc depth_desc;
+		citra_capture::frame_info info;
+		bool pending = false;
+	};
+
+	std::string path;
+	citra_capture::writer writer;
+	std::array<slot, ring_size> slots;
+	size_t next_slot = 0;
+	// Reason the last frame could not be captured, shown in the add-on settings
+	const char *last_error = nullptr;
+};
+
+struct CITRA_UUID("7c6363c7-f94e-437a-9160-141782c44a98") generic_depth_data
 {
 	// The depth-stencil resource that is currently selected as being the main depth target
 	resource selected_depth_stencil = { 0 };
@@ -134,7 +327,300 @@ struct __declspec(uuid("7c6363c7-f94e-437a-9160-141782c44a98")) generic_depth_da
 	// True when the shader resource view was created from the backup resource, false when it was created from the original depth-stencil
 	bool using_backup_texture = false;
 
+	// Signature of the selected depth-stencil in the last frame
+	surface_signature selected_signature;
+
+	// Depth-stencil that has been clearly beating the selected one, and for how many consecutive frames
+	resource challenger_depth_stencil = { 0 };
+	unsigned int challenger_frames = 0;
+
+	// Times at which the selected depth-stencil changed, going back at most one minute
+	std::vector<std::chrono::steady_clock::time_point> reselection_times;
+
 	std::unordered_map<resource, unsigned int, depth_stencil_hash> display_count_per_depth_stencil;
+
+	// Effect variables that are updated when the selected depth-stencil changes, looked up once every time effects are reloaded
+	std::vector<effect_uniform_variable> bufready_depth_variables;
+	// Textures 'Citra.fx' normalizes depth into (and reconstructs normals in), at full, half and quarter resolution
+	resource_view modified_depth_srv[3] = {};
+	resource_view modified_depth_srv_srgb[3] = {};
+	resource_view modified_normal_srv[3] = {};
+	resource_view modified_normal_srv_srgb[3] = {};
+
+	// Divisor of the depth normalization resolution last passed to 'Citra.fx', which selects one of the textures above (see 'quality_governor')
+	unsigned int depth_resolution_divisor = 1;
+	effect_uniform_variable depth_resolution_divisor_variable = { 0 };
+
+	size_t depth_resolution_index() const
+	{
+		return depth_resolution_divisor >= 4 ? 2 : depth_resolution_divisor >= 2 ? 1 : 0;
+	}
+
+	// Linearization parameters of the Citra effect (zero when it is not loaded)
+	effect_uniform_variable near_plane_variable = { 0 };
+	effect_uniform_variable far_plane_variable = { 0 };
+	effect_uniform_variable depth_multiplier_variable = { 0 };
+	effect_uniform_variable present_type_variable = { 0 };
+
+	// Capture that is currently being recorded, if any
+	std::unique_ptr<frame_capture> capture;
+};
+
+static void stop_capture(effect_runtime *runtime, generic_depth_data &data);
+
+// Summary of a single frame, used to correlate hitches with depth-stencil re-selection and copy bandwidth
+struct frame_telemetry
+{
+	uint64_t frame_index = 0;
+	uint64_t selected_depth_stencil = 0;
+	uint32_t candidate_depth_stencils = 0;
+	// Index of the clear operation the selected depth-stencil was copied at (starting at one), or zero if it was not copied at a clear operation
+	uint32_t copied_clear_index = 0;
+	uint32_t drawcalls = 0;
+	uint32_t drawcalls_indirect = 0;
+	uint32_t vertices = 0;
+	uint32_t copies = 0;
+	uint64_t bytes_copied = 0;
+	uint32_t backups = 0;
+	// Number of resource descriptions that had to be queried from the device, because they were not cached yet
+	uint32_t resource_desc_queries = 0;
+	uint64_t backup_memory = 0;
+	// One if nothing was rendered since the previous present, so depth selection and copies were skipped
+	uint32_t duplicate = 0;
+};
+
+struct frame_telemetry_ring
+{
+	static constexpr size_t capacity = 4096;
+
+	std::array<frame_telemetry, capacity> records;
+	// Index of the slot the next record is written to
+	size_t next = 0;
+	size_t size = 0;
+
+	void push(const frame_telemetry &record)
+	{
+		records[next] = record;
+		next = (next + 1) % capacity;
+		size = std::min(size + 1, capacity);
+	}
+
+	const frame_telemetry *latest() const
+	{
+		return size != 0 ? &records[(next + capacity - 1) % capacity] : nullptr;
+	}
+
+	template <typename F>
+	void for_each(F &&callback) const
+	{
+		// Iterate from the oldest to the newest record
+		for (size_t i = 0, first = (next + capacity - size) % capacity; i < size; ++i)
+			callback(records[(first + i) % capacity]);
+	}
+
+	bool write_csv(const char *path) const
+	{
+		std::ofstream file(path, std::ios::out | std::ios::trunc);
+		if (!file)
+			return false;
+
+		file << "frame,candidates,selected,clear_index,drawcalls,drawcalls_indirect,vertices,copies,bytes_copied,backups,backup_memory,resource_desc_queries,duplicate\n";
+		for_each([&file](const frame_telemetry &record) {
+			file << record.frame_index << ','
+				<< record.candidate_depth_stencils << ','
+				<< "0x" << std::hex << record.selected_depth_stencil << std::dec << ','
+				<< record.copied_clear_index << ','
+				<< record.drawcalls << ','
+				<< record.drawcalls_indirect << ','
+				<< record.vertices << ','
+				<< record.copies << ','
+				<< record.bytes_copied << ','
+				<< record.backups << ','
+				<< record.backup_memory << ','
+				<< record.resource_desc_queries << ','
+				<< record.duplicate << '\n';
+		});
+
+		return file.good();
+	}
+	bool write_binary(const char *path) const
+	{
+		std::ofstream file(path, std::ios::out | std::ios::trunc | std::ios::binary);
+		if (!file)
+			return false;
+
+		// Header is the magic, followed by the record size (so readers can detect layout changes) and the number of records
+		const uint32_t header[3] = { 0x4d4c5443 /* 'CTLM' */, sizeof(frame_telemetry), static_cast<uint32_t>(size) };
+		file.write(reinterpret_cast<const char *>(header), sizeof(header));
+		for_each([&file](const frame_telemetry &record) {
+			file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+		});
+
+		return file.good();
+	}
+};
+
+// Measures the GPU time of the depth copy made before effects, with a pair of timestamps per frame that are only read back once the GPU is done with them
+// Duplicate frames skip that copy, so this is what each of them saves
+struct copy_timer
+{
+	static constexpr uint32_t frames_in_flight = 4;
+
+	std::mutex mutex;
+	query_heap heap = { 0 };
+	// Frame the timestamps of every slot were written in, zero when they were read back already
+	uint64_t slot_frames[frames_in_flight] = {};
+	// Exponential moving average of the GPU time of one copy, in milliseconds
+	float average_copy_time = 0.0f;
+	// Sum of the average copy time over all duplicate frames
+	double saved_time = 0.0;
+	uint64_t last_saved_frame = 0;
+
+	// Returns the index of the first of the two timestamps to write around the copy of this frame, or UINT32_MAX if there is no slot for it
+	uint32_t begin(device *device, uint64_t frame)
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+		if (heap == 0 && !device->create_query_heap(query_type::timestamp, frames_in_flight * 2, &heap))
+			return std::numeric_limits<uint32_t>::max();
+
+		const uint32_t slot = static_cast<uint32_t>(frame % frames_in_flight);
+		if (slot_frames[slot] != 0)
+			return std::numeric_limits<uint32_t>::max(); // Still waiting for the results of an earlier frame
+		slot_frames[slot] = frame;
+		return slot * 2;
+	}
+
+	// Reads back the timestamps of frames that are old enough
+	void update(device *device, command_queue *queue, uint64_t frame)
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+		if (heap == 0)
+			return;
+
+		const uint64_t frequency = queue->get_timestamp_frequency();
+		for (uint32_t slot = 0; slot < frames_in_flight; ++slot)
+		{
+			if (slot_frames[slot] == 0 || slot_frames[slot] + frames_in_flight - 1 > frame)
+				continue;
+
+			uint64_t timestamps[2];
+			if (!device->get_query_heap_results(heap, slot * 2, 2, timestamps, sizeof(uint64_t)))
+				continue;
+			slot_frames[slot] = 0;
+
+			if (frequency == 0 || timestamps[1] < timestamps[0])
+				continue;
+			const float copy_time = static_cast<float>(static_cast<double>(timestamps[1] - timestamps[0]) * 1000.0 / frequency);
+			average_copy_time = average_copy_time == 0.0f ? copy_time : average_copy_time + (copy_time - average_copy_time) * 0.1f;
+		}
+	}
+
+	// Counts the copy a duplicate frame skipped, once per frame even with multiple effect runtimes
+	void skip(uint64_t frame)
+	{
+		const std::lock_guard<std::mutex> lock(mutex);
+		if (last_saved_frame == frame)
+			return;
+		last_saved_frame = frame;
+		saved_time += average_copy_time;
+	}
+};
+
+// Returns the number of bytes of a single-level, single-layer texture with the specified description
+static uint64_t texture_memory_size(const resource_desc &desc)
+{
+	return static_cast<uint64_t>(format_slice_pitch(desc.texture.format, format_row_pitch(desc.texture.format, desc.texture.width), desc.texture.height));
+}
+
+// Counting filter over resource handles that can be queried without a lock
+// It never misses a handle that was added and not removed yet, but may report some that were not added (rarely, since only a few hundred handles are in it at a time)
+struct resource_filter
+{
+	static constexpr size_t size = 4096;
+
+	std::array<std::atomic<uint32_t>, size> counters = {};
+
+	static size_t first_slot(resource resource)
+	{
+		return static_cast<size_t>(resource.handle >> 4) % size;
+	}
+	static size_t second_slot(resource resource)
+	{
+		// Multiplicative hash, so that handles which collide in the first slot (e.g. with the same low bits) usually do not collide here
+		return static_cast<size_t>((resource.handle * 0x9E3779B97F4A7C15ull) >> 52) % size;
+	}
+
+	void add(resource resource)
+	{
+		counters[first_slot(resource)].fetch_add(1, std::memory_order_release);
+		counters[second_slot(resource)].fetch_add(1, std::memory_order_release);
+	}
+	void remove(resource resource)
+	{
+		counters[first_slot(resource)].fetch_sub(1, std::memory_order_release);
+		counters[second_slot(resource)].fetch_sub(1, std::memory_order_release);
+	}
+
+	bool may_contain(resource resource) const
+	{
+		return counters[first_slot(resource)].load(std::memory_order_acquire) != 0 && counters[second_slot(resource)].load(std::memory_order_acquire) != 0;
+	}
+};
+
+// Descriptions of depth-stencil resources, captured when they are created, so that they do not have to be queried from the device every frame
+struct resource_desc_cache
+{
+	std::shared_mutex mutex;
+	std::unordered_map<resource, resource_desc, depth_stencil_hash> descs;
+	// Handles that are in 'descs', which are all the resources the add-on may track (depth-stencils and its backup textures)
+	resource_filter filter;
+
+	// Number of descriptions that were queried from the device since the last telemetry record
+	std::atomic<uint32_t> device_queries = 0;
+
+	void insert(resource resource, const resource_desc &desc)
+	{
+		const std::unique_lock<std::shared_mutex> lock(mutex);
+		if (descs.insert_or_assign(resource, desc).second)
+			filter.add(resource);
+	}
+	void erase(resource resource)
+	{
+		const std::unique_lock<std::shared_mutex> lock(mutex);
+		if (descs.erase(resource) != 0)
+			filter.remove(resource);
+	}
+
+	// Returns false for most resources that are not in the cache, without taking the lock
+	bool may_contain(resource resource) const
+	{
+		return filter.may_contain(resource);
+	}
+
+	bool find(resource resource, resource_desc &desc)
+	{
+		const std::shared_lock<std::shared_mutex> lock(mutex);
+		if (const auto it = descs.find(resource); it != descs.end())
+		{
+			desc = it->second;
+			return true;
+		}
+		return false;
+	}
+
+	// Returns the cached description, or queries and caches it the first time a resource is seen
+	resource_desc get(device *device, resource resource)
+	{
+		resource_desc desc;
+		if (find(resource, desc))
+			return desc;
+
+		desc = device->get_resource_desc(resource);
+		device_queries++;
+
+		insert(resource, desc);
+		return desc;
+	}
 };
 
 struct depth_stencil_backup
@@ -154,15 +640,208 @@ struct depth_stencil_backup
 	// Frame dimensions of the last effect runtime this backup was used with
 	uint32_t frame_width = 0;
 	uint32_t frame_height = 0;
+
+	// Description of the backup texture
+	resource_desc backup_desc;
+
+	// Clear operation (starting at one) that won in previous frames, or zero if nothing was learned yet
+	size_t predicted_clear_index = 0;
+	// Workload rendered before the predicted clear operation
+	uint32_t predicted_vertices = 0;
+	// Number of consecutive frames in which the same clear operation won
+	unsigned int prediction_hits = 0;
+	// Frame the prediction was last updated in, to only learn once per frame when there are multiple effect runtimes
+	uint64_t prediction_frame = 0;
+
+	// Snapshot of the prediction that clear operations of the current frame are checked against (zero clear index while it is not confident)
+	// Command lists are recorded on other threads than the one learning above, so this is only accessed with 'backups_mutex' held
+	size_t frame_predicted_clear_index = 0;
+	uint32_t frame_predicted_vertices = 0;
+
+	// Reference to a shader resource view acquired together with the backup texture from a depth profile, before any effect runtime selected this depth-stencil
+	resource_view prewarmed_view = { 0 };
+
+	bool is_prediction_confident() const
+	{
+		return predicted_clear_index != 0 && prediction_hits >= 4;
+	}
+	static bool matches_prediction(const draw_stats &stats, uint32_t predicted_vertices)
+	{
+		// Allow some variation, since the workload of a scene changes a little from frame to frame
+		const uint32_t tolerance = predicted_vertices / 4;
+		return stats.vertices + tolerance >= predicted_vertices && stats.vertices <= predicted_vertices + tolerance;
+	}
+
+	void update_clear_index_prediction(const depth_stencil_info &snapshot, uint64_t frame)
+	{
+		if (prediction_frame == frame)
+			return;
+		prediction_frame = frame;
+
+		// Find the clear operation the default heuristic ends up using, which is the last one that matched or beat the workload of all before it
+		size_t winner = 0;
+		draw_stats winner_stats;
+		for (size_t clear_index = 1; clear_index <= snapshot.clears.size(); ++clear_index)
+		{
+			const clear_stats &stats = snapshot.clears[clear_index - 1];
+			if (stats.vertices >= winner_stats.vertices || (stats.clear_op == clear_op::fullscreen_draw && stats.drawcalls >= winner_stats.drawcalls))
+			{
+				winner = clear_index;
+				winner_stats = stats;
+			}
+		}
+
+		if (winner != 0 && winner == predicted_clear_index && matches_prediction(winner_stats, predicted_vertices))
+			prediction_hits = std::min(prediction_hits + 1, 1000u);
+		else
+			prediction_hits = 0;
+
+		predicted_clear_index = winner;
+		predicted_vertices = winner_stats.vertices;
+	}
+
+	// Makes what was learned so far the prediction of the next frame, must be called with an exclusive lock on 'backups_mutex'
+	void publish_clear_index_prediction()
+	{
+		frame_predicted_clear_index = is_prediction_confident() ? predicted_clear_index : 0;
+		frame_predicted_vertices = predicted_vertices;
+	}
 };
 
-struct __declspec(uuid("e006e162-33ac-4b9f-b10f-0e15335c7bdb")) generic_depth_device_data
+// Depth settings remembered per game, so that the backup of the right depth-stencil can be prepared before the first frame is rendered
+struct depth_profile
+{
+	// Name of the game this profile is for, or empty when it is not known yet
+	std::string title;
+
+	// Description of the depth-stencil that was selected the last time this game was played
+	uint32_t width = 0;
+	uint32_t height = 0;
+	reshade::api::format format = reshade::api::format::unknown;
+
+	// Clear operation to copy at (see 'depth_stencil_backup::force_clear_index'), or zero for automatic detection
+	size_t clear_index = 0;
+
+	// Linearization parameters of the Citra effect
+	float near_plane = 0.0f;
+	float far_plane = 0.01f;
+	float depth_multiplier = 1.0f;
+	bool has_linearization = false;
+
+	std::string config_section() const
+	{
+		return "DEPTH_PROFILE_" + title;
+	}
+
+	bool matches(const resource_desc &desc) const
+	{
+		return width != 0 && (desc.usage & resource_usage::depth_stencil) != 0 && desc.texture.width == width && desc.texture.height == height && desc.texture.format == format;
+	}
+
+	void load()
+	{
+		const std::string section = config_section();
+
+		uint32_t format_value = 0;
+		width = height = 0;
+		reshade::config_get_value(nullptr, section.c_str(), "Width", width);
+		reshade::config_get_value(nullptr, section.c_str(), "Height", height);
+		reshade::config_get_value(nullptr, section.c_str(), "Format", format_value);
+		format = static_cast<reshade::api::format>(format_value);
+
+		clear_index = 0;
+		reshade::config_get_value(nullptr, section.c_str(), "ClearIndex", clear_index);
+
+		has_linearization =
+			reshade::config_get_value(nullptr, section.c_str(), "NearPlane", near_plane) &&
+			reshade::config_get_value(nullptr, section.c_str(), "FarPlane", far_plane) &&
+			reshade::config_get_value(nullptr, section.c_str(), "DepthMultiplier", depth_multiplier);
+	}
+	void save() const
+	{
+		if (title.empty() || width == 0)
+			return;
+
+		const std::string section = config_section();
+
+		reshade::config_set_value(nullptr, section.c_str(), "Width", width);
+		reshade::config_set_value(nullptr, section.c_str(), "Height", height);
+		reshade::config_set_value(nullptr, section.c_str(), "Format", static_cast<uint32_t>(format));
+		reshade::config_set_value(nullptr, section.c_str(), "ClearIndex", clear_index);
+
+		if (has_linearization)
+		{
+			reshade::config_set_value(nullptr, section.c_str(), "NearPlane", near_plane);
+			reshade::config_set_value(nullptr, section.c_str(), "FarPlane", far_plane);
+			reshade::config_set_value(nullptr, section.c_str(), "DepthMultiplier", depth_multiplier);
+		}
+	}
+};
+
+// Checks whether a depth-stencil could be the one Citra renders a 3DS screen with, which is 240x400 (top screen) or 240x320 (bottom screen) times the internal resolution scale, rotated or not
+static bool is_citra_depth_surface(const resource_desc &desc)
+{
+	switch (desc.texture.format)
+	{
+	case format::d16_unorm:
+	case format::r16_typeless:
+	case format::d24_unorm_x8_uint:
+	case format::d24_unorm_s8_uint:
+	case format::r24_g8_typeless:
+	case format::d32_float:
+	case format::r32_typeless:
+	case format::d32_float_s8_uint:
+	case format::r32_g8_typeless:
+		break;
+	default:
+		return false;
+	}
+
+	const uint32_t width = desc.texture.width;
+	const uint32_t height = desc.texture.height;
+
+	for (const auto &[short_side, long_side] : { std::make_pair(240u, 400u), std::make_pair(240u, 320u) })
+	{
+		for (const auto &[base_width, base_height] : { std::make_pair(short_side, long_side), std::make_pair(long_side, short_side) })
+		{
+			if (width % base_width != 0 || width / base_width == 0 || width / base_width * base_height != height)
+				continue;
+			if (s_citra_resolution_scale == 0 || width / base_width == s_citra_resolution_scale)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+// Checks whether effects have to read from a backup texture instead of directly from the depth-stencil
+static bool needs_backup_texture(device_api api, const resource_desc &desc)
+{
+	// Need to create backup texture only if doing backup copies or original resource does not support shader access (which is necessary for binding it to effects)
+	// Also always create a backup texture in D3D12 or Vulkan to circument problems in case application makes use of resource aliasing
+	return s_preserve_depth_buffers || (desc.usage & resource_usage::shader_resource) == 0 || (api == device_api::d3d12 || api == device_api::vulkan);
+}
+
+// Returns a description for a shader resource view of a depth-stencil or of its backup texture
+static resource_view_desc depth_stencil_view_desc(device_api api, format depth_stencil_format, bool backup)
+{
+	// Same format as backup texture in D3D9, as set in 'track_depth_stencil_for_backup'
+	if (backup && api == device_api::d3d9)
+		return resource_view_desc(format::r32_float);
+
+	// Create two-dimensional resource view to the first level and layer of the depth-stencil resource
+	return resource_view_desc(api != device_api::opengl && api != device_api::vulkan ? format_to_default_typed(depth_stencil_format) : depth_stencil_format);
+}
+
+struct CITRA_UUID("e006e162-33ac-4b9f-b10f-0e15335c7bdb") generic_depth_device_data
 {
 	// List of queues created for this device
 	std::vector<command_queue *> queues;
 
 	// List of resources that were deleted this frame
 	std::vector<resource> destroyed_resources;
+	// List of resources that were deleted during the frame that was presented last, which effects are rendered for after that present
+	std::vector<resource> destroyed_resources_last_frame;
 
 	// List of resources that are enqueued for delayed destruction in the future
 	std::vector<std::pair<resource, int>> delayed_destroy_resources;
@@ -172,6 +851,76 @@ struct __declspec(uuid("e006e162-33ac-4b9f-b10f-0e15335c7bdb")) generic_depth_de
 
 	// List of depth-stencils that should be tracked throughout each frame and potentially be backed up during clear operations
 	std::vector<depth_stencil_backup> depth_stencil_backups;
+	// Clear operations look backups up on the threads recording command lists, so the list and the settings of its backups are only changed with this held exclusively
+	std::shared_mutex backups_mutex;
+
+	struct shared_view
+	{
+		reshade::api::resource resource;
+		resource_view view;
+		// The number of effect runtimes (or prepared backups) referencing this view
+		size_t references;
+	};
+
+	// Shader resource views of backup textures or depth-stencils, shared by all effect runtimes that selected the same depth-stencil
+	std::vector<shared_view> shared_views;
+
+	// Descriptions of all depth-stencils and backup textures on this device
+	resource_desc_cache resource_descs;
+
+	// Number of frames presented on this device
+	uint64_t frame_count = 0;
+
+	// Copies issued to backup textures since the last telemetry record (updated from any thread that records command lists)
+	std::atomic<uint32_t> copies_since_last_record = 0;
+	std::atomic<uint64_t> bytes_copied_since_last_record = 0;
+
+	// Memory held by backup textures, including those enqueued for delayed destruction
+	uint64_t backup_memory = 0;
+
+	// Records are written when effects finish and read by the overlay and the dumps, which only take this lock, so writing a dump does not hold up rendering
+	std::mutex telemetry_mutex;
+	frame_telemetry_ring telemetry;
+
+	// Profile of the game that is currently running
+	depth_profile profile;
+	// Frame the window title was last checked for a change of the running game
+	uint64_t profile_check_frame = 0;
+	// Depth-stencils matching the profile that were created since the last frame, for which a backup should be prepared
+	std::vector<resource> prewarm_depth_stencils;
+	// Frame the last telemetry record was written for, to only write one when there are multiple effect runtimes
+	uint64_t last_recorded_frame = 0;
+
+	quality_governor governor;
+
+	// Set when there was no depth-stencil workload since the previous present (e.g. the emulator presenting the same frame again)
+	bool duplicate_frame = false;
+	uint64_t duplicate_frames = 0;
+	copy_timer duplicate_copy_timer;
+	// Copies requested inside a render pass that could not be made before their command list was submitted
+	std::atomic<uint64_t> dropped_deferred_copies = 0;
+
+	const uint64_t instance = s_next_device_instance++;
+	// Executed command list state of every thread that submitted to a queue of this device, merged and swapped at present (see 'on_execute_primary')
+	std::mutex submission_shards_mutex;
+	std::vector<std::unique_ptr<submission_shard>> submission_shards;
+	// Incremented at present, its lowest bit selects the buffer of each shard that submissions currently go to
+	std::atomic<uint32_t> submission_epoch = 0;
+	// Numbers every command list submission, since the shards are merged in the order threads first submitted and not in the order they submitted this frame
+	std::atomic<uint64_t> next_submission = 1;
+
+	submission_shard &get_submission_shard()
+	{
+		// Only take the lock the first time a thread submits to this device
+		thread_local std::unordered_map<uint64_t, submission_shard *> shard_per_device_instance;
+		submission_shard *&shard = shard_per_device_instance[instance];
+		if (shard == nullptr)
+		{
+			const std::lock_guard<std::mutex> lock(submission_shards_mutex);
+			shard = submission_shards.emplace_back(std::make_unique<submission_shard>()).get();
+		}
+		return *shard;
+	}
 
 	depth_stencil_backup *find_depth_stencil_backup(resource resource)
 	{
@@ -187,6 +936,7 @@ struct __declspec(uuid("e006e162-33ac-4b9f-b10f-0e15335c7bdb")) generic_depth_de
 			[resource](const depth_stencil_backup &existing) { return existing.depth_stencil_resource == resource; });
 		if (it != depth_stencil_backups.end())
 		{
+			// Backups prepared from a depth profile start out without references
 			it->references++;
 			return &(*it);
 		}
@@ -207,20 +957,30 @@ struct __declspec(uuid("e006e162-33ac-4b9f-b10f-0e15335c7bdb")) generic_depth_de
 		// First try to revive a backup resource that was previously enqueued for delayed destruction
 		for (auto delayed_destroy_it = delayed_destroy_resources.begin(); delayed_destroy_it != delayed_destroy_resources.end(); ++delayed_destroy_it)
 		{
-			const resource_desc delayed_destroy_desc = device->get_resource_desc(delayed_destroy_it->first);
+			const resource_desc delayed_destroy_desc = resource_descs.get(device, delayed_destroy_it->first);
 
 			if (desc.texture.width == delayed_destroy_desc.texture.width && desc.texture.height == delayed_destroy_desc.texture.height && desc.texture.format == delayed_destroy_desc.texture.format)
 			{
 				backup.backup_texture = delayed_destroy_it->first;
+				backup.backup_desc = desc;
 				delayed_destroy_resources.erase(delayed_destroy_it);
 				return &backup;
 			}
 		}
 
 		if (device->create_resource(desc, nullptr, resource_usage::copy_dest, &backup.backup_texture))
+		{
 			device->set_resource_name(backup.backup_texture, "ReShade depth backup texture");
+
+			resource_descs.insert(backup.backup_texture, desc);
+
+			backup.backup_desc = desc;
+			backup_memory += texture_memory_size(desc);
+		}
 		else
+		{
 			reshade::log_message(1, "Failed to create backup depth-stencil texture!");
+		}
 
 		return &backup;
 	}
@@ -243,6 +1003,73 @@ struct __declspec(uuid("e006e162-33ac-4b9f-b10f-0e15335c7bdb")) generic_depth_de
 
 		depth_stencil_backups.erase(it);
 	}
+
+	resource_view acquire_shader_resource_view(device *device, resource resource, const resource_view_desc &desc)
+	{
+		for (shared_view &existing : shared_views)
+		{
+			if (existing.resource == resource)
+			{
+				existing.references++;
+				return existing.view;
+			}
+		}
+
+		resource_view view = { 0 };
+		if (!device->create_resource_view(resource, resource_usage::shader_resource, desc, &view))
+			return view;
+
+		shared_views.push_back({ resource, view, 1 });
+		return view;
+	}
+	void release_shader_resource_view(device *device, resource_view view)
+	{
+		const auto it = std::find_if(shared_views.begin(), shared_views.end(),
+			[view](const shared_view &existing) { return existing.view == view; });
+		if (it == shared_views.end() || --it->references != 0)
+			return;
+
+		device->destroy_resource_view(it->view);
+
+		shared_views.erase(it);
+	}
+
+	// Creates a backup texture and view for a depth-stencil that matches the depth profile, before any effect runtime selected it
+	void prewarm_depth_stencil_backup(device *device, resource resource, const resource_desc &desc)
+	{
+		if (find_depth_stencil_backup(resource) != nullptr)
+			return;
+		// Citra usually creates several depth-stencils with the same description (e.g. for both eyes), only prepare one backup at a time for them
+		if (std::any_of(depth_stencil_backups.begin(), depth_stencil_backups.end(), [](const depth_stencil_backup &backup) { return backup.references == 0; }))
+			return;
+
+		depth_stencil_backup &backup = *track_depth_stencil_for_backup(device, resource, desc);
+		backup.references = 0;
+		backup.force_clear_index = profile.clear_index;
+
+		if (backup.backup_texture != 0)
+			backup.prewarmed_view = acquire_shader_resource_view(device, backup.backup_texture, depth_stencil_view_desc(device->get_api(), desc.texture.format, true));
+	}
+
+	// Releases prepared backups of depth-stencils that were destroyed before any effect runtime selected them
+	void release_unused_prewarmed_backups(device *device)
+	{
+		for (auto it = depth_stencil_backups.begin(); it != depth_stencil_backups.end();)
+		{
+			if (it->references != 0 || std::find(destroyed_resources.begin(), destroyed_resources.end(), it->depth_stencil_resource) == destroyed_resources.end())
+			{
+				++it;
+				continue;
+			}
+
+			if (it->prewarmed_view != 0)
+				release_shader_resource_view(device, it->prewarmed_view);
+			if (it->backup_texture != 0)
+				delayed_destroy_resources.emplace_back(it->backup_texture, 50);
+
+			it = depth_stencil_backups.erase(it);
+		}
+	}
 };
 
 // Checks whether the aspect ratio of the two sets of dimensions is similar or not
@@ -261,15 +1088,73 @@ static bool check_aspect_ratio(float width_to_check, float height_to_check, uint
 	return std::fabs(aspect_ratio) <= 0.1f && ((w_ratio <= 1.85f && w_ratio >= 0.5f && h_ratio <= 1.85f && h_ratio >= 0.5f) || (s_use_aspect_ratio_heuristics == 2 && std::modf(w_ratio, &w_ratio) <= 0.02f && std::modf(h_ratio, &h_ratio) <= 0.02f));
 }
 
+// Copies a depth-stencil to its backup texture and returns the number of bytes that were copied
+template <device_api specialized_api>
+static uint64_t copy_depth_stencil_to_backup(command_list *cmd_list, resource depth_stencil, const depth_stencil_backup &backup, const viewport &region)
+{
+	const device_api api = get_api<specialized_api>(cmd_list->get_device());
+
+	// Partial copies of depth-stencil resources are only allowed in OpenGL and Vulkan (D3D10-12 require copying the whole subresource)
+	const bool copy_region = s_copy_depth_region || cmd_list->get_device()->get_private_data<generic_depth_device_data>().governor.level >= 1;
+	if (copy_region && region.width != 0 && region.height != 0 && (api == device_api::opengl || api == device_api::vulkan))
+	{
+		const int32_t width = static_cast<int32_t>(backup.backup_desc.texture.width);
+		const int32_t height = static_cast<int32_t>(backup.backup_desc.texture.height);
+
+		// Viewports with a negative height (used to flip the image in Vulkan) extend upwards from their origin
+		const float top = region.height < 0 ? region.y + region.height : region.y;
+
+		subresource_box box;
+		box.left = std::clamp(static_cast<int32_t>(region.x), 0, width);
+		box.top = std::clamp(static_cast<int32_t>(top), 0, height);
+		box.front = 0;
+		box.right = std::clamp(static_cast<int32_t>(std::ceil(region.x + region.width)), 0, width);
+		box.bottom = std::clamp(static_cast<int32_t>(std::ceil(top + std::fabs(region.height))), 0, height);
+		box.back = 1;
+
+		const bool empty = box.right <= box.left || box.bottom <= box.top;
+		const bool covers_whole_texture = box.left == 0 && box.top == 0 && box.right == width && box.bottom == height;
+		if (!empty && !covers_whole_texture)
+		{
+			cmd_list->copy_texture_region(depth_stencil, 0, &box, backup.backup_texture, 0, &box);
+
+			const format backup_format = backup.backup_desc.texture.format;
+			return format_slice_pitch(backup_format, format_row_pitch(backup_format, box.right - box.left), box.bottom - box.top);
+		}
+	}
+
+	cmd_list->copy_resource(depth_stencil, backup.backup_texture);
+
+	return texture_memory_size(backup.backup_desc);
+}
+
+// Makes a backup copy of a depth-stencil that is currently in the specified state and updates the statistics for it
+template <device_api specialized_api>
+static void backup_depth_stencil(command_list *cmd_list, generic_depth_device_data &device_data, depth_stencil_info &counters, resource depth_stencil, const depth_stencil_backup &backup, const viewport &region, resource_usage usage)
+{
+	cmd_list->barrier(depth_stencil, usage, resource_usage::copy_source);
+	const uint64_t bytes_copied = copy_depth_stencil_to_backup<specialized_api>(cmd_list, depth_stencil, backup, region);
+	cmd_list->barrier(depth_stencil, resource_usage::copy_source, usage);
+
+	counters.copied_during_frame = true;
+
+	device_data.copies_since_last_record++;
+	device_data.bytes_copied_since_last_record += bytes_copied;
+}
+
+template <device_api specialized_api>
 static void on_clear_depth_impl(command_list *cmd_list, state_tracking &state, resource depth_stencil, clear_op op)
 {
 	if (depth_stencil == 0)
 		return;
 
 	device *const device = cmd_list->get_device();
+	generic_depth_device_data &device_data = device->get_private_data<generic_depth_device_data>();
 
-	depth_stencil_backup *const depth_stencil_backup = device->get_private_data<generic_depth_device_data>().find_depth_stencil_backup(depth_stencil);
-	if (depth_stencil_backup == nullptr || depth_stencil_backup->backup_texture == 0)
+	const std::shared_lock<std::shared_mutex> backups_lock(device_data.backups_mutex);
+	depth_stencil_backup *const depth_stencil_backup = device_data.find_depth_stencil_backup(depth_stencil);
+	// Backups prepared from a depth profile are not copied to before an effect runtime selects their depth-stencil, the copy at the end of that frame fills them
+	if (depth_stencil_backup == nullptr || depth_stencil_backup->backup_texture == 0 || depth_stencil_backup->references == 0)
 		return;
 
 	bool do_copy = true;
@@ -303,6 +1188,43 @@ static void on_clear_depth_impl(command_list *cmd_list, state_tracking &state, r
 			{
 				// Use greater equals operator here to handle case where the same scene is first rendered into a shadow map and then for real (e.g. Mirror's Edge main menu)
 				do_copy = counters.current_stats.vertices >= state.best_copy_stats.vertices || (op == clear_op::fullscreen_draw && counters.current_stats.drawcalls >= state.best_copy_stats.drawcalls);
+
+				// Once it is known which clear operation wins each frame, only copy there instead of at every clear that matches the ones before it
+				size_t predicted_clear_index = 0;
+				uint32_t predicted_vertices = 0;
+				if (s_predict_clear_index && !counters.prediction_missed)
+				{
+					predicted_clear_index = depth_stencil_backup->frame_predicted_clear_index;
+					predicted_vertices = depth_stencil_backup->frame_predicted_vertices;
+				}
+
+				// When the prediction turns out wrong, the default heuristic takes over from this clear operation on
+				// Clear operations before it were not copied though, so if one of them was the one to use, the backup of this frame ends up with a later state of the depth-stencil
+				if (predicted_clear_index != 0)
+				{
+					const size_t clear_index = counters.clears.size() + 1;
+
+					if (clear_index < predicted_clear_index)
+					{
+						// Keep track of the workload anyway, so that falling back to the default heuristic later in the frame behaves the same
+						if (do_copy)
+							state.best_copy_stats = counters.current_stats;
+						do_copy = false;
+					}
+					else if (clear_index == predicted_clear_index)
+					{
+						if (depth_stencil_backup->matches_prediction(counters.current_stats, predicted_vertices))
+							do_copy = true;
+						else
+							counters.prediction_missed = true;
+					}
+					else
+					{
+						// Only copy again if a later pass clearly outweighs the predicted one
+						do_copy = counters.current_stats.vertices > state.best_copy_stats.vertices + state.best_copy_stats.vertices / 4;
+						counters.prediction_missed = do_copy;
+					}
+				}
 			}
 			else if (std::numeric_limits<size_t>::max() == depth_stencil_backup->force_clear_index)
 			{
@@ -315,7 +1237,7 @@ static void on_clear_depth_impl(command_list *cmd_list, state_tracking &state, r
 				do_copy = counters.clears.size() == (depth_stencil_backup->force_clear_index - 1);
 			}
 
-			counters.clears.push_back({ counters.current_stats, op, do_copy });
+			counters.clears.push_back({ counters.current_stats, op, do_copy, do_copy && state.render_pass_active });
 		}
 
 		// Make a backup copy of the depth texture before it is cleared
@@ -323,12 +1245,17 @@ static void on_clear_depth_impl(command_list *cmd_list, state_tracking &state, r
 		{
 			state.best_copy_stats = counters.current_stats;
 
-			// A resource has to be in this state for a clear operation, so can assume it here
-			cmd_list->barrier(depth_stencil, resource_usage::depth_stencil_write, resource_usage::copy_source);
-			cmd_list->copy_resource(depth_stencil, depth_stencil_backup->backup_texture);
-			cmd_list->barrier(depth_stencil, resource_usage::copy_source, resource_usage::depth_stencil_write);
-
-			counters.copied_during_frame = true;
+			// A clear or fullscreen draw inside a render pass cannot be copied before, so whether to copy is decided here, but the copy is only made after the render pass ended
+			if (state.render_pass_active)
+			{
+				state.pending_copy_depth_stencil = depth_stencil;
+				state.pending_copy_region = counters.current_stats.last_viewport;
+			}
+			else
+			{
+				// A resource has to be in this state for a clear operation, so can assume it here
+				backup_depth_stencil<specialized_api>(cmd_list, device_data, counters, depth_stencil, *depth_stencil_backup, counters.current_stats.last_viewport, resource_usage::depth_stencil_write);
+			}
 		}
 	}
 
@@ -336,33 +1263,187 @@ static void on_clear_depth_impl(command_list *cmd_list, state_tracking &state, r
 	counters.current_stats = { 0, 0 };
 }
 
+// Returns the number of times the selected depth-stencil changed during the last minute
+static size_t count_recent_reselections(generic_depth_data &data)
+{
+	const auto one_minute_ago = std::chrono::steady_clock::now() - std::chrono::minutes(1);
+
+	data.reselection_times.erase(data.reselection_times.begin(),
+		std::find_if(data.reselection_times.begin(), data.reselection_times.end(), [one_minute_ago](const auto &time) { return time >= one_minute_ago; }));
+
+	return data.reselection_times.size();
+}
+
 static void update_effect_runtime(effect_runtime *runtime)
 {
 	const generic_depth_data &instance = runtime->get_private_data<generic_depth_data>();
 
 	runtime->update_texture_bindings("ORIG_DEPTH", instance.selected_shader_resource);
 
-	runtime->enumerate_uniform_variables(nullptr, [&instance](effect_runtime *runtime, auto variable) {
+	for (const effect_uniform_variable variable : instance.bufready_depth_variables)
+		runtime->set_uniform_value_bool(variable, instance.selected_shader_resource != 0);
+
+	// 'Citra.fx' only renders into the textures of the resolution selected by the divisor, so switching between them does not recompile it
+	const size_t index = instance.depth_resolution_index();
+	const int32_t divisor = static_cast<int32_t>(instance.depth_resolution_divisor);
+	runtime->set_uniform_value_int(instance.depth_resolution_divisor_variable, &divisor, 1);
+	runtime->update_texture_bindings("DEPTH", instance.modified_depth_srv[index], instance.modified_depth_srv_srgb[index]);
+	// Normals are reconstructed from that depth once, so that effects do not each have to do it again (only when 'CITRA_NORMALS' is set, otherwise the texture does not exist and nothing is bound)
+	runtime->update_texture_bindings("NORMALS", instance.modified_normal_srv[index], instance.modified_normal_srv_srgb[index]);
+}
+
+static void on_reloaded_effects(effect_runtime *runtime)
+{
+	generic_depth_data &data = runtime->get_private_data<generic_depth_data>();
+
+	// Handles are invalidated by a reload, so gather them again instead of searching for them by name every time the depth-stencil changes
+	data.bufready_depth_variables.clear();
+	runtime->enumerate_uniform_variables(nullptr, [&data](effect_runtime *runtime, auto variable) {
 		char source[32] = "";
 		if (runtime->get_annotation_string_from_uniform_variable(variable, "source", source) && std::strcmp(source, "bufready_depth") == 0)
-			runtime->set_uniform_value_bool(variable, instance.selected_shader_resource != 0);
+			data.bufready_depth_variables.push_back(variable);
 	});
 
-	resource_view srv, srv_srgb;
+	static const char *const modified_depth_names[3] = { "ModifiedDepthTex", "ModifiedDepthHalfTex", "ModifiedDepthQuarterTex" };
+	static const char *const modified_normal_names[3] = { "ModifiedNormalTex", "ModifiedNormalHalfTex", "ModifiedNormalQuarterTex" };
+	for (size_t i = 0; i < 3; ++i)
+	{
+		data.modified_depth_srv[i] = data.modified_depth_srv_srgb[i] = { 0 };
+		if (const effect_texture_variable ModifiedDepthTex_handle = runtime->find_texture_variable("Citra.fx", modified_depth_names[i]); ModifiedDepthTex_handle != 0)
+			runtime->get_texture_binding(ModifiedDepthTex_handle, &data.modified_depth_srv[i], &data.modified_depth_srv_srgb[i]);
+		data.modified_normal_srv[i] = data.modified_normal_srv_srgb[i] = { 0 };
+		if (const effect_texture_variable ModifiedNormalTex_handle = runtime->find_texture_variable("Citra.fx", modified_normal_names[i]); ModifiedNormalTex_handle != 0)
+			runtime->get_texture_binding(ModifiedNormalTex_handle, &data.modified_normal_srv[i], &data.modified_normal_srv_srgb[i]);
+	}
+
+	data.near_plane_variable = runtime->find_uniform_variable("Citra.fx", "fUINearPlane");
+	data.far_plane_variable = runtime->find_uniform_variable("Citra.fx", "fUIFarPlane");
+	data.depth_multiplier_variable = runtime->find_uniform_variable("Citra.fx", "fUIDepthMultiplier");
+	data.present_type_variable = runtime->find_uniform_variable("Citra.fx", "iUIPresentType");
+	data.depth_resolution_divisor_variable = runtime->find_uniform_variable("Citra.fx", "iCitraDepthResolutionDivisor");
+
+	// Reloading takes long enough to look like a slow frame to the governor
+	{
+		generic_depth_device_data &device_data = runtime->get_device()->get_private_data<generic_depth_device_data>();
+		const std::unique_lock<std::shared_mutex> lock(s_mutex);
+		device_data.governor.settle();
+	}
+
+	update_effect_runtime(runtime);
+}
+
+// Returns the name of the running game, or an empty string if no game is running
+static std::string get_game_title([[maybe_unused]] effect_runtime *runtime)
+{
+	std::string title;
+#ifdef _WIN32
+	// The swap chain window is a child of the Citra main window, which is the one that has the title
+	char window_title[256] = "";
+	GetWindowTextA(GetAncestor(static_cast<HWND>(runtime->get_hwnd()), GA_ROOT), window_title, sizeof(window_title));
+
+	// Citra puts the name of the game after the emulator version, separated by '|'
+	title = window_title;
+	const size_t separator = title.rfind('|');
+	if (separator == std::string::npos)
+		return std::string();
+	title.erase(0, separator + 1);
+#else
+	// There is no Citra window to read the title of outside of Windows, so the name of the game has to be set in the configuration instead
+	char configured_title[256] = "";
+	size_t configured_title_size = sizeof(configured_title);
+	if (!reshade::config_get_value(nullptr, "DEPTH", "GameTitle", configured_title, &configured_title_size))
+		return std::string();
+	title = configured_title;
+#endif
+
+	// Only keep characters that can be used in a configuration section name
+	std::string name;
+	for (const char c : title)
+	{
+		if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'))
+			name += c;
+		else if (!name.empty() && name.back() != '_')
+			name += '_';
+	}
+	while (!name.empty() && name.back() == '_')
+		name.pop_back();
+
+	return name;
+}
+
+static void save_depth_profile(effect_runtime *runtime)
+{
+	device *const device = runtime->get_device();
+	const generic_depth_data &data = runtime->get_private_data<generic_depth_data>();
+	generic_depth_device_data &device_data = device->get_private_data<generic_depth_device_data>();
+
+	depth_profile &profile = device_data.profile;
+	if (profile.title.empty() || data.selected_depth_stencil == 0)
+		return;
+
+	const resource_desc desc = device_data.resource_descs.get(device, data.selected_depth_stencil);
+	profile.width = desc.texture.width;
+	profile.height = desc.texture.height;
+	profile.format = desc.texture.format;
+
+	{
+		const std::shared_lock<std::shared_mutex> backups_lock(device_data.backups_mutex);
+		if (const depth_stencil_backup *const depth_stencil_backup = device_data.find_depth_stencil_backup(data.selected_depth_stencil))
+			profile.clear_index = depth_stencil_backup->force_clear_index;
+	}
+
+	profile.has_linearization = data.near_plane_variable != 0 && data.far_plane_variable != 0 && data.depth_multiplier_variable != 0;
+	if (profile.has_linearization)
+	{
+		runtime->get_uniform_value_float(data.near_plane_variable, &profile.near_plane, 1);
+		runtime->get_uniform_value_float(data.far_plane_variable, &profile.far_plane, 1);
+		runtime->get_uniform_value_float(data.depth_multiplier_variable, &profile.depth_multiplier, 1);
+	}
+
+	profile.save();
+}
 
-	effect_texture_variable ModifiedDepthTex_handle = runtime->find_texture_variable("Citra.fx", "ModifiedDepthTex");
-	runtime->get_texture_binding(ModifiedDepthTex_handle, &srv, &srv_srgb);
+// Writes the frame telemetry of the device to the working directory (1 = CSV, 2 = binary)
+static void dump_telemetry(generic_depth_device_data &device_data, unsigned int format)
+{
+	// Write a copy of the records, so that effects can finish and record frames while the file is written
+	std::unique_ptr<frame_telemetry_ring> telemetry;
+	{
+		const std::lock_guard<std::mutex> telemetry_lock(device_data.telemetry_mutex);
+		telemetry = std::make_unique<frame_telemetry_ring>(device_data.telemetry);
+	}
 
-	runtime->update_texture_bindings("DEPTH", srv, srv_srgb);
+	if (format == 1)
+		telemetry->write_csv("citra_telemetry.csv");
+	else if (format == 2)
+		telemetry->write_binary("citra_telemetry.bin");
 }
 
 static void on_init_device(device *device)
 {
-	device->create_private_data<generic_depth_device_data>();
+	generic_depth_device_data &device_data = device->create_private_data<generic_depth_device_data>();
+	// Partial copies of depth-stencil resources are only allowed in OpenGL and Vulkan (see 'copy_depth_stencil_to_backup')
+	device_data.governor.region_copies = device->get_api() == device_api::opengl || device->get_api() == device_api::vulkan;
 
 	reshade::config_get_value(nullptr, "DEPTH", "DisableINTZ", s_disable_intz);
 	reshade::config_get_value(nullptr, "DEPTH", "DepthCopyBeforeClears", s_preserve_depth_buffers);
 	reshade::config_get_value(nullptr, "DEPTH", "UseAspectRatioHeuristics", s_use_aspect_ratio_heuristics);
+	reshade::config_get_value(nullptr, "DEPTH", "DepthSelectionHysteresisFrames", s_selection_hysteresis_frames);
+	reshade::config_get_value(nullptr, "DEPTH", "DepthCopyPrediction", s_predict_clear_index);
+	reshade::config_get_value(nullptr, "DEPTH", "DepthCopyRegion", s_copy_depth_region);
+	reshade::config_get_value(nullptr, "DEPTH", "GovernorTargetFrameRate", s_governor_target_frame_rate);
+	reshade::config_get_value(nullptr, "DEPTH", "DumpTelemetryOnExit", s_dump_telemetry_on_exit);
+	reshade::config_get_value(nullptr, "DEPTH", "CitraSurfacesOnly", s_citra_surfaces_only);
+	reshade::config_get_value(nullptr, "DEPTH", "CitraResolutionScale", s_citra_resolution_scale);
+
+	{
+		const std::unique_lock<std::shared_mutex> lock(s_mutex);
+
+		// The API never changes for a device, so the hot callbacks can be specialized for it, unless there are devices of other APIs too
+		s_device_api = (s_devices++ == 0 || s_device_api == device->get_api()) ? device->get_api() : any_api;
+	}
+
+	update_hot_path_events();
 }
 static void on_init_command_list(command_list *cmd_list)
 {
@@ -381,24 +1462,47 @@ static void on_init_command_queue(command_queue *cmd_queue)
 static void on_init_effect_runtime(effect_runtime *runtime)
 {
 	runtime->create_private_data<generic_depth_data>();
+
+	s_effect_runtimes++;
+	update_hot_path_events();
 }
 static void on_destroy_device(device *device)
 {
 	auto &device_data = device->get_private_data<generic_depth_device_data>();
 
+	if (s_dump_telemetry_on_exit != 0)
+		dump_telemetry(device_data, s_dump_telemetry_on_exit);
+
 	// Destroy any remaining resources
 	for (const auto &[resource, _] : device_data.delayed_destroy_resources)
 	{
 		device->destroy_resource(resource);
 	}
 
+	for (const auto &shared_view : device_data.shared_views)
+	{
+		device->destroy_resource_view(shared_view.view);
+	}
+
 	for (depth_stencil_backup &depth_stencil_backup : device_data.depth_stencil_backups)
 	{
 		if (depth_stencil_backup.backup_texture != 0)
 			device->destroy_resource(depth_stencil_backup.backup_texture);
 	}
 
+	if (device_data.duplicate_copy_timer.heap != 0)
+		device->destroy_query_heap(device_data.duplicate_copy_timer.heap);
+
 	device->destroy_private_data<generic_depth_device_data>();
+
+	{
+		const std::unique_lock<std::shared_mutex> lock(s_mutex);
+
+		if (--s_devices == 0)
+			s_device_api = any_api;
+	}
+
+	update_hot_path_events();
 }
 static void on_destroy_command_list(command_list *cmd_list)
 {
@@ -416,20 +1520,31 @@ static void on_destroy_effect_runtime(effect_runtime *runtime)
 	device *const device = runtime->get_device();
 	generic_depth_data &data = runtime->get_private_data<generic_depth_data>();
 
+	save_depth_profile(runtime);
+	stop_capture(runtime, data);
+
 	if (data.selected_shader_resource != 0)
-		device->destroy_resource_view(data.selected_shader_resource);
+		device->get_private_data<generic_depth_device_data>().release_shader_resource_view(device, data.selected_shader_resource);
+
+	s_effect_runtimes--;
+	if (data.override_depth_stencil != 0)
+		s_pinned_effect_runtimes--;
+	update_hot_path_events();
 
 	runtime->destroy_private_data<generic_depth_data>();
 }
 
+template <device_api specialized_api>
 static bool on_create_resource(device *device, resource_desc &desc, subresource_data *, resource_usage)
 {
 	if (desc.type != resource_type::surface && desc.type != resource_type::texture_2d)
 		return false; // Skip resources that are not 2D textures
 	if (desc.texture.samples != 1 || (desc.usage & resource_usage::depth_stencil) == 0 || desc.texture.format == format::s8_uint)
 		return false; // Skip MSAA textures and resources that are not used as depth buffers
+	if (s_citra_surfaces_only && !is_citra_depth_surface(desc))
+		return false; // Skip shadow maps and other surfaces of the rasterizer cache, so that they keep their optimal format
 
-	switch (device->get_api())
+	switch (get_api<specialized_api>(device))
 	{
 	case device_api::d3d9:
 		if (s_disable_intz)
@@ -462,13 +1577,36 @@ static bool on_create_resource(device *device, resource_desc &desc, subresource_
 
 	return true;
 }
+static void on_init_resource(device *device, const resource_desc &desc, const subresource_data *, resource_usage, resource resource)
+{
+	if (desc.type != resource_type::surface && desc.type != resource_type::texture_2d)
+		return;
+	if ((desc.usage & resource_usage::depth_stencil) == 0)
+		return;
+	// Leaving a depth-stencil out of the description cache also keeps it out of tracking (see 'on_bind_depth_stencil')
+	if (s_citra_surfaces_only && !is_citra_depth_surface(desc))
+		return;
+
+	generic_depth_device_data &device_data = device->get_private_data<generic_depth_device_data>();
+
+	device_data.resource_descs.insert(resource, desc);
+
+	// Prepare a backup for depth-stencils that look like the one selected the last time the running game was played
+	const std::unique_lock<std::shared_mutex> lock(s_mutex);
+	if (device_data.profile.matches(desc))
+		device_data.prewarm_depth_stencils.push_back(resource);
+}
+template <device_api specialized_api>
 static bool on_create_resource_view(device *device, resource resource, resource_usage usage_type, resource_view_desc &desc)
 {
 	// A view cannot be created with a typeless format (which was set in 'on_create_resource' above), so fix it in case defaults are used
-	if ((device->get_api() != device_api::d3d10 && device->get_api() != device_api::d3d11) || desc.format != format::unknown)
+	if (const device_api api = get_api<specialized_api>(device); (api != device_api::d3d10 && api != device_api::d3d11) || desc.format != format::unknown)
 		return false;
 
-	const resource_desc texture_desc = device->get_resource_desc(resource);
+	resource_desc texture_desc;
+	// Only depth-stencils are in the description cache, so anything else was not modified
+	if (!device->get_private_data<generic_depth_device_data>().resource_descs.find(resource, texture_desc))
+		return false;
 	// Only non-MSAA textures where modified, so skip all others
 	if (texture_desc.texture.samples != 1 || (texture_desc.usage & resource_usage::depth_stencil) == 0)
 		return false;
@@ -504,10 +1642,19 @@ static void on_destroy_resource(device *device, resource resource)
 	if (std::addressof(device_data) == nullptr)
 		return;
 
+	// Citra destroys lots of textures all the time, most of which were never tracked, so avoid taking the lock for those
+	// Only depth-stencils in the description cache become candidates for selection (see 'on_present'), so all others can be ignored here
+	if (!device_data.resource_descs.may_contain(resource))
+		return;
+
+	device_data.resource_descs.erase(resource);
+
 	std::unique_lock<std::shared_mutex> lock(s_mutex);
 
 	device_data.destroyed_resources.push_back(resource);
 
+	device_data.prewarm_depth_stencils.erase(std::remove(device_data.prewarm_depth_stencils.begin(), device_data.prewarm_depth_stencils.end(), resource), device_data.prewarm_depth_stencils.end());
+
 	// Remove this destroyed resource from the list of tracked depth-stencil resources
 	const auto it = std::find_if(device_data.current_depth_stencil_list.begin(), device_data.current_depth_stencil_list.end(),
 		[resource](const auto &current) { return current.first == resource; });
@@ -526,11 +1673,12 @@ static void on_destroy_resource(device *device, resource resource)
 			reshade::log_message(2, "A depth-stencil resource was destroyed while still being tracked.");
 
 			if (!copied_during_frame)
-				Sleep(250);
+				std::this_thread::sleep_for(std::chrono::milliseconds(250));
 		}
 	}
 }
 
+template <device_api specialized_api>
 static bool on_draw(command_list *cmd_list, uint32_t vertices, uint32_t instances, uint32_t, uint32_t)
 {
 	auto &state = cmd_list->get_private_data<state_tracking>();
@@ -541,10 +1689,8 @@ static bool on_draw(command_list *cmd_list, uint32_t vertices, uint32_t instance
 	const bool fullscreen_draw = vertices == 6 && instances == 1;
 	if (fullscreen_draw &&
 		s_preserve_depth_buffers == 2 &&
-		state.first_draw_since_bind &&
-		// But ignore that in Vulkan (since it is invalid to copy a resource inside an active render pass)
-		cmd_list->get_device()->get_api() != device_api::vulkan)
-		on_clear_depth_impl(cmd_list, state, state.current_depth_stencil, clear_op::fullscreen_draw);
+		state.first_draw_since_bind)
+		on_clear_depth_impl<specialized_api>(cmd_list, state, state.current_depth_stencil, clear_op::fullscreen_draw);
 
 	state.first_draw_since_bind = false;
 
@@ -556,13 +1702,14 @@ static bool on_draw(command_list *cmd_list, uint32_t vertices, uint32_t instance
 
 	// Skip updating last viewport for fullscreen draw calls, to prevent a clear operation in Prince of Persia: The Sands of Time from getting filtered out
 	if (!fullscreen_draw)
-		counters.current_stats.last_viewport = state.current_viewport;
+		counters.current_stats.last_viewport = counters.total_stats.last_viewport = state.current_viewport;
 
 	return false;
 }
+template <device_api specialized_api>
 static bool on_draw_indexed(command_list *cmd_list, uint32_t indices, uint32_t instances, uint32_t, int32_t, uint32_t)
 {
-	on_draw(cmd_list, indices, instances, 0, 0);
+	on_draw<specialized_api>(cmd_list, indices, instances, 0, 0);
 
 	return false;
 }
@@ -580,11 +1727,27 @@ static bool on_draw_indirect(command_list *cmd_list, indirect_command type, reso
 	counters.total_stats.drawcalls_indirect += draw_count;
 	counters.current_stats.drawcalls += draw_count;
 	counters.current_stats.drawcalls_indirect += draw_count;
-	counters.current_stats.last_viewport = state.current_viewport;
+	counters.current_stats.last_viewport = counters.total_stats.last_viewport = state.current_viewport;
 
 	return false;
 }
 
+// Makes the copy that was scheduled at the end of the last render pass, now that no render pass is active anymore
+template <device_api specialized_api>
+static void flush_pending_depth_stencil_copy(command_list *cmd_list, state_tracking &state, resource_usage usage)
+{
+	const resource depth_stencil = std::exchange(state.pending_copy_depth_stencil, resource { 0 });
+
+	generic_depth_device_data &device_data = cmd_list->get_device()->get_private_data<generic_depth_device_data>();
+
+	const std::shared_lock<std::shared_mutex> backups_lock(device_data.backups_mutex);
+	const depth_stencil_backup *const depth_stencil_backup = device_data.find_depth_stencil_backup(depth_stencil);
+	if (depth_stencil_backup == nullptr || depth_stencil_backup->backup_texture == 0)
+		return;
+
+	backup_depth_stencil<specialized_api>(cmd_list, device_data, state.counters_per_used_depth_stencil[depth_stencil], depth_stencil, *depth_stencil_backup, state.pending_copy_region, usage);
+}
+
 static void on_bind_viewport(command_list *cmd_list, uint32_t first, uint32_t count, const viewport *viewport)
 {
 	if (first != 0 || count == 0)
@@ -593,11 +1756,23 @@ static void on_bind_viewport(command_list *cmd_list, uint32_t first, uint32_t co
 	auto &state = cmd_list->get_private_data<state_tracking>();
 	state.current_viewport = viewport[0];
 }
+template <device_api specialized_api>
 static void on_bind_depth_stencil(command_list *cmd_list, uint32_t, const resource_view *, resource_view depth_stencil_view)
 {
 	auto &state = cmd_list->get_private_data<state_tracking>();
 
-	const resource depth_stencil = (depth_stencil_view != 0) ? cmd_list->get_device()->get_resource_from_view(depth_stencil_view) : resource{ 0 };
+	resource depth_stencil = (depth_stencil_view != 0) ? cmd_list->get_device()->get_resource_from_view(depth_stencil_view) : resource{ 0 };
+
+	// Treat depth-stencils that were not admitted as if none was bound, so that draw calls with them are not counted
+	// Without the filter there is nothing to look up here, depth-stencils that are not in the description cache yet are added to it when they become candidates (see 'on_present')
+	if (s_citra_surfaces_only && depth_stencil != 0 && depth_stencil != state.current_depth_stencil)
+	{
+		resource_desc_cache &resource_descs = cmd_list->get_device()->get_private_data<generic_depth_device_data>().resource_descs;
+
+		resource_desc desc;
+		if (!resource_descs.may_contain(depth_stencil) || !resource_descs.find(depth_stencil, desc))
+			depth_stencil = { 0 };
+	}
 
 	if (depth_stencil != state.current_depth_stencil)
 	{
@@ -607,12 +1782,13 @@ static void on_bind_depth_stencil(command_list *cmd_list, uint32_t, const resour
 		// Make a backup of the depth texture before it is used differently, since in D3D12 or Vulkan the underlying memory may be aliased to a different resource, so cannot just access it at the end of the frame
 		if (s_preserve_depth_buffers == 2 &&
 			state.current_depth_stencil != 0 && depth_stencil == 0 && (
-			cmd_list->get_device()->get_api() == device_api::d3d12 || cmd_list->get_device()->get_api() == device_api::vulkan))
-			on_clear_depth_impl(cmd_list, state, state.current_depth_stencil, clear_op::unbind_depth_stencil_view);
+			get_api<specialized_api>(cmd_list->get_device()) == device_api::d3d12 || get_api<specialized_api>(cmd_list->get_device()) == device_api::vulkan))
+			on_clear_depth_impl<specialized_api>(cmd_list, state, state.current_depth_stencil, clear_op::unbind_depth_stencil_view);
 	}
 
 	state.current_depth_stencil = depth_stencil;
 }
+template <device_api specialized_api>
 static bool on_clear_depth_stencil(command_list *cmd_list, resource_view dsv, const float *depth, const uint8_t *, uint32_t, const rect *)
 {
 	// Ignore clears that do not affect the depth buffer (stencil clears)
@@ -622,26 +1798,66 @@ static bool on_clear_depth_stencil(command_list *cmd_list, resource_view dsv, co
 
 		const resource depth_stencil = cmd_list->get_device()->get_resource_from_view(dsv);
 
-		// Note: This does not work when called from 'vkCmdClearAttachments', since it is invalid to copy a resource inside an active render pass
-		on_clear_depth_impl(cmd_list, state, depth_stencil, clear_op::clear_depth_stencil_view);
+		// Note: When called from 'vkCmdClearAttachments' this is inside an active render pass, so the copy is deferred to the end of it
+		on_clear_depth_impl<specialized_api>(cmd_list, state, depth_stencil, clear_op::clear_depth_stencil_view);
 	}
 
 	return false;
 }
+template <device_api specialized_api>
 static void on_begin_render_pass_with_depth_stencil(command_list *cmd_list, uint32_t, const render_pass_render_target_desc *, const render_pass_depth_stencil_desc *depth_stencil_desc)
 {
+	auto &state = cmd_list->get_private_data<state_tracking>();
+
+	// Last chance to make a copy that was deferred from the previous render pass, which has to come before the copy of a clear when this render pass loads the depth-stencil, since that one is newer
+	if (state.pending_copy_depth_stencil != 0)
+		flush_pending_depth_stencil_copy<specialized_api>(cmd_list, state, resource_usage::depth_stencil_write);
+
 	if (depth_stencil_desc != nullptr && depth_stencil_desc->depth_load_op == render_pass_load_op::clear)
 	{
-		on_clear_depth_stencil(cmd_list, depth_stencil_desc->view, &depth_stencil_desc->clear_depth, nullptr, 0, nullptr);
+		on_clear_depth_stencil<specialized_api>(cmd_list, depth_stencil_desc->view, &depth_stencil_desc->clear_depth, nullptr, 0, nullptr);
 
 		// Prevent 'on_bind_depth_stencil' from copying depth buffer again
-		auto &state = cmd_list->get_private_data<state_tracking>();
 		state.current_depth_stencil = { 0 };
 	}
 
 	// If render pass has depth store operation set to 'discard', any copy performed after the render pass will likely contain broken data, so can only hope that the depth buffer can be copied before that ...
 
-	on_bind_depth_stencil(cmd_list, 0, nullptr, depth_stencil_desc != nullptr ? depth_stencil_desc->view : resource_view{});
+	on_bind_depth_stencil<specialized_api>(cmd_list, 0, nullptr, depth_stencil_desc != nullptr ? depth_stencil_desc->view : resource_view{});
+
+	state.render_pass_active = true;
+}
+static void on_end_render_pass(command_list *cmd_list)
+{
+	auto &state = cmd_list->get_private_data<state_tracking>();
+
+	// This is called before the render pass actually ends, so a copy requested inside it is only made at the next barrier, render pass or when the command list is closed
+	state.render_pass_active = false;
+}
+template <device_api specialized_api>
+static void on_barrier(command_list *cmd_list, uint32_t count, const resource *resources, const resource_usage *, const resource_usage *new_states)
+{
+	auto &state = cmd_list->get_private_data<state_tracking>();
+	if (state.pending_copy_depth_stencil == 0 || state.render_pass_active)
+		return;
+
+	// Render passes usually leave the depth-stencil in the depth write state, unless the application transitions it right after
+	resource_usage usage = resource_usage::depth_stencil_write;
+	for (uint32_t i = 0; i < count; ++i)
+		if (resources[i] == state.pending_copy_depth_stencil)
+			usage = new_states[i];
+
+	flush_pending_depth_stencil_copy<specialized_api>(cmd_list, state, usage);
+}
+
+template <device_api specialized_api>
+static void on_close(command_list *cmd_list)
+{
+	auto &state = cmd_list->get_private_data<state_tracking>();
+
+	// Nothing can be recorded after this, so make a copy that was deferred from the last render pass of this command list now
+	if (state.pending_copy_depth_stencil != 0 && !state.render_pass_active)
+		flush_pending_depth_stencil_copy<specialized_api>(cmd_list, state, resource_usage::depth_stencil_write);
 }
 
 static void on_reset(command_list *cmd_list)
@@ -657,7 +1873,19 @@ static void on_execute_primary(command_queue *queue, command_list *cmd_list)
 	// Skip merging state when this execution event is just the immediate command list getting flushed
 	if (std::addressof(target_state) != std::addressof(source_state))
 	{
-		target_state.merge(source_state);
+		// Command lists may be executed from several threads at once (and concurrently to present), so merge into a buffer owned by the calling thread instead of the queue state
+		generic_depth_device_data &device_data = queue->get_device()->get_private_data<generic_depth_device_data>();
+		submission_shard &shard = device_data.get_submission_shard();
+
+		// A copy that is still pending was requested in a render pass that did not end before the command list was closed, so it is lost
+		if (source_state.pending_copy_depth_stencil != 0)
+			device_data.dropped_deferred_copies++;
+
+		// Announce the write before reading the epoch, so that 'on_present' either waits for it to finish or this already sees the next epoch
+		const uint64_t submission = device_data.next_submission++;
+		shard.writing.store(true);
+		shard.states[device_data.submission_epoch.load() & 1].merge(source_state, submission);
+		shard.writing.store(false, std::memory_order_release);
 	}
 }
 static void on_execute_secondary(command_list *cmd_list, command_list *secondary_cmd_list)
@@ -674,48 +1902,103 @@ static void on_execute_secondary(command_list *cmd_list, command_list *secondary
 	}
 	else
 	{
-		target_state.merge(source_state);
+		// Bundles are often executed many times per frame, so flatten their state once and only add that up on every execution
+		std::shared_ptr<const state_summary> summary = std::atomic_load(&source_state.summary);
+		if (summary == nullptr)
+		{
+			summary = source_state.summarize();
+			std::atomic_store(&source_state.summary, summary);
+		}
+
+		target_state.merge(*summary);
 	}
 }
 
-static void on_present(command_queue *, swapchain *swapchain, const rect *, const rect *, uint32_t, const rect *)
+static void on_present(command_queue *queue, swapchain *swapchain, const rect *, const rect *, uint32_t, const rect *)
 {
 	device *const device = swapchain->get_device();
 	generic_depth_device_data &device_data = device->get_private_data<generic_depth_device_data>();
 
+	// Redirect further submissions to the other buffer of each shard, then take the buffer of the last frame once no thread is merging into it anymore
+	// This waits on the submitting threads, so is done before taking the global lock, which those threads need for their draw and clear events
+	state_tracking submitted_state;
+	const uint32_t epoch = device_data.submission_epoch.fetch_add(1);
+	{
+		const std::lock_guard<std::mutex> shards_lock(device_data.submission_shards_mutex);
+		for (const std::unique_ptr<submission_shard> &shard : device_data.submission_shards)
+		{
+			while (shard->writing.load())
+				std::this_thread::yield();
+
+			state_tracking &shard_state = shard->states[epoch & 1];
+			submitted_state.merge(shard_state);
+			shard_state.reset_on_present();
+		}
+	}
+
 	const std::unique_lock<std::shared_mutex> lock(s_mutex);
 
-	// Merge state from all graphics queues
+	device_data.frame_count++;
+
+	const auto now = std::chrono::steady_clock::now();
+	if (s_governor_target_frame_rate == 0 && device_data.governor.level != 0)
+		device_data.governor.reset();
+	else if (s_governor_target_frame_rate != 0 && device_data.governor.last_present != std::chrono::steady_clock::time_point())
+		device_data.governor.update(std::chrono::duration<float, std::milli>(now - device_data.governor.last_present).count(), 1000.0f / s_governor_target_frame_rate);
+	device_data.governor.last_present = now;
+
+	// Merge state from all graphics queues (which only contains something for immediate contexts that record directly on the queue)
 	state_tracking queue_state;
 	for (command_queue *const queue : device_data.queues)
 		queue_state.merge(queue->get_private_data<state_tracking>());
+	queue_state.merge(submitted_state);
 
-	// Only update device list if there are any depth-stencils, otherwise this may be a second present call (at which point 'reset_on_present' already cleared out the queue list in the first present call)
-	if (queue_state.counters_per_used_depth_stencil.empty())
-		return;
+	// Clears were appended per shard, so put them back in the order their command lists were submitted in (clears recorded directly on a queue stay in front)
+	for (auto &[depth_stencil_handle, snapshot] : queue_state.counters_per_used_depth_stencil)
+		std::stable_sort(snapshot.clears.begin(), snapshot.clears.end(),
+			[](const clear_stats &a, const clear_stats &b) { return a.submission < b.submission; });
 
+	// Only update device list if there are any depth-stencils, otherwise this may be a second present call (at which point 'reset_on_present' already cleared out the queue list in the first present call)
 	// Also skip update when there has been very little activity (special case for emulators like PCSX2 which may present more often than they render a frame)
-	if (queue_state.counters_per_used_depth_stencil.size() == 1 && queue_state.counters_per_used_depth_stencil.begin()->second.total_stats.drawcalls <= 8)
-		return;
+	// Nothing is known about the workload while draw calls are not tracked, so consider every frame new then
+	device_data.duplicate_frame = s_draw_events_registered && (queue_state.counters_per_used_depth_stencil.empty() ||
+		(queue_state.counters_per_used_depth_stencil.size() == 1 && queue_state.counters_per_used_depth_stencil.begin()->second.total_stats.drawcalls <= 8));
+	if (device_data.duplicate_frame)
+	{
+		// Keep the depth-stencil list of the last frame (which 'on_destroy_resource' keeps free of destroyed resources), but still do the cleanup below
+		device_data.duplicate_frames++;
+	}
+	else
+	{
+		device_data.current_depth_stencil_list.clear();
+		device_data.current_depth_stencil_list.reserve(queue_state.counters_per_used_depth_stencil.size());
 
-	device_data.current_depth_stencil_list.clear();
-	device_data.current_depth_stencil_list.reserve(queue_state.counters_per_used_depth_stencil.size());
+		for (const auto &[resource, snapshot] : queue_state.counters_per_used_depth_stencil)
+		{
+			if (snapshot.total_stats.drawcalls == 0)
+				continue; // Skip unused
 
-	for (const auto &[resource, snapshot] : queue_state.counters_per_used_depth_stencil)
-	{
-		if (snapshot.total_stats.drawcalls == 0)
-			continue; // Skip unused
+			if (std::find(device_data.destroyed_resources.begin(), device_data.destroyed_resources.end(), resource) != device_data.destroyed_resources.end())
+				continue; // Skip resources that were destroyed by the application
 
-		if (std::find(device_data.destroyed_resources.begin(), device_data.destroyed_resources.end(), resource) != device_data.destroyed_resources.end())
-			continue; // Skip resources that were destroyed by the application
+			// Depth-stencils that were created before the add-on was loaded (or without an 'init_resource' event) are not in the description cache yet
+			// Add them now, since 'on_destroy_resource' ignores resources that are not in the cache
+			device_data.resource_descs.get(device, resource);
 
-		// Save to current list of depth-stencils on the device, so that it can be displayed in the GUI
-		device_data.current_depth_stencil_list.emplace_back(resource, snapshot);
+			// Save to current list of depth-stencils on the device, so that it can be displayed in the GUI
+			device_data.current_depth_stencil_list.emplace_back(resource, snapshot);
+		}
 	}
 
+	// The few draw calls of a duplicate frame are dropped from the queues as well, the same as from the submission shards above
 	for (command_queue *const queue : device_data.queues)
 		queue->get_private_data<state_tracking>().reset_on_present();
 
+	{
+		const std::unique_lock<std::shared_mutex> backups_lock(device_data.backups_mutex);
+		device_data.release_unused_prewarmed_backups(device);
+	}
+	device_data.destroyed_resources_last_frame.swap(device_data.destroyed_resources);
 	device_data.destroyed_resources.clear();
 
 	// Destroy resources that were enqueued for delayed destruction and have reached the targeted number of passed frames
@@ -723,6 +2006,8 @@ static void on_present(command_queue *, swapchain *swapchain, const rect *, cons
 	{
 		if (--it->second == 0)
 		{
+			device_data.backup_memory -= texture_memory_size(device_data.resource_descs.get(device, it->first));
+			device_data.resource_descs.erase(it->first);
 			device->destroy_resource(it->first);
 
 			it = device_data.delayed_destroy_resources.erase(it);
@@ -732,6 +2017,79 @@ static void on_present(command_queue *, swapchain *swapchain, const rect *, cons
 			++it;
 		}
 	}
+
+	if (queue != nullptr)
+		device_data.duplicate_copy_timer.update(device, queue, device_data.frame_count);
+}
+
+// Switches to the depth profile of the running game when it changed
+static void update_depth_profile(effect_runtime *runtime, generic_depth_device_data &device_data)
+{
+	// Only check the window title every few seconds, since that has to go through the window manager
+	if (device_data.profile_check_frame != 0 && device_data.frame_count < device_data.profile_check_frame + 120)
+		return;
+	device_data.profile_check_frame = device_data.frame_count;
+
+	std::string title = get_game_title(runtime);
+	if (title == device_data.profile.title)
+		return;
+
+	// Remember the settings of the previous game before switching
+	save_depth_profile(runtime);
+
+	std::unique_lock<std::shared_mutex> lock(s_mutex);
+
+	device_data.profile = depth_profile();
+	device_data.profile.title = std::move(title);
+	if (device_data.profile.title.empty())
+		return;
+
+	device_data.profile.load();
+
+	// Depth-stencils of the game may have been created before its name showed up in the window title
+	{
+		const std::shared_lock<std::shared_mutex> descs_lock(device_data.resource_descs.mutex);
+		for (const auto &[resource, desc] : device_data.resource_descs.descs)
+			if (device_data.profile.matches(desc))
+				device_data.prewarm_depth_stencils.push_back(resource);
+	}
+
+	const depth_profile profile = device_data.profile;
+
+	lock.unlock();
+
+	if (profile.has_linearization)
+	{
+		const generic_depth_data &data = runtime->get_private_data<generic_depth_data>();
+		if (data.near_plane_variable != 0)
+			runtime->set_uniform_value_float(data.near_plane_variable, &profile.near_plane, 1);
+		if (data.far_plane_variable != 0)
+			runtime->set_uniform_value_float(data.far_plane_variable, &profile.far_plane, 1);
+		if (data.depth_multiplier_variable != 0)
+			runtime->set_uniform_value_float(data.depth_multiplier_variable, &profile.depth_multiplier, 1);
+	}
+}
+
+// Prepares backups for depth-stencils matching the depth profile, so that effects have valid depth from the first frame they are selected on
+static void prewarm_depth_stencil_backups(device *device, generic_depth_device_data &device_data)
+{
+	std::unique_lock<std::shared_mutex> lock(s_mutex);
+	if (device_data.prewarm_depth_stencils.empty())
+		return;
+	const std::vector<resource> prewarm_depth_stencils = std::move(device_data.prewarm_depth_stencils);
+	device_data.prewarm_depth_stencils.clear();
+	// Unlock while calling into device below (see 'on_begin_render_effects')
+	lock.unlock();
+
+	for (const resource depth_stencil : prewarm_depth_stencils)
+	{
+		const resource_desc desc = device_data.resource_descs.get(device, depth_stencil);
+		if (needs_backup_texture(device->get_api(), desc))
+		{
+			const std::unique_lock<std::shared_mutex> backups_lock(device_data.backups_mutex);
+			device_data.prewarm_depth_stencil_backup(device, depth_stencil, desc);
+		}
+	}
 }
 
 static void on_begin_render_effects(effect_runtime *runtime, command_list *cmd_list, resource_view, resource_view)
@@ -744,28 +2102,79 @@ static void on_begin_render_effects(effect_runtime *runtime, command_list *cmd_l
 	resource_desc best_match_desc;
 	const depth_stencil_info *best_snapshot = nullptr;
 
-	uint32_t frame_width, frame_height;
-	runtime->get_screenshot_width_and_height(&frame_width, &frame_height);
+	uint32_t frame_width, frame_height;
+	runtime->get_screenshot_width_and_height(&frame_width, &frame_height);
+
+	update_depth_profile(runtime, device_data);
+	prewarm_depth_stencil_backups(device, device_data);
+
+	std::shared_lock<std::shared_mutex> lock(s_mutex);
+
+	// Only a uniform and the texture bindings change with the resolution, so this does not recompile 'Citra.fx'
+	if (const unsigned int divisor = device_data.governor.depth_resolution_divisor(); divisor != data.depth_resolution_divisor)
+	{
+		data.depth_resolution_divisor = divisor;
+		update_effect_runtime(runtime);
+	}
+
+	// The depth of the last frame is still current when nothing was rendered since, so keep what is bound instead of running selection (which would also count this frame towards switching depth-stencils) and copying again
+	// That only works while the selected depth-stencil still exists, otherwise selection has to run to let go of it
+	const auto was_destroyed = [&device_data](resource resource) {
+		return std::find(device_data.destroyed_resources.begin(), device_data.destroyed_resources.end(), resource) != device_data.destroyed_resources.end() ||
+			std::find(device_data.destroyed_resources_last_frame.begin(), device_data.destroyed_resources_last_frame.end(), resource) != device_data.destroyed_resources_last_frame.end();
+	};
+	if (device_data.duplicate_frame && data.selected_shader_resource != 0 && !was_destroyed(data.selected_depth_stencil))
+	{
+		lock.unlock();
+
+		if (data.using_backup_texture)
+			device_data.duplicate_copy_timer.skip(device_data.frame_count);
+
+		// Undo the transitions made in 'on_finish_render_effects'
+		if (data.using_backup_texture)
+		{
+			cmd_list->barrier(device->get_resource_from_view(data.selected_shader_resource), resource_usage::copy_dest, resource_usage::shader_resource);
+		}
+		else
+		{
+			if (device->get_api() <= device_api::d3d11)
+				cmd_list->bind_render_targets_and_depth_stencil(0, nullptr);
+
+			cmd_list->barrier(data.selected_depth_stencil, resource_usage::depth_stencil | resource_usage::shader_resource, resource_usage::shader_resource);
+		}
+		return;
+	}
 
-	std::shared_lock<std::shared_mutex> lock(s_mutex);
 	const auto current_depth_stencil_list = device_data.current_depth_stencil_list;
 	// Unlock while calling into device below, since device may hold a lock itself and that then can deadlock another thread that calls into 'on_destroy_resource' from the device holding that lock
 	lock.unlock();
 
+	// The depth-stencil selected in previous frames, in case it is still a valid candidate
+	resource incumbent = { 0 };
+	resource_desc incumbent_desc;
+	const depth_stencil_info *incumbent_snapshot = nullptr;
+
 	for (auto &[resource, snapshot] : current_depth_stencil_list)
 	{
-		const resource_desc desc = device->get_resource_desc(resource);
+		const resource_desc desc = device_data.resource_descs.get(device, resource);
 		if (desc.texture.samples > 1)
 			continue; // Ignore MSAA textures, since they would need to be resolved first
 
 		if (s_use_aspect_ratio_heuristics && !check_aspect_ratio(static_cast<float>(desc.texture.width), static_cast<float>(desc.texture.height), frame_width, frame_height))
 			continue; // Not a good fit
 
-		if (best_snapshot == nullptr || (snapshot.total_stats.drawcalls_indirect < (snapshot.total_stats.drawcalls / 3) ?
-			// Choose snapshot with the most vertices, since that is likely to contain the main scene
-			snapshot.total_stats.vertices > best_snapshot->total_stats.vertices :
-		// Or check draw calls, since vertices may not be accurate if application is using indirect draw calls
-		snapshot.total_stats.drawcalls > best_snapshot->total_stats.drawcalls))
+		// Prefer the exact same resource, but otherwise accept one that looks exactly like it, in case it was recreated
+		// Before anything was selected, start with the depth-stencil the depth profile of the running game remembers
+		if (resource == data.selected_depth_stencil || (incumbent != data.selected_depth_stencil && surface_signature(desc) == data.selected_signature) ||
+			(data.selected_depth_stencil == 0 && incumbent == 0 && device_data.profile.matches(desc)))
+		{
+			incumbent = resource;
+			incumbent_desc = desc;
+			incumbent_snapshot = &snapshot;
+		}
+
+		// Choose snapshot with the most workload, since that is likely to contain the main scene
+		if (best_snapshot == nullptr || selection_score(snapshot) > selection_score(*best_snapshot))
 		{
 			best_match = resource;
 			best_match_desc = desc;
@@ -773,6 +2182,42 @@ static void on_begin_render_effects(effect_runtime *runtime, command_list *cmd_l
 		}
 	}
 
+	// Only switch away from the selected depth-stencil after another one has clearly had more workload for a number of consecutive frames, since every switch has to recreate resources and wait for the GPU
+	if (s_selection_hysteresis_frames != 0 && incumbent_snapshot != nullptr && best_match != incumbent)
+	{
+		const uint32_t incumbent_score = selection_score(*incumbent_snapshot);
+
+		if (selection_score(*best_snapshot) > incumbent_score + incumbent_score / 2)
+		{
+			if (data.challenger_depth_stencil == best_match)
+				data.challenger_frames++;
+			else
+			{
+				data.challenger_depth_stencil = best_match;
+				data.challenger_frames = 1;
+			}
+		}
+		else
+		{
+			data.challenger_frames = 0;
+		}
+
+		if (data.challenger_frames < s_selection_hysteresis_frames)
+		{
+			best_match = incumbent;
+			best_match_desc = incumbent_desc;
+			best_snapshot = incumbent_snapshot;
+		}
+		else
+		{
+			data.challenger_frames = 0;
+		}
+	}
+	else
+	{
+		data.challenger_frames = 0;
+	}
+
 	if (data.override_depth_stencil != 0)
 	{
 		const auto it = std::find_if(current_depth_stencil_list.begin(), current_depth_stencil_list.end(),
@@ -780,9 +2225,26 @@ static void on_begin_render_effects(effect_runtime *runtime, command_list *cmd_l
 		if (it != current_depth_stencil_list.end())
 		{
 			best_match = it->first;
-			best_match_desc = device->get_resource_desc(it->first);
+			best_match_desc = device_data.resource_descs.get(device, it->first);
 			best_snapshot = &it->second;
 		}
+		// Draw calls are not tracked while every effect runtime has a depth-stencil pinned, so it never shows up in the list then
+		else if (!s_draw_events_registered)
+		{
+			// Only destroyed depth-stencils are missing from the description cache, in which case go back to automatic selection
+			if (device_data.resource_descs.find(data.override_depth_stencil, best_match_desc))
+			{
+				static const depth_stencil_info untracked_snapshot;
+				best_match = data.override_depth_stencil;
+				best_snapshot = &untracked_snapshot;
+			}
+			else
+			{
+				data.override_depth_stencil = { 0 };
+				s_pinned_effect_runtimes--;
+				update_hot_path_events();
+			}
+		}
 	}
 
 	if (best_match != 0)
@@ -791,27 +2253,38 @@ static void on_begin_render_effects(effect_runtime *runtime, command_list *cmd_l
 
 		depth_stencil_backup *depth_stencil_backup = device_data.find_depth_stencil_backup(best_match);
 
+		data.selected_signature = surface_signature(best_match_desc);
+
 		if (best_match != data.selected_depth_stencil || data.selected_shader_resource == 0 || (s_preserve_depth_buffers && depth_stencil_backup == nullptr))
 		{
-			// Destroy previous resource view, since the underlying resource has changed
-			if (data.selected_shader_resource != 0)
+			std::unique_lock<std::shared_mutex> backups_lock(device_data.backups_mutex);
+
+			if (best_match != data.selected_depth_stencil && data.selected_depth_stencil != 0)
 			{
-				runtime->get_command_queue()->wait_idle(); // Ensure resource view is no longer in-use before destroying it
-				device->destroy_resource_view(data.selected_shader_resource);
+				data.reselection_times.push_back(std::chrono::steady_clock::now());
+				count_recent_reselections(data);
+			}
 
+			const resource_view previous_shader_resource = data.selected_shader_resource;
+			if (previous_shader_resource != 0)
 				device_data.untrack_depth_stencil(data.selected_depth_stencil);
-			}
 
 			data.using_backup_texture = false;
 			data.selected_depth_stencil = best_match;
 			data.selected_shader_resource = { 0 };
 
-			// Create two-dimensional resource view to the first level and layer of the depth-stencil resource
-			resource_view_desc srv_desc(api != device_api::opengl && api != device_api::vulkan ? format_to_default_typed(best_match_desc.texture.format) : best_match_desc.texture.format);
+			// Destroy previous resource view, since the underlying resource has changed
+			if (previous_shader_resource != 0)
+			{
+				// Waiting for the GPU takes a while, so do not hold up the threads recording command lists in the meantime
+				backups_lock.unlock();
+				runtime->get_command_queue()->wait_idle(); // Ensure resource view is no longer in-use before destroying it
+				backups_lock.lock();
+
+				device_data.release_shader_resource_view(device, previous_shader_resource);
+			}
 
-			// Need to create backup texture only if doing backup copies or original resource does not support shader access (which is necessary for binding it to effects)
-			// Also always create a backup texture in D3D12 or Vulkan to circument problems in case application makes use of resource aliasing
-			if (s_preserve_depth_buffers || (best_match_desc.usage & resource_usage::shader_resource) == 0 || (api == device_api::d3d12 || api == device_api::vulkan))
+			if (needs_backup_texture(api, best_match_desc))
 			{
 				depth_stencil_backup = device_data.track_depth_stencil_for_backup(device, best_match, best_match_desc);
 
@@ -827,17 +2300,21 @@ static void on_begin_render_effects(effect_runtime *runtime, command_list *cmd_l
 				else
 					depth_stencil_backup->force_clear_index = 0;
 
-				if (api == device_api::d3d9)
-					srv_desc.format = format::r32_float; // Same format as backup texture, as set in 'track_depth_stencil_for_backup'
+				// A clear index remembered for the running game takes precedence over the global one
+				if (s_preserve_depth_buffers && device_data.profile.matches(best_match_desc) && device_data.profile.clear_index != 0)
+					depth_stencil_backup->force_clear_index = device_data.profile.clear_index;
 
-				if (!device->create_resource_view(depth_stencil_backup->backup_texture, resource_usage::shader_resource, srv_desc, &data.selected_shader_resource))
+				// Take over the reference to the view that was prepared from the depth profile if there is one, otherwise share the view with other effect runtimes
+				if (depth_stencil_backup->prewarmed_view != 0)
+					data.selected_shader_resource = std::exchange(depth_stencil_backup->prewarmed_view, resource_view { 0 });
+				else if ((data.selected_shader_resource = device_data.acquire_shader_resource_view(device, depth_stencil_backup->backup_texture, depth_stencil_view_desc(api, best_match_desc.texture.format, true))) == 0)
 					return;
 
 				data.using_backup_texture = true;
 			}
 			else
 			{
-				if (!device->create_resource_view(best_match, resource_usage::shader_resource, srv_desc, &data.selected_shader_resource))
+				if ((data.selected_shader_resource = device_data.acquire_shader_resource_view(device, best_match, depth_stencil_view_desc(api, best_match_desc.texture.format, false))) == 0)
 					return;
 			}
 
@@ -849,6 +2326,14 @@ static void on_begin_render_effects(effect_runtime *runtime, command_list *cmd_l
 			assert(depth_stencil_backup != nullptr && depth_stencil_backup->backup_texture != 0 && best_snapshot != nullptr);
 			const resource backup_texture = depth_stencil_backup->backup_texture;
 
+			if (s_preserve_depth_buffers && depth_stencil_backup->force_clear_index == 0)
+			{
+				depth_stencil_backup->update_clear_index_prediction(*best_snapshot, device_data.frame_count);
+
+				const std::unique_lock<std::shared_mutex> backups_lock(device_data.backups_mutex);
+				depth_stencil_backup->publish_clear_index_prediction();
+			}
+
 			// Copy to backup texture unless already copied during the current frame
 			if (!best_snapshot->copied_during_frame && (best_match_desc.usage & resource_usage::copy_source) != 0)
 			{
@@ -861,14 +2346,24 @@ static void on_begin_render_effects(effect_runtime *runtime, command_list *cmd_l
 				// Indicate that the copy is now being done, so it is not repeated in case effects are rendered by another runtime (e.g. when there are multiple present calls in a frame)
 				if (it != device_data.current_depth_stencil_list.end())
 					it->second.copied_during_frame = true;
-				else
+				else if (s_draw_events_registered)
 					// Resource disappeared from the current depth-stencil list between earlier in this function and now, which indicates that it was destroyed in the meantime
 					return;
 				lock.unlock();
 
+				const uint32_t timestamp_index = device_data.duplicate_copy_timer.begin(device, device_data.frame_count);
+				if (timestamp_index != std::numeric_limits<uint32_t>::max())
+					cmd_list->end_query(device_data.duplicate_copy_timer.heap, query_type::timestamp, timestamp_index);
+
 				cmd_list->barrier(best_match, old_state, resource_usage::copy_source);
-				cmd_list->copy_resource(best_match, backup_texture);
+				const uint64_t bytes_copied = copy_depth_stencil_to_backup<any_api>(cmd_list, best_match, *depth_stencil_backup, best_snapshot->total_stats.last_viewport);
 				cmd_list->barrier(best_match, resource_usage::copy_source, old_state);
+
+				if (timestamp_index != std::numeric_limits<uint32_t>::max())
+					cmd_list->end_query(device_data.duplicate_copy_timer.heap, query_type::timestamp, timestamp_index + 1);
+
+				device_data.copies_since_last_record++;
+				device_data.bytes_copied_since_last_record += bytes_copied;
 			}
 
 			cmd_list->barrier(backup_texture, resource_usage::copy_dest, resource_usage::shader_resource);
@@ -890,8 +2385,9 @@ static void on_begin_render_effects(effect_runtime *runtime, command_list *cmd_l
 			if (data.selected_shader_resource != 0)
 			{
 				runtime->get_command_queue()->wait_idle(); // Ensure resource view is no longer in-use before destroying it
-				device->destroy_resource_view(data.selected_shader_resource);
+				device_data.release_shader_resource_view(device, data.selected_shader_resource);
 
+				const std::unique_lock<std::shared_mutex> backups_lock(device_data.backups_mutex);
 				device_data.untrack_depth_stencil(data.selected_depth_stencil);
 			}
 
@@ -903,9 +2399,241 @@ static void on_begin_render_effects(effect_runtime *runtime, command_list *cmd_l
 		}
 	}
 }
+static void record_frame_telemetry(generic_depth_device_data &device_data, const generic_depth_data &data)
+{
+	const std::shared_lock<std::shared_mutex> lock(s_mutex);
+	const std::lock_guard<std::mutex> telemetry_lock(device_data.telemetry_mutex);
+
+	if (device_data.last_recorded_frame == device_data.frame_count)
+		return;
+	device_data.last_recorded_frame = device_data.frame_count;
+
+	frame_telemetry record;
+	record.frame_index = device_data.frame_count;
+	record.selected_depth_stencil = data.selected_depth_stencil.handle;
+	record.candidate_depth_stencils = static_cast<uint32_t>(device_data.current_depth_stencil_list.size());
+
+	for (const auto &[resource, snapshot] : device_data.current_depth_stencil_list)
+	{
+		record.drawcalls += snapshot.total_stats.drawcalls;
+		record.drawcalls_indirect += snapshot.total_stats.drawcalls_indirect;
+		record.vertices += snapshot.total_stats.vertices;
+
+		if (resource != data.selected_depth_stencil)
+			continue;
+
+		// The last copied clear is the one whose data ended up in the backup texture
+		for (size_t clear_index = snapshot.clears.size(); clear_index != 0; --clear_index)
+		{
+			if (snapshot.clears[clear_index - 1].copied_during_frame)
+			{
+				record.copied_clear_index = static_cast<uint32_t>(clear_index);
+				break;
+			}
+		}
+	}
+
+	record.copies = device_data.copies_since_last_record.exchange(0);
+	record.bytes_copied = device_data.bytes_copied_since_last_record.exchange(0);
+	record.resource_desc_queries = device_data.resource_descs.device_queries.exchange(0);
+	{
+		const std::shared_lock<std::shared_mutex> backups_lock(device_data.backups_mutex);
+		record.backups = static_cast<uint32_t>(device_data.depth_stencil_backups.size());
+		record.backup_memory = device_data.backup_memory;
+	}
+	record.duplicate = device_data.duplicate_frame ? 1 : 0;
+
+	device_data.telemetry.push(record);
+}
+
+static void destroy_capture_slot(device *device, frame_capture::slot &slot)
+{
+	if (slot.color != 0)
+		device->destroy_resource(slot.color);
+	if (slot.depth != 0)
+		device->destroy_resource(slot.depth);
+
+	slot = frame_capture::slot();
+}
+
+static bool read_capture_texture(device *device, resource texture, uint32_t width, uint32_t height, uint8_t *out)
+{
+	subresource_data mapped;
+	if (!device->map_texture_region(texture, 0, nullptr, map_access::read_only, &mapped))
+		return false;
+
+	// Both color and depth have four bytes per pixel, rows are padded though
+	const size_t row_size = static_cast<size_t>(width) * 4;
+	for (uint32_t y = 0; y < height; ++y)
+		std::memcpy(out + y * row_size, static_cast<const uint8_t *>(mapped.data) + static_cast<size_t>(y) * mapped.row_pitch, row_size);
+
+	device->unmap_texture_region(texture, 0);
+	return true;
+}
+
+static void read_capture_slot(device *device, frame_capture &capture, frame_capture::slot &slot)
+{
+	slot.pending = false;
+
+	citra_capture::frame frame;
+	frame.info = slot.info;
+	frame.color.resize(static_cast<size_t>(slot.info.color_width) * slot.info.color_height * 4);
+	frame.depth.resize(static_cast<size_t>(slot.info.depth_width) * slot.info.depth_height);
+
+	if (!read_capture_texture(device, slot.color, slot.info.color_width, slot.info.color_height, frame.color.data()) ||
+		!read_capture_texture(device, slot.depth, slot.info.depth_width, slot.info.depth_height, reinterpret_cast<uint8_t *>(frame.depth.data())))
+	{
+		capture.last_error = "Failed to read back a captured frame.";
+		return;
+	}
+
+	// Compression and disk access happen on the writer thread, which drops frames instead of blocking when it cannot keep up
+	capture.writer.submit(std::move(frame));
+}
+
+static void start_capture(generic_depth_data &data, const generic_depth_device_data &device_data)
+{
+	auto capture = std::make_unique<frame_capture>();
+	capture->path = "citra_capture_" + std::to_string(device_data.frame_count) + ".ccap";
+	if (!capture->writer.open(capture->path.c_str()))
+	{
+		reshade::log_message(1, ("Failed to open \"" + capture->path + "\" for writing.").c_str());
+		return;
+	}
+
+	data.capture = std::move(capture);
+}
+
+static void stop_capture(effect_runtime *runtime, generic_depth_data &data)
+{
+	if (data.capture == nullptr)
+		return;
+
+	device *const device = runtime->get_device();
+
+	// The newest frames may still be in flight, and mapping does not wait for them in every API, so wait for the GPU (which is fine once)
+	runtime->get_command_queue()->wait_idle();
+
+	// Read back those frames from the oldest to the newest
+	for (size_t i = 0; i < frame_capture::ring_size; ++i)
+	{
+		frame_capture::slot &slot = data.capture->slots[(data.capture->next_slot + i) % frame_capture::ring_size];
+		if (slot.pending)
+			read_capture_slot(device, *data.capture, slot);
+		destroy_capture_slot(device, slot);
+	}
+
+	data.capture->writer.close();
+	data.capture.reset();
+}
+
+static void capture_frame(effect_runtime *runtime, command_list *cmd_list, generic_depth_data &data, generic_depth_device_data &device_data)
+{
+	device *const device = runtime->get_device();
+	frame_capture &capture = *data.capture;
+
+	const resource back_buffer = runtime->get_current_back_buffer();
+	const resource_view depth_srv = data.modified_depth_srv[data.depth_resolution_index()];
+	const resource depth = depth_srv != 0 ? device->get_resource_from_view(depth_srv) : resource { 0 };
+	if (depth == 0)
+	{
+		capture.last_error = "'Citra.fx' is not loaded, so there is no normalized depth to capture.";
+		return;
+	}
+
+	resource_desc color_desc = device->get_resource_desc(back_buffer);
+	resource_desc depth_desc = device->get_resource_desc(depth);
+
+	citra_capture::color_order color_format;
+	switch (color_desc.texture.format)
+	{
+	case format::r8g8b8a8_unorm:
+	case format::r8g8b8a8_unorm_srgb:
+		color_format = citra_capture::color_order::rgba8;
+		break;
+	case format::b8g8r8a8_unorm:
+	case format::b8g8r8a8_unorm_srgb:
+		color_format = citra_capture::color_order::bgra8;
+		break;
+	default:
+		capture.last_error = "The format of the back buffer is not supported for captures.";
+		return;
+	}
+
+	frame_capture::slot &slot = capture.slots[capture.next_slot];
+	capture.next_slot = (capture.next_slot + 1) % frame_capture::ring_size;
+
+	// This slot was copied 'ring_size' frames ago, so read it back before reusing it
+	if (slot.pending)
+		read_capture_slot(device, capture, slot);
+
+	// Staging textures have to match the source exactly, so recreate them when the window was resized or the depth resolution changed
+	const auto same_texture = [](const resource_desc &a, const resource_desc &b) {
+		return a.texture.width == b.texture.width && a.texture.height == b.texture.height && a.texture.format == b.texture.format;
+	};
+	if (slot.color == 0 || !same_texture(slot.color_desc, color_desc) || !same_texture(slot.depth_desc, depth_desc))
+	{
+		destroy_capture_slot(device, slot);
+
+		slot.color_desc = resource_desc(color_desc.texture.width, color_desc.texture.height, 1, 1, color_desc.texture.format, 1, memory_heap::gpu_to_cpu, resource_usage::copy_dest);
+		slot.depth_desc = resource_desc(depth_desc.texture.width, depth_desc.texture.height, 1, 1, depth_desc.texture.format, 1, memory_heap::gpu_to_cpu, resource_usage::copy_dest);
+
+		if (!device->create_resource(slot.color_desc, nullptr, resource_usage::copy_dest, &slot.color) ||
+			!device->create_resource(slot.depth_desc, nullptr, resource_usage::copy_dest, &slot.depth))
+		{
+			destroy_capture_slot(device, slot);
+			capture.last_error = "Failed to create staging textures for the capture.";
+			return;
+		}
+	}
+
+	cmd_list->barrier(back_buffer, resource_usage::render_target, resource_usage::copy_source);
+	cmd_list->copy_resource(back_buffer, slot.color);
+	cmd_list->barrier(back_buffer, resource_usage::copy_source, resource_usage::render_target);
+
+	cmd_list->barrier(depth, resource_usage::shader_resource, resource_usage::copy_source);
+	cmd_list->copy_resource(depth, slot.depth);
+	cmd_list->barrier(depth, resource_usage::copy_source, resource_usage::shader_resource);
+
+	slot.info = citra_capture::frame_info();
+	slot.info.frame_index = device_data.frame_count;
+	slot.info.color_width = color_desc.texture.width;
+	slot.info.color_height = color_desc.texture.height;
+	slot.info.color_format = color_format;
+	slot.info.depth_width = depth_desc.texture.width;
+	slot.info.depth_height = depth_desc.texture.height;
+	if (data.present_type_variable != 0)
+		runtime->get_uniform_value_int(data.present_type_variable, &slot.info.present_type, 1);
+	if (data.near_plane_variable != 0)
+		runtime->get_uniform_value_float(data.near_plane_variable, &slot.info.near_plane, 1);
+	if (data.far_plane_variable != 0)
+		runtime->get_uniform_value_float(data.far_plane_variable, &slot.info.far_plane, 1);
+	if (data.depth_multiplier_variable != 0)
+		runtime->get_uniform_value_float(data.depth_multiplier_variable, &slot.info.depth_multiplier, 1);
+
+	{
+		const std::shared_lock<std::shared_mutex> lock(s_mutex);
+		const std::lock_guard<std::mutex> telemetry_lock(device_data.telemetry_mutex);
+
+		// Telemetry of this frame was just recorded
+		if (const frame_telemetry *const record = device_data.telemetry.latest(); record != nullptr && record->frame_index == device_data.frame_count)
+			slot.info.clear_index = record->copied_clear_index;
+	}
+
+	slot.pending = true;
+	capture.last_error = nullptr;
+}
+
 static void on_finish_render_effects(effect_runtime *runtime, command_list *cmd_list, resource_view, resource_view)
 {
-	const generic_depth_data &data = runtime->get_private_data<generic_depth_data>();
+	generic_depth_data &data = runtime->get_private_data<generic_depth_data>();
+	generic_depth_device_data &device_data = runtime->get_device()->get_private_data<generic_depth_device_data>();
+
+	record_frame_telemetry(device_data, data);
+
+	// Duplicate presents have nothing new to record, and neither does a capture that can no longer be written
+	if (data.capture != nullptr && !device_data.duplicate_frame && !data.capture->writer.failed())
+		capture_frame(runtime, cmd_list, data, device_data);
 
 	if (data.selected_shader_resource != 0)
 	{
@@ -980,6 +2708,7 @@ static void draw_settings_overlay(effect_runtime *runtime)
 	{
 		s_preserve_depth_buffers = copy_before_clear_operations ? 1 : 0;
 		reshade::config_set_value(nullptr, "DEPTH", "DepthCopyBeforeClears", s_preserve_depth_buffers);
+		update_hot_path_events();
 		force_reset = true;
 	}
 
@@ -995,12 +2724,115 @@ static void draw_settings_overlay(effect_runtime *runtime)
 		}
 	}
 
+	if (s_preserve_depth_buffers)
+	{
+		if (bool predict_clear_index = s_predict_clear_index != 0;
+			ImGui::Checkbox("Learn which clear operation to copy at to make only one copy per frame", &predict_clear_index))
+		{
+			s_predict_clear_index = predict_clear_index ? 1 : 0;
+			reshade::config_set_value(nullptr, "DEPTH", "DepthCopyPrediction", s_predict_clear_index);
+		}
+	}
+
+	if (bool citra_surfaces_only = s_citra_surfaces_only != 0;
+		ImGui::Checkbox("Only consider depth buffers with the shape of a 3DS screen (applies to depth buffers created afterwards)", &citra_surfaces_only))
+	{
+		s_citra_surfaces_only = citra_surfaces_only ? 1 : 0;
+		reshade::config_set_value(nullptr, "DEPTH", "CitraSurfacesOnly", s_citra_surfaces_only);
+		force_reset = true;
+	}
+
+	if (device->get_api() == device_api::opengl || device->get_api() == device_api::vulkan)
+	{
+		if (bool copy_region = s_copy_depth_region != 0;
+			ImGui::Checkbox("Copy only the area of the last viewport (e.g. the top screen)", &copy_region))
+		{
+			s_copy_depth_region = copy_region ? 1 : 0;
+			reshade::config_set_value(nullptr, "DEPTH", "DepthCopyRegion", s_copy_depth_region);
+		}
+	}
+
 	ImGui::Spacing();
 	ImGui::Separator();
 	ImGui::Spacing();
 
 	std::shared_lock<std::shared_mutex> lock(s_mutex);
 
+	ImGui::Text("Depth buffer re-selections in the last minute: %zu", count_recent_reselections(data));
+
+	if (s_governor_target_frame_rate != 0)
+	{
+		static const char *const level_descriptions[quality_governor::max_level + 1] = {
+			"full quality",
+			"copying only the last viewport area",
+			"copying only the last viewport area, depth at half resolution",
+			"copying only the last viewport area, depth at quarter resolution",
+		};
+
+		const unsigned int level = device_data.governor.level;
+		ImGui::Text("Quality governor: %.2f ms average (target %.2f ms) | level %u: %s",
+			device_data.governor.average_frame_time, 1000.0f / s_governor_target_frame_rate, level, level_descriptions[level]);
+	}
+
+	{
+		const std::lock_guard<std::mutex> telemetry_lock(device_data.telemetry_mutex);
+		const frame_telemetry *const last_frame = device_data.telemetry.latest();
+		ImGui::Text("Frame telemetry: %zu of %zu frames recorded | %u copies last frame", device_data.telemetry.size, frame_telemetry_ring::capacity, last_frame != nullptr ? last_frame->copies : 0u);
+	}
+	{
+		const std::lock_guard<std::mutex> timer_lock(device_data.duplicate_copy_timer.mutex);
+		ImGui::Text("Duplicate frames: %llu skipped | depth copy takes %.3f ms on the GPU | %.1f ms of GPU time saved", static_cast<unsigned long long>(device_data.duplicate_frames), device_data.duplicate_copy_timer.average_copy_time, device_data.duplicate_copy_timer.saved_time);
+	}
+	if (const uint64_t dropped_deferred_copies = device_data.dropped_deferred_copies.load(); dropped_deferred_copies != 0)
+		ImGui::Text("%llu copies requested inside a render pass were lost, since the command list ended before the render pass", static_cast<unsigned long long>(dropped_deferred_copies));
+	unsigned int dump_format = 0;
+	if (ImGui::Button("Dump to CSV"))
+		dump_format = 1;
+	ImGui::SameLine();
+	if (ImGui::Button("Dump to binary file"))
+		dump_format = 2;
+	if (dump_format != 0)
+	{
+		// Writing the file takes a while, so do not keep threads that want an exclusive lock waiting for it
+		lock.unlock();
+		dump_telemetry(device_data, dump_format);
+		lock.lock();
+	}
+
+	if (data.capture != nullptr)
+	{
+		ImGui::Text("Capturing to %s: %llu frames written, %llu dropped (%.1f MB)", data.capture->path.c_str(),
+			static_cast<unsigned long long>(data.capture->writer.frames_written()), static_cast<unsigned long long>(data.capture->writer.frames_dropped()), data.capture->writer.bytes_written() / (1024.0 * 1024.0));
+		if (data.capture->writer.failed())
+			ImGui::TextUnformatted("Writing the capture failed (e.g. because the disk is full), so no further frames are recorded. The frames written before are still readable.");
+		else if (data.capture->last_error != nullptr)
+			ImGui::Text("%s", data.capture->last_error);
+		if (ImGui::Button("Stop capture"))
+			stop_capture(runtime, data);
+	}
+	else if (ImGui::Button("Start capturing color and depth"))
+	{
+		start_capture(data, device_data);
+	}
+
+	ImGui::Spacing();
+	ImGui::Separator();
+	ImGui::Spacing();
+
+	if (!s_draw_events_registered && data.override_depth_stencil != 0)
+	{
+		lock.unlock();
+
+		ImGui::Text("Depth buffer 0x%016llx is pinned, so draw calls are not tracked.", static_cast<unsigned long long>(data.override_depth_stencil.handle));
+		if (ImGui::Button("Unpin to choose a different depth buffer"))
+		{
+			data.override_depth_stencil = { 0 };
+			s_pinned_effect_runtimes--;
+			update_hot_path_events();
+		}
+		return;
+	}
+
 	if (device_data.current_depth_stencil_list.empty())
 	{
 		ImGui::TextUnformatted("No depth buffers found.");
@@ -1011,7 +2843,7 @@ static void draw_settings_overlay(effect_runtime *runtime)
 	struct depth_stencil_item
 	{
 		unsigned int display_count;
-		resource resource;
+		reshade::api::resource resource;
 		depth_stencil_info snapshot;
 		resource_desc desc;
 	};
@@ -1024,11 +2856,11 @@ static void draw_settings_overlay(effect_runtime *runtime)
 		if (auto it = data.display_count_per_depth_stencil.find(resource);
 			it == data.display_count_per_depth_stencil.end())
 		{
-			sorted_item_list.push_back({ 1u, resource, snapshot, device->get_resource_desc(resource) });
+			sorted_item_list.push_back({ 1u, resource, snapshot, device_data.resource_descs.get(device, resource) });
 		}
 		else
 		{
-			sorted_item_list.push_back({ it->second + 1u, resource, snapshot, device->get_resource_desc(resource) });
+			sorted_item_list.push_back({ it->second + 1u, resource, snapshot, device_data.resource_descs.get(device, resource) });
 		}
 	}
 
@@ -1049,7 +2881,7 @@ static void draw_settings_overlay(effect_runtime *runtime)
 		data.display_count_per_depth_stencil[item.resource] = item.display_count;
 
 		char label[512] = "";
-		sprintf_s(label, "%c 0x%016llx", (item.resource == data.selected_depth_stencil ? '>' : ' '), item.resource.handle);
+		std::snprintf(label, sizeof(label), "%c 0x%016llx", (item.resource == data.selected_depth_stencil ? '>' : ' '), static_cast<unsigned long long>(item.resource.handle));
 
 		if (item.desc.texture.samples > 1) // Disable widget for MSAA textures
 		{
@@ -1062,7 +2894,12 @@ static void draw_settings_overlay(effect_runtime *runtime)
 		if (bool value = (item.resource == data.override_depth_stencil);
 			ImGui::Checkbox(label, &value))
 		{
+			if (value && data.override_depth_stencil == 0)
+				s_pinned_effect_runtimes++;
+			else if (!value && data.override_depth_stencil != 0)
+				s_pinned_effect_runtimes--;
 			data.override_depth_stencil = value ? item.resource : resource{ 0 };
+			update_hot_path_events();
 			force_reset = true;
 		}
 
@@ -1098,13 +2935,16 @@ static void draw_settings_overlay(effect_runtime *runtime)
 			{
 				const auto &clear_stats = item.snapshot.clears[clear_index - 1];
 
-				sprintf_s(label, "%c   CLEAR %2zu", clear_stats.copied_during_frame ? '>' : ' ', clear_index);
+				std::snprintf(label, sizeof(label), "%c   CLEAR %2zu", clear_stats.copied_during_frame ? '>' : ' ', clear_index);
 
 				if (bool value = (depth_stencil_backup->force_clear_index == clear_index);
 					ImGui::Checkbox(label, &value))
 				{
+					std::unique_lock<std::shared_mutex> backups_lock(device_data.backups_mutex);
 					depth_stencil_backup->force_clear_index = value ? clear_index : 0;
+					backups_lock.unlock();
 					reshade::config_set_value(nullptr, "DEPTH", "DepthCopyAtClearIndex", depth_stencil_backup->force_clear_index);
+					save_depth_profile(runtime);
 				}
 
 				ImGui::SameLine();
@@ -1112,7 +2952,13 @@ static void draw_settings_overlay(effect_runtime *runtime)
 					clear_stats.drawcalls,
 					clear_stats.drawcalls_indirect,
 					clear_stats.vertices,
-					clear_stats.clear_op == clear_op::fullscreen_draw ? " Fullscreen draw call" : "");
+					clear_stats.clear_op == clear_op::fullscreen_draw ? " Fullscreen draw call" : clear_stats.copied_after_render_pass ? " Copied after render pass" : "");
+			}
+
+			if (s_predict_clear_index && depth_stencil_backup->force_clear_index == 0 && depth_stencil_backup->predicted_clear_index != 0)
+			{
+				ImGui::Text("    Predicted winning clear: %2zu (%s)", depth_stencil_backup->predicted_clear_index,
+					depth_stencil_backup->is_prediction_confident() ? "copying only there" : "learning");
 			}
 
 			if (sorted_item_list.size() == 1 && !is_d3d12_or_vulkan)
@@ -1120,8 +2966,11 @@ static void draw_settings_overlay(effect_runtime *runtime)
 				if (bool value = (depth_stencil_backup->force_clear_index == std::numeric_limits<size_t>::max());
 					ImGui::Checkbox("    Choose last clear operation with high number of draw calls", &value))
 				{
+					std::unique_lock<std::shared_mutex> backups_lock(device_data.backups_mutex);
 					depth_stencil_backup->force_clear_index = value ? std::numeric_limits<size_t>::max() : 0;
+					backups_lock.unlock();
 					reshade::config_set_value(nullptr, "DEPTH", "DepthCopyAtClearIndex", depth_stencil_backup->force_clear_index);
+					save_depth_profile(runtime);
 				}
 			}
 		}
@@ -1150,8 +2999,9 @@ static void draw_settings_overlay(effect_runtime *runtime)
 			command_queue *const queue = runtime->get_command_queue();
 
 			queue->wait_idle(); // Ensure resource view is no longer in-use before destroying it
-			device->destroy_resource_view(data.selected_shader_resource);
+			device_data.release_shader_resource_view(device, data.selected_shader_resource);
 
+			const std::unique_lock<std::shared_mutex> backups_lock(device_data.backups_mutex);
 			device_data.untrack_depth_stencil(data.selected_depth_stencil);
 		}
 
@@ -1163,6 +3013,154 @@ static void draw_settings_overlay(effect_runtime *runtime)
 	}
 }
 
+template <device_api specialized_api>
+static void set_resource_events(bool enable)
+{
+	if (enable)
+	{
+		reshade::register_event<reshade::addon_event::create_resource>(on_create_resource<specialized_api>);
+		reshade::register_event<reshade::addon_event::create_resource_view>(on_create_resource_view<specialized_api>);
+	}
+	else
+	{
+		reshade::unregister_event<reshade::addon_event::create_resource>(on_create_resource<specialized_api>);
+		reshade::unregister_event<reshade::addon_event::create_resource_view>(on_create_resource_view<specialized_api>);
+	}
+}
+template <device_api specialized_api>
+static void set_draw_events(bool enable)
+{
+	if (enable)
+	{
+		reshade::register_event<reshade::addon_event::draw>(on_draw<specialized_api>);
+		reshade::register_event<reshade::addon_event::draw_indexed>(on_draw_indexed<specialized_api>);
+		reshade::register_event<reshade::addon_event::draw_or_dispatch_indirect>(on_draw_indirect);
+		reshade::register_event<reshade::addon_event::bind_viewports>(on_bind_viewport);
+		reshade::register_event<reshade::addon_event::begin_render_pass>(on_begin_render_pass_with_depth_stencil<specialized_api>);
+		reshade::register_event<reshade::addon_event::end_render_pass>(on_end_render_pass);
+		reshade::register_event<reshade::addon_event::bind_render_targets_and_depth_stencil>(on_bind_depth_stencil<specialized_api>);
+	}
+	else
+	{
+		reshade::unregister_event<reshade::addon_event::draw>(on_draw<specialized_api>);
+		reshade::unregister_event<reshade::addon_event::draw_indexed>(on_draw_indexed<specialized_api>);
+		reshade::unregister_event<reshade::addon_event::draw_or_dispatch_indirect>(on_draw_indirect);
+		reshade::unregister_event<reshade::addon_event::bind_viewports>(on_bind_viewport);
+		reshade::unregister_event<reshade::addon_event::begin_render_pass>(on_begin_render_pass_with_depth_stencil<specialized_api>);
+		reshade::unregister_event<reshade::addon_event::end_render_pass>(on_end_render_pass);
+		reshade::unregister_event<reshade::addon_event::bind_render_targets_and_depth_stencil>(on_bind_depth_stencil<specialized_api>);
+	}
+}
+template <device_api specialized_api>
+static void set_clear_events(bool enable)
+{
+	if (enable)
+	{
+		reshade::register_event<reshade::addon_event::close_command_list>(on_close<specialized_api>);
+		reshade::register_event<reshade::addon_event::barrier>(on_barrier<specialized_api>);
+		reshade::register_event<reshade::addon_event::clear_depth_stencil_view>(on_clear_depth_stencil<specialized_api>);
+	}
+	else
+	{
+		reshade::unregister_event<reshade::addon_event::close_command_list>(on_close<specialized_api>);
+		reshade::unregister_event<reshade::addon_event::barrier>(on_barrier<specialized_api>);
+		reshade::unregister_event<reshade::addon_event::clear_depth_stencil_view>(on_clear_depth_stencil<specialized_api>);
+	}
+}
+
+// Calls 'callback' with the graphics API as a compile-time constant ('std::integral_constant'), to pick the matching instantiation of the hot callbacks
+template <typename F>
+static void dispatch_api(device_api api, F &&callback)
+{
+	switch (api)
+	{
+	case device_api::d3d9:
+		callback(std::integral_constant<device_api, device_api::d3d9>());
+		break;
+	case device_api::d3d10:
+		callback(std::integral_constant<device_api, device_api::d3d10>());
+		break;
+	case device_api::d3d11:
+		callback(std::integral_constant<device_api, device_api::d3d11>());
+		break;
+	case device_api::d3d12:
+		callback(std::integral_constant<device_api, device_api::d3d12>());
+		break;
+	case device_api::opengl:
+		callback(std::integral_constant<device_api, device_api::opengl>());
+		break;
+	case device_api::vulkan:
+		callback(std::integral_constant<device_api, device_api::vulkan>());
+		break;
+	default:
+		callback(std::integral_constant<device_api, any_api>());
+		break;
+	}
+}
+
+static void set_hot_path_events(device_api api, bool resources, bool draws, bool clears)
+{
+	if (api != s_hot_path_api)
+	{
+		// Draw and clear callbacks add to the tracked state, so two instantiations running at once would count the same command twice, while missing a few commands in between only loses some statistics
+		dispatch_api(s_hot_path_api, [](auto api_constant) {
+			constexpr device_api old_api = decltype(api_constant)::value;
+			if (s_draw_events_registered)
+				set_draw_events<old_api>(false);
+			if (s_clear_events_registered)
+				set_clear_events<old_api>(false);
+		});
+		// Resource callbacks only fill the description cache, so register the new instantiation before unregistering the old one, so that no resource creation is missed in between (running both for a moment does no harm)
+		dispatch_api(api, [resources](auto api_constant) {
+			constexpr device_api new_api = decltype(api_constant)::value;
+			if (resources)
+				set_resource_events<new_api>(true);
+		});
+		dispatch_api(s_hot_path_api, [](auto api_constant) {
+			constexpr device_api old_api = decltype(api_constant)::value;
+			if (s_resource_events_registered)
+				set_resource_events<old_api>(false);
+		});
+		dispatch_api(api, [draws, clears](auto api_constant) {
+			constexpr device_api new_api = decltype(api_constant)::value;
+			if (draws)
+				set_draw_events<new_api>(true);
+			if (clears)
+				set_clear_events<new_api>(true);
+		});
+	}
+	else
+	{
+		dispatch_api(api, [resources, draws, clears](auto api_constant) {
+			constexpr device_api same_api = decltype(api_constant)::value;
+			if (resources != s_resource_events_registered)
+				set_resource_events<same_api>(resources);
+			if (draws != s_draw_events_registered)
+				set_draw_events<same_api>(draws);
+			if (clears != s_clear_events_registered)
+				set_clear_events<same_api>(clears);
+		});
+	}
+
+	s_hot_path_api = api;
+	s_resource_events_registered = resources;
+	s_draw_events_registered = draws;
+	s_clear_events_registered = clears;
+}
+static void update_hot_path_events()
+{
+	static std::mutex mutex;
+	const std::lock_guard<std::mutex> lock(mutex);
+
+	// Draw calls only have to be counted to select a depth-stencil automatically or to find the clear operation to copy at, neither of which is needed when every effect runtime has one pinned
+	const unsigned int effect_runtimes = s_effect_runtimes.load();
+	const bool draws = s_preserve_depth_buffers != 0 || effect_runtimes == 0 || s_pinned_effect_runtimes.load() < effect_runtimes;
+	// Clear operations (and the barriers and command list ends copies are deferred to) only matter when copying before them
+	const bool clears = draws && s_preserve_depth_buffers != 0;
+
+	set_hot_path_events(s_device_api, true, draws, clears);
+}
+
 void register_addon_depth()
 {
 	reshade::register_overlay(nullptr, draw_settings_overlay);
@@ -1176,17 +3174,11 @@ void register_addon_depth()
 	reshade::register_event<reshade::addon_event::destroy_command_queue>(on_destroy_command_queue);
 	reshade::register_event<reshade::addon_event::destroy_effect_runtime>(on_destroy_effect_runtime);
 
-	reshade::register_event<reshade::addon_event::create_resource>(on_create_resource);
-	reshade::register_event<reshade::addon_event::create_resource_view>(on_create_resource_view);
+	reshade::register_event<reshade::addon_event::init_resource>(on_init_resource);
 	reshade::register_event<reshade::addon_event::destroy_resource>(on_destroy_resource);
 
-	reshade::register_event<reshade::addon_event::draw>(on_draw);
-	reshade::register_event<reshade::addon_event::draw_indexed>(on_draw_indexed);
-	reshade::register_event<reshade::addon_event::draw_or_dispatch_indirect>(on_draw_indirect);
-	reshade::register_event<reshade::addon_event::bind_viewports>(on_bind_viewport);
-	reshade::register_event<reshade::addon_event::begin_render_pass>(on_begin_render_pass_with_depth_stencil);
-	reshade::register_event<reshade::addon_event::bind_render_targets_and_depth_stencil>(on_bind_depth_stencil);
-	reshade::register_event<reshade::addon_event::clear_depth_stencil_view>(on_clear_depth_stencil);
+	// Events called for every resource creation and draw call are specialized for the graphics API once a device is created, and the latter are only registered when needed (see 'update_hot_path_events')
+	update_hot_path_events();
 
 	reshade::register_event<reshade::addon_event::reset_command_list>(on_reset);
 	reshade::register_event<reshade::addon_event::execute_command_list>(on_execute_primary);
@@ -1197,7 +3189,7 @@ void register_addon_depth()
 	reshade::register_event<reshade::addon_event::reshade_begin_effects>(on_begin_render_effects);
 	reshade::register_event<reshade::addon_event::reshade_finish_effects>(on_finish_render_effects);
 	// Need to set texture binding again after reloading
-	reshade::register_event<reshade::addon_event::reshade_reloaded_effects>(update_effect_runtime);
+	reshade::register_event<reshade::addon_event::reshade_reloaded_effects>(on_reloaded_effects);
 }
 void unregister_addon_depth()
 {
@@ -1210,17 +3202,10 @@ void unregister_addon_depth()
 	reshade::unregister_event<reshade::addon_event::destroy_command_queue>(on_destroy_command_queue);
 	reshade::unregister_event<reshade::addon_event::destroy_effect_runtime>(on_destroy_effect_runtime);
 
-	reshade::unregister_event<reshade::addon_event::create_resource>(on_create_resource);
-	reshade::unregister_event<reshade::addon_event::create_resource_view>(on_create_resource_view);
+	reshade::unregister_event<reshade::addon_event::init_resource>(on_init_resource);
 	reshade::unregister_event<reshade::addon_event::destroy_resource>(on_destroy_resource);
 
-	reshade::unregister_event<reshade::addon_event::draw>(on_draw);
-	reshade::unregister_event<reshade::addon_event::draw_indexed>(on_draw_indexed);
-	reshade::unregister_event<reshade::addon_event::draw_or_dispatch_indirect>(on_draw_indirect);
-	reshade::unregister_event<reshade::addon_event::bind_viewports>(on_bind_viewport);
-	reshade::unregister_event<reshade::addon_event::begin_render_pass>(on_begin_render_pass_with_depth_stencil);
-	reshade::unregister_event<reshade::addon_event::bind_render_targets_and_depth_stencil>(on_bind_depth_stencil);
-	reshade::unregister_event<reshade::addon_event::clear_depth_stencil_view>(on_clear_depth_stencil);
+	set_hot_path_events(s_hot_path_api, false, false, false);
 
 	reshade::unregister_event<reshade::addon_event::reset_command_list>(on_reset);
 	reshade::unregister_event<reshade::addon_event::execute_command_list>(on_execute_primary);
@@ -1230,12 +3215,16 @@ void unregister_addon_depth()
 
 	reshade::unregister_event<reshade::addon_event::reshade_begin_effects>(on_begin_render_effects);
 	reshade::unregister_event<reshade::addon_event::reshade_finish_effects>(on_finish_render_effects);
-	reshade::unregister_event<reshade::addon_event::reshade_reloaded_effects>(update_effect_runtime);
+	reshade::unregister_event<reshade::addon_event::reshade_reloaded_effects>(on_reloaded_effects);
 }
 
-extern "C" __declspec(dllexport) const char *NAME = "Citra";
-extern "C" __declspec(dllexport) const char *DESCRIPTION = "add-on that pre-processes depth buffer from Citra to be standardized / aligned for other add-ons to consume it.";
+// Declared separately from the definitions below, since GCC warns about initializing a variable declared 'extern'
+CITRA_EXPORT const char *NAME;
+CITRA_EXPORT const char *DESCRIPTION;
+const char *NAME = "Citra";
+const char *DESCRIPTION = "add-on that pre-processes depth buffer from Citra to be standardized / aligned for other add-ons to consume it.";
 
+#ifdef _WIN32
 BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID)
 {
 	switch (fdwReason)
@@ -1252,3 +3241,4 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID)
 	}
 	return TRUE;
 }
+#endif
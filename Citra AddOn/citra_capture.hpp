@@ -0,0 +1,401 @@
+/*
+ * 2022 Jake Downs
+ *
+ * File format of the color + depth captures the add-on records, with the writer the add-on uses and a reader for offline tools
+ * Only depends on the standard library, so it can be included by tools outside of ReShade (see 'encoder/lkg-encode.cpp')
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace citra_capture
+{
+	// A file starts with a 'file_header', followed by the frames, each of which is:
+	//   frame_info
+	//   uint32_t chunk count
+	//   for every chunk: uint32_t raw size, uint32_t stored size, stored bytes
+	// Color chunks (rows_per_chunk rows each) come first, then depth chunks
+	// A chunk whose stored size equals its raw size is stored uncompressed
+	static constexpr uint32_t file_magic = 0x50414343; // 'CCAP'
+	static constexpr uint32_t file_version = 1;
+	static constexpr uint32_t rows_per_chunk = 16;
+
+	enum class color_order : uint32_t
+	{
+		rgba8 = 0,
+		bgra8 = 1,
+	};
+
+	struct frame_info
+	{
+		uint64_t frame_index = 0;
+		uint32_t color_width = 0;
+		uint32_t color_height = 0;
+		color_order color_format = color_order::rgba8;
+		// Depth is the normalized depth of 'Citra.fx' (0 = near), which may be at a lower resolution than color when the quality governor lowered it (see 'iCitraDepthResolutionDivisor')
+		uint32_t depth_width = 0;
+		uint32_t depth_height = 0;
+		// Value of 'iUIPresentType' in 'Citra.fx', which describes how the screens are laid out in the frame
+		int32_t present_type = 0;
+		// Linearization parameters 'Citra.fx' normalized depth with
+		float near_plane = 0.0f;
+		float far_plane = 0.0f;
+		float depth_multiplier = 0.0f;
+		// Index of the clear operation the depth buffer was copied at (starting at one), or zero if it was not copied at a clear operation
+		uint32_t clear_index = 0;
+	};
+
+	struct file_header
+	{
+		uint32_t magic = file_magic;
+		uint32_t version = file_version;
+		// Size of 'frame_info', so readers can detect layout changes
+		uint32_t frame_info_size = sizeof(frame_info);
+	};
+
+	struct frame
+	{
+		frame_info info;
+		std::vector<uint8_t> color; // Four bytes per pixel, in 'info.color_format'
+		std::vector<float> depth; // One float per pixel
+	};
+
+	// Splits 4-byte elements into byte planes (so that e.g. all alpha or all exponent bytes end up next to each other), replaces every byte by its difference to the previous one in its plane and then encodes runs of zero bytes
+	// Control bytes below 128 are followed by that many plus one literal bytes, control bytes of 128 and above stand for that many minus 127 zero bytes
+	inline void compress(const uint8_t *data, size_t size, std::vector<uint8_t> &out)
+	{
+		const size_t plane_size = size / 4;
+		std::vector<uint8_t> deltas(size);
+		for (size_t plane = 0; plane < 4; ++plane)
+		{
+			uint8_t previous = 0;
+			for (size_t i = 0; i < plane_size; ++i)
+			{
+				const uint8_t value = data[i * 4 + plane];
+				deltas[plane * plane_size + i] = static_cast<uint8_t>(value - previous);
+				previous = value;
+			}
+		}
+		// Trailing bytes that do not make up a full element are kept as they are
+		for (size_t i = plane_size * 4; i < size; ++i)
+			deltas[i] = data[i];
+
+		for (size_t i = 0; i < size;)
+		{
+			size_t run = 0;
+			while (i + run < size && run < 128 && deltas[i + run] == 0)
+				run++;
+			if (run != 0)
+			{
+				out.push_back(static_cast<uint8_t>(127 + run));
+				i += run;
+				continue;
+			}
+
+			// Only end a literal run at two zeros in a row, since a single zero costs more as its own token
+			size_t literal = 0;
+			while (i + literal < size && literal < 128 && !(deltas[i + literal] == 0 && i + literal + 1 < size && deltas[i + literal + 1] == 0))
+				literal++;
+			out.push_back(static_cast<uint8_t>(literal - 1));
+			out.insert(out.end(), deltas.begin() + i, deltas.begin() + i + literal);
+			i += literal;
+		}
+	}
+
+	// Reverses 'compress', returns false if the data is corrupt
+	inline bool decompress(const uint8_t *data, size_t size, uint8_t *out, size_t raw_size)
+	{
+		std::vector<uint8_t> deltas(raw_size);
+		size_t offset = 0;
+		for (size_t i = 0; i < size;)
+		{
+			const uint8_t control = data[i++];
+			if (control >= 128)
+			{
+				const size_t run = control - 127u;
+				if (offset + run > raw_size)
+					return false;
+				std::memset(deltas.data() + offset, 0, run);
+				offset += run;
+			}
+			else
+			{
+				const size_t literal = control + 1u;
+				if (offset + literal > raw_size || i + literal > size)
+					return false;
+				std::memcpy(deltas.data() + offset, data + i, literal);
+				offset += literal;
+				i += literal;
+			}
+		}
+		if (offset != raw_size)
+			return false;
+
+		const size_t plane_size = raw_size / 4;
+		for (size_t plane = 0; plane < 4; ++plane)
+		{
+			uint8_t previous = 0;
+			for (size_t i = 0; i < plane_size; ++i)
+				out[i * 4 + plane] = previous = static_cast<uint8_t>(previous + deltas[plane * plane_size + i]);
+		}
+		for (size_t i = plane_size * 4; i < raw_size; ++i)
+			out[i] = deltas[i];
+
+		return true;
+	}
+
+	inline void append(std::vector<uint8_t> &out, const void *data, size_t size)
+	{
+		out.insert(out.end(), static_cast<const uint8_t *>(data), static_cast<const uint8_t *>(data) + size);
+	}
+
+	// Appends a frame in the layout described above to 'out'
+	inline void encode_frame(const frame &frame, std::vector<uint8_t> &out)
+	{
+		append(out, &frame.info, sizeof(frame.info));
+
+		const uint32_t color_chunks = (frame.info.color_height + rows_per_chunk - 1) / rows_per_chunk;
+		const uint32_t depth_chunks = (frame.info.depth_height + rows_per_chunk - 1) / rows_per_chunk;
+		const uint32_t chunk_count = color_chunks + depth_chunks;
+		append(out, &chunk_count, sizeof(chunk_count));
+
+		std::vector<uint8_t> compressed;
+		const auto encode_chunks = [&](const uint8_t *data, uint32_t chunks, uint32_t height, size_t row_size) {
+			for (uint32_t chunk = 0; chunk < chunks; ++chunk)
+			{
+				const uint32_t first_row = chunk * rows_per_chunk;
+				const uint32_t raw_size = static_cast<uint32_t>(std::min(rows_per_chunk, height - first_row) * row_size);
+				const uint8_t *const raw = data + first_row * row_size;
+
+				compressed.clear();
+				compress(raw, raw_size, compressed);
+
+				const bool store_raw = compressed.size() >= raw_size;
+				const uint32_t stored_size = store_raw ? raw_size : static_cast<uint32_t>(compressed.size());
+				append(out, &raw_size, sizeof(raw_size));
+				append(out, &stored_size, sizeof(stored_size));
+				append(out, store_raw ? raw : compressed.data(), stored_size);
+			}
+		};
+
+		encode_chunks(frame.color.data(), color_chunks, frame.info.color_height, frame.info.color_width * 4);
+		encode_chunks(reinterpret_cast<const uint8_t *>(frame.depth.data()), depth_chunks, frame.info.depth_height, frame.info.depth_width * sizeof(float));
+	}
+
+	// Writes frames to a file on a background thread, so that the thread submitting them never waits for compression or the disk
+	class writer
+	{
+	public:
+		~writer() { close(); }
+
+		bool open(const char *path, size_t max_queued_frames = 8)
+		{
+			close();
+
+			_file = std::fopen(path, "wb");
+			if (_file == nullptr)
+				return false;
+
+			const file_header header;
+			if (std::fwrite(&header, sizeof(header), 1, _file) != 1)
+			{
+				std::fclose(_file);
+				_file = nullptr;
+				return false;
+			}
+
+			_max_queued_frames = max_queued_frames;
+			_closing = false;
+			_failed = false;
+			_frames_written = 0;
+			_frames_dropped = 0;
+			_bytes_written = sizeof(header);
+			_thread = std::thread([this]() { run(); });
+			return true;
+		}
+		void close()
+		{
+			if (_file == nullptr)
+				return;
+
+			{
+				const std::lock_guard<std::mutex> lock(_mutex);
+				_closing = true;
+			}
+			_wake.notify_all();
+			_thread.join();
+
+			std::fclose(_file);
+			_file = nullptr;
+		}
+
+		bool is_open() const { return _file != nullptr; }
+
+		// Queues a frame for writing, or drops it if the writer thread is too far behind
+		// Returns false without queuing anything once writing failed (see 'failed')
+		bool submit(frame &&frame)
+		{
+			{
+				const std::lock_guard<std::mutex> lock(_mutex);
+				if (_file == nullptr || _failed)
+					return false;
+				if (_queue.size() >= _max_queued_frames)
+				{
+					_frames_dropped++;
+					return false;
+				}
+				_queue.push_back(std::move(frame));
+			}
+			_wake.notify_one();
+			return true;
+		}
+
+		uint64_t frames_written() const { return _frames_written; }
+		uint64_t frames_dropped() const { return _frames_dropped; }
+		uint64_t bytes_written() const { return _bytes_written; }
+		// Whether a frame could not be written completely (e.g. because the disk is full), after which the writer stopped, so the file ends with that partial frame
+		bool failed() const { return _failed; }
+
+	private:
+		void run()
+		{
+			std::vector<uint8_t> encoded;
+			for (frame current;;)
+			{
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_wake.wait(lock, [this]() { return !_queue.empty() || _closing; });
+					// Drain the queue before stopping, so that closing does not lose frames that were already accepted
+					if (_queue.empty())
+						break;
+					current = std::move(_queue.front());
+					_queue.pop_front();
+				}
+
+				encoded.clear();
+				encode_frame(current, encoded);
+				if (std::fwrite(encoded.data(), 1, encoded.size(), _file) != encoded.size())
+				{
+					// Frames written after a partial one could not be read anymore, so stop here and drop what is still queued
+					const std::lock_guard<std::mutex> lock(_mutex);
+					_failed = true;
+					_frames_dropped += 1 + _queue.size();
+					_queue.clear();
+					break;
+				}
+
+				_frames_written++;
+				_bytes_written += encoded.size();
+			}
+		}
+
+		std::FILE *_file = nullptr;
+		std::thread _thread;
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::deque<frame> _queue;
+		size_t _max_queued_frames = 8;
+		bool _closing = false;
+		std::atomic<bool> _failed = false;
+		std::atomic<uint64_t> _frames_written = 0;
+		std::atomic<uint64_t> _frames_dropped = 0;
+		std::atomic<uint64_t> _bytes_written = 0;
+	};
+
+	// Reads the frames of a capture file one after another
+	class reader
+	{
+	public:
+		~reader() { close(); }
+
+		bool open(const char *path)
+		{
+			close();
+
+			_file = std::fopen(path, "rb");
+			if (_file == nullptr)
+				return false;
+
+			file_header header;
+			if (std::fread(&header, sizeof(header), 1, _file) != 1 || header.magic != file_magic || header.version != file_version || header.frame_info_size != sizeof(frame_info))
+			{
+				close();
+				return false;
+			}
+			return true;
+		}
+		void close()
+		{
+			if (_file == nullptr)
+				return;
+
+			std::fclose(_file);
+			_file = nullptr;
+		}
+
+		// Reads the next frame, with color converted to RGBA, and returns false at the end of the file or if it is corrupt
+		bool read(frame &frame)
+		{
+			uint32_t chunk_count = 0;
+			if (_file == nullptr || std::fread(&frame.info, sizeof(frame.info), 1, _file) != 1 || std::fread(&chunk_count, sizeof(chunk_count), 1, _file) != 1)
+				return false;
+
+			frame.color.resize(static_cast<size_t>(frame.info.color_width) * frame.info.color_height * 4);
+			frame.depth.resize(static_cast<size_t>(frame.info.depth_width) * frame.info.depth_height);
+
+			const size_t color_size = frame.color.size();
+			const size_t total_size = color_size + frame.depth.size() * sizeof(float);
+			size_t offset = 0;
+			for (uint32_t chunk = 0; chunk < chunk_count; ++chunk)
+			{
+				uint32_t sizes[2] = {};
+				if (std::fread(sizes, sizeof(sizes), 1, _file) != 1 || sizes[1] > sizes[0] || offset + sizes[0] > total_size)
+					return false;
+				// The writer chunks color and depth separately, so a chunk that spans both images means the file is corrupt
+				if (offset < color_size && offset + sizes[0] > color_size)
+					return false;
+
+				uint8_t *const out = offset < color_size ? frame.color.data() + offset : reinterpret_cast<uint8_t *>(frame.depth.data()) + (offset - color_size);
+
+				if (sizes[1] == sizes[0])
+				{
+					if (std::fread(out, 1, sizes[0], _file) != sizes[0])
+						return false;
+				}
+				else
+				{
+					_compressed.resize(sizes[1]);
+					if (std::fread(_compressed.data(), 1, sizes[1], _file) != sizes[1] || !decompress(_compressed.data(), sizes[1], out, sizes[0]))
+						return false;
+				}
+
+				offset += sizes[0];
+			}
+			if (offset != total_size)
+				return false;
+
+			if (frame.info.color_format == color_order::bgra8)
+			{
+				for (size_t i = 0; i < color_size; i += 4)
+					std::swap(frame.color[i + 0], frame.color[i + 2]);
+				frame.info.color_format = color_order::rgba8;
+			}
+
+			return true;
+		}
+
+	private:
+		std::FILE *_file = nullptr;
+		std::vector<uint8_t> _compressed;
+	};
+}
@@ -0,0 +1,51 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Stand-in for the Dear ImGui functions the settings overlay of 'citra.cpp' uses
+ * Text is collected instead of drawn and widgets report a click when a test asked for one (see 'mock_host.hpp')
+ */
+
+#pragma once
+
+typedef int ImGuiCol;
+
+enum ImGuiCol_
+{
+	ImGuiCol_Text,
+	ImGuiCol_TextDisabled,
+	ImGuiCol_COUNT
+};
+
+struct ImVec2
+{
+	float x, y;
+	ImVec2(float x = 0.0f, float y = 0.0f) : x(x), y(y) {}
+};
+struct ImVec4
+{
+	float x, y, z, w;
+	ImVec4(float x = 0.0f, float y = 0.0f, float z = 0.0f, float w = 0.0f) : x(x), y(y), z(z), w(w) {}
+};
+
+struct ImGuiStyle
+{
+	ImVec4 Colors[ImGuiCol_COUNT];
+};
+
+namespace ImGui
+{
+	void Text(const char *fmt, ...);
+	void TextUnformatted(const char *text, const char *text_end = nullptr);
+	bool Button(const char *label, const ImVec2 &size = ImVec2());
+	bool Checkbox(const char *label, bool *v);
+	void SameLine(float offset_from_start_x = 0.0f, float spacing = -1.0f);
+	void Spacing();
+	void Separator();
+	void BeginDisabled(bool disabled = true);
+	void EndDisabled();
+	void PushStyleColor(ImGuiCol idx, const ImVec4 &col);
+	void PopStyleColor(int count = 1);
+	void PushTextWrapPos(float wrap_local_pos_x = 0.0f);
+	void PopTextWrapPos();
+	ImGuiStyle &GetStyle();
+}
@@ -0,0 +1,708 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Implementation of the fake ReShade host (see 'mock_host.hpp')
+ */
+
+#include "mock_host.hpp"
+#include <imgui.h>
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <map>
+
+using namespace reshade::api;
+
+std::vector<void *> mock::s_callbacks[static_cast<size_t>(addon_event::max)];
+
+static std::mutex s_config_mutex;
+static std::map<std::pair<std::string, std::string>, std::string> s_config;
+static std::vector<std::string> s_log;
+
+static std::vector<void(*)(reshade::api::effect_runtime *)> s_overlays;
+static std::string s_click_label;
+static std::vector<std::string> s_overlay_text;
+
+void reshade::internal::register_event(addon_event ev, void *callback)
+{
+	mock::s_callbacks[static_cast<size_t>(ev)].push_back(callback);
+}
+void reshade::internal::unregister_event(addon_event ev, void *callback)
+{
+	std::vector<void *> &callbacks = mock::s_callbacks[static_cast<size_t>(ev)];
+	if (const auto it = std::find(callbacks.begin(), callbacks.end(), callback); it != callbacks.end())
+		callbacks.erase(it);
+}
+
+bool reshade::internal::config_get_value(const char *section, const char *key, std::string &value)
+{
+	const std::lock_guard<std::mutex> lock(s_config_mutex);
+	if (const auto it = s_config.find({ section != nullptr ? section : "", key }); it != s_config.end())
+	{
+		value = it->second;
+		return true;
+	}
+	return false;
+}
+void reshade::internal::config_set_value(const char *section, const char *key, const std::string &value)
+{
+	const std::lock_guard<std::mutex> lock(s_config_mutex);
+	s_config[{ section != nullptr ? section : "", key }] = value;
+}
+
+void reshade::register_overlay(const char *, void(*callback)(api::effect_runtime *runtime))
+{
+	s_overlays.push_back(callback);
+}
+void reshade::unregister_overlay(const char *, void(*callback)(api::effect_runtime *runtime))
+{
+	s_overlays.erase(std::remove(s_overlays.begin(), s_overlays.end(), callback), s_overlays.end());
+}
+
+bool reshade::register_addon(HMODULE)
+{
+	return true;
+}
+void reshade::unregister_addon(HMODULE)
+{
+}
+
+void reshade::log_message(int, const char *message)
+{
+	const std::lock_guard<std::mutex> lock(s_config_mutex);
+	s_log.push_back(message);
+}
+
+void mock::reset_config()
+{
+	const std::lock_guard<std::mutex> lock(s_config_mutex);
+	s_config.clear();
+	s_log.clear();
+}
+void mock::set_config(const char *section, const char *key, const std::string &value)
+{
+	reshade::internal::config_set_value(section, key, value);
+}
+std::string mock::get_config(const char *section, const char *key)
+{
+	std::string value;
+	reshade::internal::config_get_value(section, key, value);
+	return value;
+}
+
+std::vector<std::string> mock::log_messages()
+{
+	const std::lock_guard<std::mutex> lock(s_config_mutex);
+	return s_log;
+}
+
+std::vector<std::string> mock::draw_overlay(reshade::api::effect_runtime *runtime, const char *click_label)
+{
+	s_click_label = click_label != nullptr ? click_label : "";
+	s_overlay_text.clear();
+
+	for (const auto callback : s_overlays)
+		callback(runtime);
+
+	s_click_label.clear();
+	return std::move(s_overlay_text);
+}
+bool mock::overlay_contains(const std::vector<std::string> &lines, const char *text)
+{
+	return std::any_of(lines.begin(), lines.end(), [text](const std::string &line) { return line.find(text) != std::string::npos; });
+}
+
+static bool consume_click(const char *label)
+{
+	if (s_click_label.empty() || std::strncmp(label, s_click_label.c_str(), s_click_label.size()) != 0)
+		return false;
+	s_click_label.clear();
+	return true;
+}
+
+void ImGui::Text(const char *fmt, ...)
+{
+	char text[1024];
+	va_list args;
+	va_start(args, fmt);
+	std::vsnprintf(text, sizeof(text), fmt, args);
+	va_end(args);
+	s_overlay_text.push_back(text);
+}
+void ImGui::TextUnformatted(const char *text, const char *text_end)
+{
+	s_overlay_text.push_back(text_end != nullptr ? std::string(text, text_end) : std::string(text));
+}
+bool ImGui::Button(const char *label, const ImVec2 &)
+{
+	return consume_click(label);
+}
+bool ImGui::Checkbox(const char *label, bool *v)
+{
+	if (!consume_click(label))
+		return false;
+	*v = !*v;
+	return true;
+}
+void ImGui::SameLine(float, float) {}
+void ImGui::Spacing() {}
+void ImGui::Separator() {}
+void ImGui::BeginDisabled(bool) {}
+void ImGui::EndDisabled() {}
+void ImGui::PushStyleColor(ImGuiCol, const ImVec4 &) {}
+void ImGui::PopStyleColor(int) {}
+void ImGui::PushTextWrapPos(float) {}
+void ImGui::PopTextWrapPos() {}
+ImGuiStyle &ImGui::GetStyle()
+{
+	static ImGuiStyle style;
+	return style;
+}
+
+uint64_t mock::next_handle()
+{
+	// Aligned like pointers, which the add-on relies on for hashing
+	static std::atomic<uint64_t> next = 0x10000;
+	return next.fetch_add(0x40);
+}
+
+bool mock::device::create_resource(const resource_desc &desc, const subresource_data *, resource_usage, resource *out_handle)
+{
+	resource_state state;
+	state.desc = desc;
+	if (desc.heap == memory_heap::gpu_to_cpu && desc.type != resource_type::buffer)
+		state.data.resize(format_slice_pitch(desc.texture.format, format_row_pitch(desc.texture.format, desc.texture.width), desc.texture.height));
+
+	*out_handle = { next_handle() };
+	resources_created++;
+
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+	_resources.emplace(out_handle->handle, std::move(state));
+	return true;
+}
+void mock::device::destroy_resource(resource handle)
+{
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+	_resources.erase(handle.handle);
+}
+resource_desc mock::device::get_resource_desc(resource resource) const
+{
+	get_resource_desc_calls++;
+
+	const std::shared_lock<std::shared_mutex> lock(_mutex);
+	if (const auto it = _resources.find(resource.handle); it != _resources.end())
+		return it->second.desc;
+	return resource_desc();
+}
+
+bool mock::device::create_resource_view(resource resource, resource_usage, const resource_view_desc &desc, resource_view *out_handle)
+{
+	*out_handle = { next_handle() };
+	resource_views_created++;
+
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+	_views.emplace(out_handle->handle, std::make_pair(resource, desc));
+	return true;
+}
+void mock::device::destroy_resource_view(resource_view handle)
+{
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+	_views.erase(handle.handle);
+}
+resource mock::device::get_resource_from_view(resource_view view) const
+{
+	const std::shared_lock<std::shared_mutex> lock(_mutex);
+	if (const auto it = _views.find(view.handle); it != _views.end())
+		return it->second.first;
+	return { 0 };
+}
+resource_view_desc mock::device::get_resource_view_desc(resource_view view) const
+{
+	const std::shared_lock<std::shared_mutex> lock(_mutex);
+	if (const auto it = _views.find(view.handle); it != _views.end())
+		return it->second.second;
+	return resource_view_desc();
+}
+
+bool mock::device::map_texture_region(resource resource, uint32_t, const subresource_box *, map_access, subresource_data *out_data)
+{
+	const std::shared_lock<std::shared_mutex> lock(_mutex);
+	const auto it = _resources.find(resource.handle);
+	if (it == _resources.end() || it->second.data.empty())
+		return false;
+
+	const resource_desc &desc = it->second.desc;
+	out_data->data = it->second.data.data();
+	out_data->row_pitch = format_row_pitch(desc.texture.format, desc.texture.width);
+	out_data->slice_pitch = format_slice_pitch(desc.texture.format, out_data->row_pitch, desc.texture.height);
+	return true;
+}
+void mock::device::unmap_texture_region(resource, uint32_t)
+{
+}
+
+bool mock::device::create_query_heap(query_type, uint32_t size, query_heap *out_handle)
+{
+	*out_handle = { next_handle() };
+
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+	_query_heaps.emplace(out_handle->handle, std::vector<uint64_t>(size));
+	return true;
+}
+void mock::device::destroy_query_heap(query_heap handle)
+{
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+	_query_heaps.erase(handle.handle);
+}
+bool mock::device::get_query_heap_results(query_heap heap, uint32_t first, uint32_t count, void *results, uint32_t stride)
+{
+	// Commands run as they are recorded, so results are always available
+	const std::shared_lock<std::shared_mutex> lock(_mutex);
+	const auto it = _query_heaps.find(heap.handle);
+	if (it == _query_heaps.end() || first + count > it->second.size())
+		return false;
+
+	for (uint32_t i = 0; i < count; ++i)
+		std::memcpy(static_cast<uint8_t *>(results) + static_cast<size_t>(i) * stride, &it->second[first + i], sizeof(uint64_t));
+	return true;
+}
+void mock::device::write_timestamp(query_heap heap, uint32_t index)
+{
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+	if (const auto it = _query_heaps.find(heap.handle); it != _query_heaps.end() && index < it->second.size())
+		it->second[index] = _gpu_clock.load();
+}
+size_t mock::device::query_heap_count() const
+{
+	const std::shared_lock<std::shared_mutex> lock(_mutex);
+	return _query_heaps.size();
+}
+
+void mock::device::set_resource_name(resource resource, const char *name)
+{
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+	if (const auto it = _resources.find(resource.handle); it != _resources.end())
+		it->second.name = name;
+}
+
+resource mock::device::create_application_resource(resource_desc desc, resource_usage initial_state)
+{
+	// Like in ReShade, the description is only replaced when an add-on reports that it modified it
+	resource_desc modified_desc = desc;
+	if (invoke<addon_event::create_resource>(static_cast<reshade::api::device *>(this), modified_desc, static_cast<subresource_data *>(nullptr), initial_state))
+		desc = modified_desc;
+
+	resource resource = { 0 };
+	create_resource(desc, nullptr, initial_state, &resource);
+
+	invoke<addon_event::init_resource>(static_cast<reshade::api::device *>(this), static_cast<const resource_desc &>(desc), static_cast<const subresource_data *>(nullptr), initial_state, resource);
+	return resource;
+}
+resource_view mock::device::create_application_view(resource resource, resource_usage usage_type, resource_view_desc desc)
+{
+	resource_view_desc modified_desc = desc;
+	if (invoke<addon_event::create_resource_view>(static_cast<reshade::api::device *>(this), resource, usage_type, modified_desc))
+		desc = modified_desc;
+
+	resource_view view = { 0 };
+	create_resource_view(resource, usage_type, desc, &view);
+	return view;
+}
+void mock::device::destroy_application_resource(resource resource)
+{
+	invoke<addon_event::destroy_resource>(static_cast<reshade::api::device *>(this), resource);
+
+	destroy_resource(resource);
+}
+
+std::pair<resource, resource_view> mock::device::create_depth_stencil(uint32_t width, uint32_t height, format format)
+{
+	const resource resource = create_application_resource(resource_desc(width, height, 1, 1, format, 1, memory_heap::gpu_only, resource_usage::depth_stencil), resource_usage::depth_stencil_write);
+	const resource_view view = create_application_view(resource, resource_usage::depth_stencil);
+	return { resource, view };
+}
+
+bool mock::device::exists(resource resource) const
+{
+	const std::shared_lock<std::shared_mutex> lock(_mutex);
+	return _resources.find(resource.handle) != _resources.end();
+}
+resource_desc mock::device::desc(resource resource) const
+{
+	const std::shared_lock<std::shared_mutex> lock(_mutex);
+	if (const auto it = _resources.find(resource.handle); it != _resources.end())
+		return it->second.desc;
+	return resource_desc();
+}
+uint64_t mock::device::content(resource resource) const
+{
+	const std::shared_lock<std::shared_mutex> lock(_mutex);
+	if (const auto it = _resources.find(resource.handle); it != _resources.end())
+		return it->second.content;
+	return 0;
+}
+void mock::device::set_content(resource resource, uint64_t content)
+{
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+	if (const auto it = _resources.find(resource.handle); it != _resources.end())
+		it->second.content = content;
+}
+
+size_t mock::device::resource_count() const
+{
+	const std::shared_lock<std::shared_mutex> lock(_mutex);
+	return _resources.size();
+}
+
+void mock::command_list::barrier(uint32_t count, const resource *resources, const resource_usage *old_states, const resource_usage *new_states)
+{
+	for (uint32_t i = 0; i < count; ++i)
+		_commands.push_back({ command_type::barrier, resources[i], { 0 }, old_states[i], new_states[i], _render_pass_active });
+}
+void mock::command_list::bind_render_targets_and_depth_stencil(uint32_t, const resource_view *, resource_view dsv)
+{
+	_bound_dsv = dsv;
+	_commands.push_back({ command_type::bind_render_targets_and_depth_stencil, { 0 }, { 0 }, resource_usage::undefined, resource_usage::undefined, _render_pass_active });
+}
+void mock::command_list::copy_resource(resource source, resource dest)
+{
+	_device->set_content(dest, _device->content(source));
+	const resource_desc desc = _device->desc(dest);
+	_device->advance_gpu_clock(format_slice_pitch(desc.texture.format, format_row_pitch(desc.texture.format, desc.texture.width), desc.texture.height));
+	_commands.push_back({ command_type::copy_resource, source, dest, resource_usage::undefined, resource_usage::undefined, _render_pass_active });
+}
+void mock::command_list::copy_texture_region(resource source, uint32_t, const subresource_box *source_box, resource dest, uint32_t, const subresource_box *, filter_mode)
+{
+	_device->set_content(dest, _device->content(source));
+	const resource_desc desc = _device->desc(dest);
+	const uint32_t width = source_box != nullptr ? source_box->right - source_box->left : desc.texture.width;
+	const uint32_t height = source_box != nullptr ? source_box->bottom - source_box->top : desc.texture.height;
+	_device->advance_gpu_clock(format_slice_pitch(desc.texture.format, format_row_pitch(desc.texture.format, width), height));
+	_commands.push_back({ command_type::copy_texture_region, source, dest, resource_usage::undefined, resource_usage::undefined, _render_pass_active });
+}
+void mock::command_list::end_query(query_heap heap, query_type, uint32_t index)
+{
+	_device->write_timestamp(heap, index);
+	_commands.push_back({ command_type::end_query, { 0 }, { 0 }, resource_usage::undefined, resource_usage::undefined, _render_pass_active });
+}
+
+void mock::command_list::bind_viewport(const viewport &viewport)
+{
+	invoke<addon_event::bind_viewports>(static_cast<reshade::api::command_list *>(this), 0u, 1u, &viewport);
+}
+void mock::command_list::bind_depth_stencil(resource_view dsv)
+{
+	_bound_dsv = dsv;
+	invoke<addon_event::bind_render_targets_and_depth_stencil>(static_cast<reshade::api::command_list *>(this), 0u, static_cast<const resource_view *>(nullptr), dsv);
+}
+void mock::command_list::draw(uint32_t vertices, uint32_t instances)
+{
+	if (!invoke<addon_event::draw>(static_cast<reshade::api::command_list *>(this), vertices, instances, 0u, 0u))
+		draw_content();
+}
+void mock::command_list::draw_indexed(uint32_t indices, uint32_t instances)
+{
+	if (!invoke<addon_event::draw_indexed>(static_cast<reshade::api::command_list *>(this), indices, instances, 0u, 0, 0u))
+		draw_content();
+}
+void mock::command_list::draw_indirect(uint32_t draw_count)
+{
+	if (!invoke<addon_event::draw_or_dispatch_indirect>(static_cast<reshade::api::command_list *>(this), indirect_command::draw, resource { 0 }, uint64_t(0), draw_count, 0u))
+		draw_content();
+}
+void mock::command_list::clear_depth(resource_view dsv, float depth)
+{
+	if (!invoke<addon_event::clear_depth_stencil_view>(static_cast<reshade::api::command_list *>(this), dsv, static_cast<const float *>(&depth), static_cast<const uint8_t *>(nullptr), 0u, static_cast<const rect *>(nullptr)))
+		_device->set_content(_device->get_resource_from_view(dsv), 0);
+}
+void mock::command_list::begin_render_pass(resource_view dsv, render_pass_load_op depth_load_op, render_pass_store_op depth_store_op)
+{
+	render_pass_depth_stencil_desc depth_stencil_desc;
+	depth_stencil_desc.view = dsv;
+	depth_stencil_desc.depth_load_op = depth_load_op;
+	depth_stencil_desc.depth_store_op = depth_store_op;
+	depth_stencil_desc.clear_depth = 1.0f;
+
+	invoke<addon_event::begin_render_pass>(static_cast<reshade::api::command_list *>(this), 0u, static_cast<const render_pass_render_target_desc *>(nullptr), dsv != 0 ? static_cast<const render_pass_depth_stencil_desc *>(&depth_stencil_desc) : nullptr);
+
+	_render_pass_active = true;
+	_render_pass_dsv = dsv;
+	if (dsv != 0 && depth_load_op == render_pass_load_op::clear)
+		_device->set_content(_device->get_resource_from_view(dsv), 0);
+}
+void mock::command_list::end_render_pass()
+{
+	invoke<addon_event::end_render_pass>(static_cast<reshade::api::command_list *>(this));
+
+	_render_pass_active = false;
+	_render_pass_dsv = { 0 };
+}
+void mock::command_list::transition(resource resource, resource_usage old_state, resource_usage new_state)
+{
+	invoke<addon_event::barrier>(static_cast<reshade::api::command_list *>(this), 1u, static_cast<const reshade::api::resource *>(&resource), static_cast<const resource_usage *>(&old_state), static_cast<const resource_usage *>(&new_state));
+}
+void mock::command_list::reset()
+{
+	invoke<addon_event::reset_command_list>(static_cast<reshade::api::command_list *>(this));
+
+	_bound_dsv = { 0 };
+	_render_pass_active = false;
+	_render_pass_dsv = { 0 };
+}
+void mock::command_list::close()
+{
+	invoke<addon_event::close_command_list>(static_cast<reshade::api::command_list *>(this));
+}
+void mock::command_list::execute_secondary(command_list &secondary)
+{
+	invoke<addon_event::execute_secondary_command_list>(static_cast<reshade::api::command_list *>(this), static_cast<reshade::api::command_list *>(&secondary));
+}
+
+size_t mock::command_list::count(command_type type) const
+{
+	return std::count_if(_commands.begin(), _commands.end(), [type](const command &command) { return command.type == type; });
+}
+
+void mock::command_list::draw_content()
+{
+	const resource_view dsv = _render_pass_active ? _render_pass_dsv : _bound_dsv;
+	if (dsv != 0)
+		_device->set_content(_device->get_resource_from_view(dsv), _device->next_content());
+}
+
+void mock::command_queue::execute(command_list &cmd_list)
+{
+	invoke<addon_event::execute_command_list>(static_cast<reshade::api::command_queue *>(this), static_cast<reshade::api::command_list *>(&cmd_list));
+}
+
+mock::effect_runtime::effect_runtime(mock::device *device, mock::command_queue *queue, uint32_t width, uint32_t height) :
+	_device(device), _queue(queue), _width(width), _height(height)
+{
+	_device->create_resource(resource_desc(width, height, 1, 1, format::b8g8r8a8_unorm, 1, memory_heap::gpu_only, resource_usage::render_target | resource_usage::copy_source), nullptr, resource_usage::present, &_back_buffer);
+}
+
+void mock::effect_runtime::get_screenshot_width_and_height(uint32_t *out_width, uint32_t *out_height) const
+{
+	*out_width = _width;
+	*out_height = _height;
+}
+
+void mock::effect_runtime::update_texture_bindings(const char *semantic, resource_view srv, resource_view srv_srgb)
+{
+	binding_updates++;
+
+	for (auto &[name, views] : _bindings)
+	{
+		if (name == semantic)
+		{
+			views = { srv, srv_srgb };
+			return;
+		}
+	}
+	_bindings.emplace_back(semantic, std::make_pair(srv, srv_srgb));
+}
+
+void mock::effect_runtime::enumerate_uniform_variables(const char *effect_name, void(*callback)(reshade::api::effect_runtime *runtime, effect_uniform_variable variable, void *user_data), void *user_data)
+{
+	uniform_enumerations++;
+
+	for (size_t i = 0; i < _uniforms.size(); ++i)
+		if (effect_name == nullptr || _uniforms[i].effect == effect_name)
+			callback(this, { i + 1 }, user_data);
+}
+effect_uniform_variable mock::effect_runtime::find_uniform_variable(const char *effect_name, const char *variable_name) const
+{
+	variable_lookups++;
+
+	for (size_t i = 0; i < _uniforms.size(); ++i)
+		if (_uniforms[i].effect == effect_name && _uniforms[i].name == variable_name)
+			return { i + 1 };
+	return { 0 };
+}
+bool mock::effect_runtime::get_annotation_string_from_uniform_variable(effect_uniform_variable variable, const char *name, char *value, size_t *size) const
+{
+	if (variable.handle == 0 || variable.handle > _uniforms.size() || std::strcmp(name, "source") != 0)
+		return false;
+
+	const std::string &source = _uniforms[variable.handle - 1].source;
+	if (source.empty())
+		return false;
+
+	const size_t length = std::min(source.size(), *size - 1);
+	std::memcpy(value, source.c_str(), length);
+	value[length] = '\0';
+	*size = length;
+	return true;
+}
+void mock::effect_runtime::get_uniform_value_float(effect_uniform_variable variable, float *values, size_t count, size_t array_index) const
+{
+	for (size_t i = 0; i < count && array_index + i < 4; ++i)
+		values[i] = variable.handle != 0 ? _uniforms[variable.handle - 1].values[array_index + i] : 0.0f;
+}
+void mock::effect_runtime::get_uniform_value_int(effect_uniform_variable variable, int32_t *values, size_t count, size_t array_index) const
+{
+	for (size_t i = 0; i < count && array_index + i < 4; ++i)
+		values[i] = variable.handle != 0 ? static_cast<int32_t>(_uniforms[variable.handle - 1].values[array_index + i]) : 0;
+}
+void mock::effect_runtime::set_uniform_value_bool(effect_uniform_variable variable, const bool *values, size_t count, size_t array_index)
+{
+	for (size_t i = 0; i < count && array_index + i < 4; ++i)
+		if (variable.handle != 0)
+			_uniforms[variable.handle - 1].values[array_index + i] = values[i] ? 1.0f : 0.0f;
+}
+void mock::effect_runtime::set_uniform_value_float(effect_uniform_variable variable, const float *values, size_t count, size_t array_index)
+{
+	for (size_t i = 0; i < count && array_index + i < 4; ++i)
+		if (variable.handle != 0)
+			_uniforms[variable.handle - 1].values[array_index + i] = values[i];
+}
+void mock::effect_runtime::set_uniform_value_int(effect_uniform_variable variable, const int32_t *values, size_t count, size_t array_index)
+{
+	for (size_t i = 0; i < count && array_index + i < 4; ++i)
+		if (variable.handle != 0)
+			_uniforms[variable.handle - 1].values[array_index + i] = static_cast<float>(values[i]);
+}
+
+effect_texture_variable mock::effect_runtime::find_texture_variable(const char *effect_name, const char *variable_name) const
+{
+	variable_lookups++;
+
+	for (size_t i = 0; i < _textures.size(); ++i)
+		if (_textures[i].effect == effect_name && _textures[i].name == variable_name)
+			return { i + 1 };
+	return { 0 };
+}
+void mock::effect_runtime::get_texture_binding(effect_texture_variable variable, resource_view *out_srv, resource_view *out_srv_srgb) const
+{
+	if (variable.handle == 0 || variable.handle > _textures.size())
+		return;
+
+	*out_srv = _textures[variable.handle - 1].srv;
+	*out_srv_srgb = _textures[variable.handle - 1].srv_srgb;
+}
+
+void mock::effect_runtime::set_preprocessor_definition(const char *name, const char *value)
+{
+	definition_changes++;
+
+	for (auto &[existing_name, existing_value] : _definitions)
+	{
+		if (existing_name == name)
+		{
+			existing_value = value;
+			return;
+		}
+	}
+	_definitions.emplace_back(name, value);
+}
+
+void mock::effect_runtime::add_uniform_variable(const char *effect_name, const char *variable_name, const char *source, float value)
+{
+	uniform_variable &variable = _uniforms.emplace_back();
+	variable.effect = effect_name;
+	variable.name = variable_name;
+	variable.source = source;
+	variable.values[0] = value;
+}
+void mock::effect_runtime::add_texture_variable(const char *effect_name, const char *variable_name, uint32_t width, uint32_t height, format format)
+{
+	texture_variable &variable = _textures.emplace_back();
+	variable.effect = effect_name;
+	variable.name = variable_name;
+
+	_device->create_resource(resource_desc(width, height, 1, 1, format, 1, memory_heap::gpu_only, resource_usage::render_target | resource_usage::shader_resource | resource_usage::copy_source), nullptr, resource_usage::shader_resource, &variable.texture);
+	_device->create_resource_view(variable.texture, resource_usage::shader_resource, resource_view_desc(format), &variable.srv);
+	_device->create_resource_view(variable.texture, resource_usage::shader_resource, resource_view_desc(format), &variable.srv_srgb);
+}
+void mock::effect_runtime::add_citra_effect()
+{
+	add_uniform_variable("Citra.fx", "fUINearPlane", "", 0.0f);
+	add_uniform_variable("Citra.fx", "fUIFarPlane", "", 0.01f);
+	add_uniform_variable("Citra.fx", "fUIDepthMultiplier", "", 1.0f);
+	add_uniform_variable("Citra.fx", "iUIPresentType", "", 0.0f);
+	add_uniform_variable("Citra.fx", "bHasDepth", "bufready_depth", 0.0f);
+	add_uniform_variable("Citra.fx", "iCitraDepthResolutionDivisor", "", 1.0f);
+	add_texture_variable("Citra.fx", "ModifiedDepthTex", _width, _height, format::r32_float);
+	add_texture_variable("Citra.fx", "ModifiedDepthHalfTex", _width / 2, _height / 2, format::r32_float);
+	add_texture_variable("Citra.fx", "ModifiedDepthQuarterTex", _width / 4, _height / 4, format::r32_float);
+	add_texture_variable("Citra.fx", "ModifiedNormalTex", _width, _height, format::r8g8b8a8_unorm);
+	add_texture_variable("Citra.fx", "ModifiedNormalHalfTex", _width / 2, _height / 2, format::r8g8b8a8_unorm);
+	add_texture_variable("Citra.fx", "ModifiedNormalQuarterTex", _width / 4, _height / 4, format::r8g8b8a8_unorm);
+}
+
+resource_view mock::effect_runtime::binding(const char *semantic) const
+{
+	for (const auto &[name, views] : _bindings)
+		if (name == semantic)
+			return views.first;
+	return { 0 };
+}
+std::string mock::effect_runtime::definition(const char *name) const
+{
+	for (const auto &[existing_name, value] : _definitions)
+		if (existing_name == name)
+			return value;
+	return std::string();
+}
+float mock::effect_runtime::uniform_value(const char *effect_name, const char *variable_name) const
+{
+	for (const uniform_variable &variable : _uniforms)
+		if (variable.effect == effect_name && variable.name == variable_name)
+			return variable.values[0];
+	return 0.0f;
+}
+
+void mock::effect_runtime::present()
+{
+	invoke<addon_event::present>(static_cast<reshade::api::command_queue *>(_queue), static_cast<reshade::api::swapchain *>(this), static_cast<const rect *>(nullptr), static_cast<const rect *>(nullptr), 0u, static_cast<const rect *>(nullptr));
+
+	render_effects();
+}
+void mock::effect_runtime::render_effects()
+{
+	reshade::api::command_list *const cmd_list = _queue->get_immediate_command_list();
+
+	invoke<addon_event::reshade_begin_effects>(static_cast<reshade::api::effect_runtime *>(this), cmd_list, resource_view { 0 }, resource_view { 0 });
+	invoke<addon_event::reshade_finish_effects>(static_cast<reshade::api::effect_runtime *>(this), cmd_list, resource_view { 0 }, resource_view { 0 });
+}
+void mock::effect_runtime::reload_effects()
+{
+	invoke<addon_event::reshade_reloaded_effects>(static_cast<reshade::api::effect_runtime *>(this));
+}
+
+mock::context::context(device_api api, uint32_t width, uint32_t height)
+{
+	device = std::make_unique<mock::device>(api);
+	invoke<addon_event::init_device>(static_cast<reshade::api::device *>(device.get()));
+
+	queue = std::make_unique<mock::command_queue>(device.get());
+	invoke<addon_event::init_command_queue>(static_cast<reshade::api::command_queue *>(queue.get()));
+
+	runtime = std::make_unique<mock::effect_runtime>(device.get(), queue.get(), width, height);
+	invoke<addon_event::init_effect_runtime>(static_cast<reshade::api::effect_runtime *>(runtime.get()));
+
+	runtime->add_citra_effect();
+	runtime->reload_effects();
+}
+mock::context::~context()
+{
+	invoke<addon_event::destroy_effect_runtime>(static_cast<reshade::api::effect_runtime *>(runtime.get()));
+	runtime.reset();
+
+	invoke<addon_event::destroy_command_queue>(static_cast<reshade::api::command_queue *>(queue.get()));
+	queue.reset();
+
+	invoke<addon_event::destroy_device>(static_cast<reshade::api::device *>(device.get()));
+	device.reset();
+}
+
+std::unique_ptr<mock::command_list, void(*)(mock::command_list *)> mock::context::create_command_list()
+{
+	command_list *const cmd_list = new command_list(device.get());
+	invoke<addon_event::init_command_list>(static_cast<reshade::api::command_list *>(cmd_list));
+
+	return { cmd_list, [](command_list *cmd_list) {
+		invoke<addon_event::destroy_command_list>(static_cast<reshade::api::command_list *>(cmd_list));
+		delete cmd_list;
+	} };
+}
@@ -0,0 +1,409 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Fake ReShade host for tests and benchmarks of the add-on core
+ * It plays the part of both ReShade (invoking the events the add-on registered) and the application (creating resources, recording and submitting command lists, presenting)
+ * Everything the add-on does through the API is recorded, and resources carry a "content" value that draws, clears and copies update, so that tests can check what ended up in a backup texture
+ */
+
+#pragma once
+
+#include <reshade.hpp>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Entry points of the add-on core (see 'citra.cpp')
+void register_addon_depth();
+void unregister_addon_depth();
+
+namespace mock
+{
+	using namespace reshade::api;
+	using reshade::addon_event;
+
+	// Callbacks the add-on currently has registered for every event
+	// Like in ReShade, changing registrations is not synchronized with invoking them, so tests must not do that from different threads at the same time
+	extern std::vector<void *> s_callbacks[static_cast<size_t>(addon_event::max)];
+
+	inline size_t registered_callbacks(addon_event ev)
+	{
+		return s_callbacks[static_cast<size_t>(ev)].size();
+	}
+
+	// Calls every callback registered for an event, returning whether any of them returned true for events that can skip the call
+	// Arguments are passed by reference, so that callbacks see changes made to descriptions by the ones before them, like in ReShade
+	template <addon_event ev, typename... Args>
+	inline typename reshade::addon_event_traits<ev>::type invoke(Args &&... args)
+	{
+		using traits = reshade::addon_event_traits<ev>;
+		const std::vector<void *> &callbacks = s_callbacks[static_cast<size_t>(ev)];
+
+		if constexpr (std::is_same_v<typename traits::type, bool>)
+		{
+			bool skip = false;
+			for (size_t i = 0; i < callbacks.size(); ++i)
+				skip |= reinterpret_cast<typename traits::decl>(callbacks[i])(args...);
+			return skip;
+		}
+		else
+		{
+			for (size_t i = 0; i < callbacks.size(); ++i)
+				reinterpret_cast<typename traits::decl>(callbacks[i])(args...);
+		}
+	}
+
+	// Clears the configuration and the log, should be called before a device is created
+	void reset_config();
+	void set_config(const char *section, const char *key, const std::string &value);
+	std::string get_config(const char *section, const char *key);
+
+	// Messages the add-on logged
+	std::vector<std::string> log_messages();
+
+	// Draws the settings overlay of the add-on, clicking the first widget whose label starts with 'click_label' (if any)
+	// Returns the text the overlay showed, one entry per text widget
+	std::vector<std::string> draw_overlay(effect_runtime *runtime, const char *click_label = nullptr);
+	// Returns whether any of the text the overlay last showed contains 'text'
+	bool overlay_contains(const std::vector<std::string> &lines, const char *text);
+
+	// Private data of an API object, looked up linearly by key like ReShade does
+	struct private_data_store
+	{
+		std::vector<std::pair<const void *, void *>> entries;
+
+		void *get(const void *key) const
+		{
+			for (const auto &[entry_key, data] : entries)
+				if (entry_key == key)
+					return data;
+			return nullptr;
+		}
+		void set(const void *key, void *data)
+		{
+			for (auto &entry : entries)
+			{
+				if (entry.first == key)
+				{
+					entry.second = data;
+					return;
+				}
+			}
+			entries.emplace_back(key, data);
+		}
+	};
+
+	uint64_t next_handle();
+
+	class device final : public reshade::api::device
+	{
+	public:
+		struct resource_state
+		{
+			resource_desc desc;
+			std::string name;
+			// Changed by draws, clears and copies (see 'command_list')
+			uint64_t content = 0;
+			// Storage of textures in the 'gpu_to_cpu' heap, which can be mapped
+			std::vector<uint8_t> data;
+		};
+
+		explicit device(device_api api) : _api(api) {}
+
+		uint64_t get_native() const override { return reinterpret_cast<uintptr_t>(this); }
+		void *get_private_data_pointer(const void *key) const override { return _private_data.get(key); }
+		void set_private_data_pointer(const void *key, void *data) override { _private_data.set(key, data); }
+
+		device_api get_api() override { return _api; }
+
+		bool create_resource(const resource_desc &desc, const subresource_data *initial_data, resource_usage initial_state, resource *out_handle) override;
+		void destroy_resource(resource handle) override;
+		resource_desc get_resource_desc(resource resource) const override;
+
+		bool create_resource_view(resource resource, resource_usage usage_type, const resource_view_desc &desc, resource_view *out_handle) override;
+		void destroy_resource_view(resource_view handle) override;
+		resource get_resource_from_view(resource_view view) const override;
+		resource_view_desc get_resource_view_desc(resource_view view) const override;
+
+		bool map_texture_region(resource resource, uint32_t subresource, const subresource_box *box, map_access access, subresource_data *out_data) override;
+		void unmap_texture_region(resource resource, uint32_t subresource) override;
+
+		bool create_query_heap(query_type type, uint32_t size, query_heap *out_handle) override;
+		void destroy_query_heap(query_heap handle) override;
+		bool get_query_heap_results(query_heap heap, uint32_t first, uint32_t count, void *results, uint32_t stride) override;
+
+		void set_resource_name(resource resource, const char *name) override;
+
+		// Creates a resource as the application would, which goes through the 'create_resource' and 'init_resource' events
+		resource create_application_resource(resource_desc desc, resource_usage initial_state = resource_usage::undefined);
+		// Creates a view as the application would, which goes through the 'create_resource_view' event
+		resource_view create_application_view(resource resource, resource_usage usage_type, resource_view_desc desc = resource_view_desc());
+		// Destroys a resource as the application would, which goes through the 'destroy_resource' event
+		void destroy_application_resource(resource resource);
+
+		// Creates a depth-stencil texture and a depth-stencil view to it
+		std::pair<resource, resource_view> create_depth_stencil(uint32_t width, uint32_t height, format format = format::d24_unorm_s8_uint);
+
+		bool exists(resource resource) const;
+		// Same as 'get_resource_desc', but not counted in 'get_resource_desc_calls' since the add-on did not ask for it
+		resource_desc desc(resource resource) const;
+		uint64_t content(resource resource) const;
+		void set_content(resource resource, uint64_t content);
+		uint64_t next_content() { return ++_next_content; }
+
+		// Time on the fake GPU in nanoseconds, which only copies advance (by 'gpu_copy_bytes_per_ns'), so that timestamps around them measure their size
+		static constexpr uint64_t gpu_copy_bytes_per_ns = 10;
+		uint64_t gpu_clock() const { return _gpu_clock.load(); }
+		void advance_gpu_clock(uint64_t bytes_copied) { _gpu_clock += bytes_copied / gpu_copy_bytes_per_ns; }
+		void write_timestamp(query_heap heap, uint32_t index);
+
+		// Number of query heaps that exist
+		size_t query_heap_count() const;
+
+		// Number of resources that exist, which were created by the add-on or the application
+		size_t resource_count() const;
+
+		mutable std::atomic<size_t> get_resource_desc_calls = 0;
+		std::atomic<size_t> resources_created = 0;
+		std::atomic<size_t> resource_views_created = 0;
+
+	private:
+		const device_api _api;
+		private_data_store _private_data;
+		mutable std::shared_mutex _mutex;
+		std::unordered_map<uint64_t, resource_state> _resources;
+		std::unordered_map<uint64_t, std::pair<resource, resource_view_desc>> _views;
+		std::unordered_map<uint64_t, std::vector<uint64_t>> _query_heaps;
+		std::atomic<uint64_t> _next_content = 0;
+		std::atomic<uint64_t> _gpu_clock = 0;
+	};
+
+	class command_list final : public reshade::api::command_list
+	{
+	public:
+		enum class command_type
+		{
+			barrier,
+			copy_resource,
+			copy_texture_region,
+			bind_render_targets_and_depth_stencil,
+			end_query,
+		};
+		struct command
+		{
+			command_type type;
+			resource source;
+			resource dest;
+			resource_usage old_state;
+			resource_usage new_state;
+			// Set for commands the add-on recorded while a render pass was active, which is not allowed for copies in D3D12 and Vulkan
+			bool inside_render_pass;
+		};
+
+		// A command list can share the private data of a queue, which is what the immediate context in D3D11 does
+		explicit command_list(mock::device *device, private_data_store *shared_private_data = nullptr) :
+			_device(device), _private_data(shared_private_data != nullptr ? shared_private_data : &_own_private_data) {}
+
+		uint64_t get_native() const override { return reinterpret_cast<uintptr_t>(this); }
+		void *get_private_data_pointer(const void *key) const override { return _private_data->get(key); }
+		void set_private_data_pointer(const void *key, void *data) override { _private_data->set(key, data); }
+
+		reshade::api::device *get_device() override { return _device; }
+
+		// Commands recorded by the add-on
+		void barrier(uint32_t count, const resource *resources, const resource_usage *old_states, const resource_usage *new_states) override;
+		void bind_render_targets_and_depth_stencil(uint32_t count, const resource_view *rtvs, resource_view dsv) override;
+		void copy_resource(resource source, resource dest) override;
+		void copy_texture_region(resource source, uint32_t source_subresource, const subresource_box *source_box, resource dest, uint32_t dest_subresource, const subresource_box *dest_box, filter_mode filter) override;
+		void end_query(query_heap heap, query_type type, uint32_t index) override;
+		using reshade::api::command_list::barrier;
+
+		// Commands recorded by the application, which go through the events the add-on registered for them
+		void bind_viewport(const viewport &viewport);
+		void bind_depth_stencil(resource_view dsv);
+		void draw(uint32_t vertices, uint32_t instances = 1);
+		void draw_indexed(uint32_t indices, uint32_t instances = 1);
+		void draw_indirect(uint32_t draw_count);
+		void clear_depth(resource_view dsv, float depth = 1.0f);
+		void begin_render_pass(resource_view dsv, render_pass_load_op depth_load_op = render_pass_load_op::load, render_pass_store_op depth_store_op = render_pass_store_op::store);
+		void end_render_pass();
+		void transition(resource resource, resource_usage old_state, resource_usage new_state);
+		void reset();
+		void close();
+		void execute_secondary(command_list &secondary);
+
+		bool render_pass_active() const { return _render_pass_active; }
+
+		// Commands the add-on recorded since the last call to 'clear_commands'
+		const std::vector<command> &commands() const { return _commands; }
+		size_t count(command_type type) const;
+		void clear_commands() { _commands.clear(); }
+
+	private:
+		void draw_content();
+
+		mock::device *const _device;
+		private_data_store _own_private_data;
+		private_data_store *const _private_data;
+		std::vector<command> _commands;
+		resource_view _bound_dsv = { 0 };
+		resource_view _render_pass_dsv = { 0 };
+		bool _render_pass_active = false;
+	};
+
+	class command_queue final : public reshade::api::command_queue
+	{
+	public:
+		explicit command_queue(mock::device *device, command_queue_type type = command_queue_type::graphics) :
+			_device(device), _type(type), _immediate_command_list(device, &_private_data) {}
+
+		uint64_t get_native() const override { return reinterpret_cast<uintptr_t>(this); }
+		void *get_private_data_pointer(const void *key) const override { return _private_data.get(key); }
+		void set_private_data_pointer(const void *key, void *data) override { _private_data.set(key, data); }
+
+		reshade::api::device *get_device() override { return _device; }
+
+		command_queue_type get_type() const override { return _type; }
+
+		void wait_idle() const override
+		{
+			wait_idle_calls++;
+			if (on_wait_idle)
+				on_wait_idle();
+		}
+
+		// Timestamps are in nanoseconds of the fake GPU clock (see 'device::gpu_clock')
+		uint64_t get_timestamp_frequency() const override { return 1000000000; }
+
+		void flush_immediate_command_list() const override {}
+		mock::command_list *get_immediate_command_list() override { return &_immediate_command_list; }
+
+		// Submits a command list as the application would, which goes through the 'execute_command_list' event
+		void execute(command_list &cmd_list);
+
+		mutable std::atomic<size_t> wait_idle_calls = 0;
+		// Called while the add-on waits for the GPU, to check what other threads can do in the meantime
+		std::function<void()> on_wait_idle;
+
+	private:
+		mock::device *const _device;
+		const command_queue_type _type;
+		private_data_store _private_data;
+		mock::command_list _immediate_command_list;
+	};
+
+	class effect_runtime final : public reshade::api::effect_runtime
+	{
+	public:
+		struct uniform_variable
+		{
+			std::string effect;
+			std::string name;
+			// Value of the "source" annotation
+			std::string source;
+			float values[4] = {};
+		};
+		struct texture_variable
+		{
+			std::string effect;
+			std::string name;
+			resource texture = { 0 };
+			resource_view srv = { 0 };
+			resource_view srv_srgb = { 0 };
+		};
+
+		effect_runtime(mock::device *device, mock::command_queue *queue, uint32_t width, uint32_t height);
+
+		uint64_t get_native() const override { return reinterpret_cast<uintptr_t>(this); }
+		void *get_private_data_pointer(const void *key) const override { return _private_data.get(key); }
+		void set_private_data_pointer(const void *key, void *data) override { _private_data.set(key, data); }
+
+		reshade::api::device *get_device() override { return _device; }
+
+		void *get_hwnd() const override { return nullptr; }
+		resource get_current_back_buffer() override { return _back_buffer; }
+
+		reshade::api::command_queue *get_command_queue() override { return _queue; }
+
+		void get_screenshot_width_and_height(uint32_t *out_width, uint32_t *out_height) const override;
+
+		void update_texture_bindings(const char *semantic, resource_view srv, resource_view srv_srgb) override;
+
+		void enumerate_uniform_variables(const char *effect_name, void(*callback)(reshade::api::effect_runtime *runtime, effect_uniform_variable variable, void *user_data), void *user_data) override;
+		using reshade::api::effect_runtime::enumerate_uniform_variables;
+		effect_uniform_variable find_uniform_variable(const char *effect_name, const char *variable_name) const override;
+		bool get_annotation_string_from_uniform_variable(effect_uniform_variable variable, const char *name, char *value, size_t *size) const override;
+		using reshade::api::effect_runtime::get_annotation_string_from_uniform_variable;
+		void get_uniform_value_float(effect_uniform_variable variable, float *values, size_t count, size_t array_index) const override;
+		void get_uniform_value_int(effect_uniform_variable variable, int32_t *values, size_t count, size_t array_index) const override;
+		void set_uniform_value_bool(effect_uniform_variable variable, const bool *values, size_t count, size_t array_index) override;
+		using reshade::api::effect_runtime::set_uniform_value_bool;
+		void set_uniform_value_float(effect_uniform_variable variable, const float *values, size_t count, size_t array_index) override;
+		void set_uniform_value_int(effect_uniform_variable variable, const int32_t *values, size_t count, size_t array_index) override;
+
+		effect_texture_variable find_texture_variable(const char *effect_name, const char *variable_name) const override;
+		void get_texture_binding(effect_texture_variable variable, resource_view *out_srv, resource_view *out_srv_srgb) const override;
+
+		void set_preprocessor_definition(const char *name, const char *value) override;
+
+		// Adds a uniform variable, optionally with a "source" annotation
+		void add_uniform_variable(const char *effect_name, const char *variable_name, const char *source = "", float value = 0.0f);
+		// Adds a texture variable, for which a texture and views are created
+		void add_texture_variable(const char *effect_name, const char *variable_name, uint32_t width, uint32_t height, format format);
+		// Adds the variables of 'Citra.fx' that the add-on looks for, plus one uniform that asks whether depth is available
+		void add_citra_effect();
+
+		// What the add-on bound to a texture semantic (zero when nothing)
+		resource_view binding(const char *semantic) const;
+		// Value of a preprocessor definition the add-on set (empty when none)
+		std::string definition(const char *name) const;
+		float uniform_value(const char *effect_name, const char *variable_name) const;
+
+		// Presents as the application would, which goes through the 'present' event and then renders effects
+		void present();
+		// Renders effects, which goes through the 'reshade_begin_effects' and 'reshade_finish_effects' events
+		void render_effects();
+		// Reloads effects, which goes through the 'reshade_reloaded_effects' event
+		void reload_effects();
+
+		size_t binding_updates = 0;
+		size_t definition_changes = 0;
+		mutable size_t uniform_enumerations = 0;
+		mutable size_t variable_lookups = 0;
+
+	private:
+		mock::device *const _device;
+		mock::command_queue *const _queue;
+		private_data_store _private_data;
+		const uint32_t _width, _height;
+		resource _back_buffer = { 0 };
+		std::vector<uniform_variable> _uniforms;
+		std::vector<texture_variable> _textures;
+		std::vector<std::pair<std::string, std::pair<resource_view, resource_view>>> _bindings;
+		std::vector<std::pair<std::string, std::string>> _definitions;
+	};
+
+	// A device with a graphics queue and an effect runtime, created and destroyed in the order ReShade does
+	class context
+	{
+	public:
+		explicit context(device_api api, uint32_t width = 1200, uint32_t height = 720);
+		~context();
+
+		// Creates a command list (e.g. a Vulkan command buffer or a D3D11 deferred context) that is submitted with 'command_queue::execute'
+		std::unique_ptr<command_list, void(*)(command_list *)> create_command_list();
+
+		// Command list that records directly on the queue (e.g. the D3D11 immediate context)
+		command_list &immediate() { return *queue->get_immediate_command_list(); }
+
+		std::unique_ptr<mock::device> device;
+		std::unique_ptr<mock::command_queue> queue;
+		std::unique_ptr<mock::effect_runtime> runtime;
+	};
+}
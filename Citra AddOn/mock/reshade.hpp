@@ -0,0 +1,697 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Stand-in for the parts of the ReShade add-on API that 'citra.cpp' uses, so that the add-on core can be built and tested outside of ReShade (e.g. on Linux)
+ * Declarations follow ReShade 5 (reshade_api_*.hpp, reshade_events.hpp), the implementations that record what the add-on does are in 'mock_host.hpp'
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+#ifndef _WIN32
+typedef void *HMODULE;
+#endif
+
+namespace reshade { namespace api
+{
+	#define RESHADE_DEFINE_ENUM_FLAG_OPERATORS(type) \
+		constexpr type operator~(type a) { return static_cast<type>(~static_cast<uint32_t>(a)); } \
+		constexpr type operator&(type a, type b) { return static_cast<type>(static_cast<uint32_t>(a) & static_cast<uint32_t>(b)); } \
+		constexpr type operator|(type a, type b) { return static_cast<type>(static_cast<uint32_t>(a) | static_cast<uint32_t>(b)); } \
+		inline type &operator&=(type &a, type b) { return a = a & b; } \
+		inline type &operator|=(type &a, type b) { return a = a | b; } \
+		constexpr bool operator==(type lhs, uint32_t rhs) { return static_cast<uint32_t>(lhs) == rhs; } \
+		constexpr bool operator!=(type lhs, uint32_t rhs) { return static_cast<uint32_t>(lhs) != rhs; }
+
+	#define RESHADE_DEFINE_HANDLE(name) \
+		struct name { uint64_t handle; }; \
+		constexpr bool operator< (name lhs, name rhs) { return lhs.handle < rhs.handle; } \
+		constexpr bool operator!=(name lhs, name rhs) { return lhs.handle != rhs.handle; } \
+		constexpr bool operator!=(name lhs, uint64_t rhs) { return lhs.handle != rhs; } \
+		constexpr bool operator==(name lhs, name rhs) { return lhs.handle == rhs.handle; } \
+		constexpr bool operator==(name lhs, uint64_t rhs) { return lhs.handle == rhs; }
+
+	enum class device_api
+	{
+		d3d9 = 0x9000,
+		d3d10 = 0xa000,
+		d3d11 = 0xb000,
+		d3d12 = 0xc000,
+		opengl = 0x10000,
+		vulkan = 0x20000
+	};
+
+	enum class format : uint32_t
+	{
+		unknown = 0,
+		r32_g8_typeless = 19,
+		d32_float_s8_uint = 20,
+		r8g8b8a8_typeless = 27,
+		r8g8b8a8_unorm = 28,
+		r8g8b8a8_unorm_srgb = 29,
+		r32_typeless = 39,
+		d32_float = 40,
+		r32_float = 41,
+		r24_g8_typeless = 44,
+		d24_unorm_s8_uint = 45,
+		r24_unorm_x8_uint = 46,
+		r16_typeless = 53,
+		r16_float = 54,
+		d16_unorm = 55,
+		r16_unorm = 56,
+		b8g8r8a8_typeless = 90,
+		b8g8r8a8_unorm = 87,
+		b8g8r8a8_unorm_srgb = 91,
+		s8_uint = 0x7fff0000,
+		d16_unorm_s8_uint = 0x7fff0001,
+		d24_unorm_x8_uint = 0x7fff0002,
+		intz = 0x5a544e49 // 'INTZ'
+	};
+
+	inline format format_to_typeless(format value)
+	{
+		switch (value)
+		{
+		case format::r32_g8_typeless:
+		case format::d32_float_s8_uint:
+			return format::r32_g8_typeless;
+		case format::r32_typeless:
+		case format::d32_float:
+		case format::r32_float:
+			return format::r32_typeless;
+		case format::r24_g8_typeless:
+		case format::d24_unorm_s8_uint:
+		case format::d24_unorm_x8_uint:
+		case format::r24_unorm_x8_uint:
+		case format::intz:
+			return format::r24_g8_typeless;
+		case format::r16_typeless:
+		case format::r16_float:
+		case format::d16_unorm:
+		case format::r16_unorm:
+			return format::r16_typeless;
+		case format::r8g8b8a8_typeless:
+		case format::r8g8b8a8_unorm:
+		case format::r8g8b8a8_unorm_srgb:
+			return format::r8g8b8a8_typeless;
+		case format::b8g8r8a8_typeless:
+		case format::b8g8r8a8_unorm:
+		case format::b8g8r8a8_unorm_srgb:
+			return format::b8g8r8a8_typeless;
+		default:
+			return value;
+		}
+	}
+	inline format format_to_default_typed(format value, int srgb_variant = -1)
+	{
+		switch (value)
+		{
+		case format::r32_g8_typeless:
+		case format::d32_float_s8_uint:
+			return format::r32_g8_typeless;
+		case format::r32_typeless:
+		case format::d32_float:
+			return format::r32_float;
+		case format::r24_g8_typeless:
+		case format::d24_unorm_s8_uint:
+		case format::d24_unorm_x8_uint:
+		case format::intz:
+			return format::r24_unorm_x8_uint;
+		case format::r16_typeless:
+		case format::d16_unorm:
+			return format::r16_unorm;
+		case format::r8g8b8a8_typeless:
+			return srgb_variant == 1 ? format::r8g8b8a8_unorm_srgb : format::r8g8b8a8_unorm;
+		case format::b8g8r8a8_typeless:
+			return srgb_variant == 1 ? format::b8g8r8a8_unorm_srgb : format::b8g8r8a8_unorm;
+		default:
+			return value;
+		}
+	}
+	inline format format_to_depth_stencil_typed(format value)
+	{
+		switch (value)
+		{
+		case format::r32_g8_typeless:
+			return format::d32_float_s8_uint;
+		case format::r32_typeless:
+		case format::r32_float:
+			return format::d32_float;
+		case format::r24_g8_typeless:
+		case format::r24_unorm_x8_uint:
+			return format::d24_unorm_s8_uint;
+		case format::r16_typeless:
+		case format::r16_unorm:
+			return format::d16_unorm;
+		default:
+			return value;
+		}
+	}
+
+	inline uint32_t format_row_pitch(format value, uint32_t width)
+	{
+		switch (value)
+		{
+		case format::s8_uint:
+			return width;
+		case format::r16_typeless:
+		case format::r16_float:
+		case format::d16_unorm:
+		case format::r16_unorm:
+			return width * 2;
+		case format::r32_g8_typeless:
+		case format::d32_float_s8_uint:
+			return width * 8;
+		case format::unknown:
+			return 0;
+		default:
+			return width * 4;
+		}
+	}
+	inline uint32_t format_slice_pitch(format, uint32_t row_pitch, uint32_t height)
+	{
+		return row_pitch * height;
+	}
+
+	enum class resource_type : uint32_t
+	{
+		unknown,
+		buffer,
+		texture_1d,
+		texture_2d,
+		texture_3d,
+		surface
+	};
+
+	enum class resource_view_type : uint32_t
+	{
+		unknown,
+		buffer,
+		texture_1d,
+		texture_1d_array,
+		texture_2d,
+		texture_2d_array,
+		texture_2d_multisample,
+		texture_2d_multisample_array,
+		texture_3d,
+		texture_cube,
+		texture_cube_array
+	};
+
+	enum class memory_heap : uint32_t
+	{
+		unknown,
+		gpu_only,
+		cpu_to_gpu,
+		gpu_to_cpu,
+		cpu_only
+	};
+
+	enum class resource_usage : uint32_t
+	{
+		undefined = 0,
+		index_buffer = 0x2,
+		vertex_buffer = 0x1,
+		constant_buffer = 0x8000,
+		unordered_access = 0x8,
+		render_target = 0x4,
+		depth_stencil = 0x30,
+		depth_stencil_read = 0x20,
+		depth_stencil_write = 0x10,
+		shader_resource = 0xc0,
+		shader_resource_pixel = 0x80,
+		shader_resource_non_pixel = 0x40,
+		copy_dest = 0x400,
+		copy_source = 0x800,
+		general = 0x80000000,
+		present = 0x80000000 | render_target | copy_source
+	};
+	RESHADE_DEFINE_ENUM_FLAG_OPERATORS(resource_usage);
+
+	enum class resource_flags : uint32_t
+	{
+		none = 0,
+		dynamic = (1 << 3),
+		cube_compatible = (1 << 2),
+		generate_mipmaps = (1 << 0),
+		shared = (1 << 1)
+	};
+	RESHADE_DEFINE_ENUM_FLAG_OPERATORS(resource_flags);
+
+	enum class command_queue_type : uint32_t
+	{
+		graphics = 0x1,
+		compute = 0x2,
+		copy = 0x4
+	};
+	RESHADE_DEFINE_ENUM_FLAG_OPERATORS(command_queue_type);
+
+	enum class indirect_command : uint32_t
+	{
+		unknown,
+		draw,
+		draw_indexed,
+		dispatch
+	};
+
+	enum class render_pass_load_op : uint32_t
+	{
+		load,
+		clear,
+		discard,
+		no_access
+	};
+	enum class render_pass_store_op : uint32_t
+	{
+		store,
+		discard,
+		no_access
+	};
+
+	enum class map_access : uint32_t
+	{
+		read_only,
+		write_only,
+		read_write,
+		write_discard
+	};
+
+	enum class filter_mode : uint32_t
+	{
+		min_mag_mip_point = 0
+	};
+
+	enum class query_type
+	{
+		occlusion = 0,
+		binary_occlusion = 1,
+		timestamp = 2
+	};
+
+	RESHADE_DEFINE_HANDLE(resource);
+	RESHADE_DEFINE_HANDLE(resource_view);
+	RESHADE_DEFINE_HANDLE(query_heap);
+	RESHADE_DEFINE_HANDLE(effect_uniform_variable);
+	RESHADE_DEFINE_HANDLE(effect_texture_variable);
+	RESHADE_DEFINE_HANDLE(effect_technique);
+
+	struct viewport
+	{
+		float x, y;
+		float width, height;
+		float min_depth, max_depth;
+	};
+
+	struct rect
+	{
+		int32_t left, top;
+		int32_t right, bottom;
+	};
+
+	struct subresource_box
+	{
+		int32_t left, top, front;
+		int32_t right, bottom, back;
+	};
+
+	struct subresource_data
+	{
+		void *data;
+		uint32_t row_pitch;
+		uint32_t slice_pitch;
+	};
+
+	struct resource_desc
+	{
+		resource_desc() : type(resource_type::unknown), texture(), heap(memory_heap::unknown), usage(resource_usage::undefined), flags(resource_flags::none) {}
+		resource_desc(uint64_t size, memory_heap heap, resource_usage usage, resource_flags flags = resource_flags::none) :
+			type(resource_type::buffer), buffer({ size, 0 }), heap(heap), usage(usage), flags(flags) {}
+		resource_desc(uint32_t width, uint32_t height, uint16_t layers, uint16_t levels, api::format format, uint16_t samples, memory_heap heap, resource_usage usage, resource_flags flags = resource_flags::none) :
+			type(resource_type::texture_2d), texture({ width, height, layers, levels, format, samples }), heap(heap), usage(usage), flags(flags) {}
+		resource_desc(resource_type type, uint32_t width, uint32_t height, uint16_t depth_or_layers, uint16_t levels, api::format format, uint16_t samples, memory_heap heap, resource_usage usage, resource_flags flags = resource_flags::none) :
+			type(type), texture({ width, height, depth_or_layers, levels, format, samples }), heap(heap), usage(usage), flags(flags) {}
+
+		resource_type type;
+
+		union
+		{
+			struct
+			{
+				uint32_t width;
+				uint32_t height;
+				uint16_t depth_or_layers;
+				uint16_t levels;
+				api::format format;
+				uint16_t samples;
+			} texture;
+			struct
+			{
+				uint64_t size;
+				uint32_t stride;
+			} buffer;
+		};
+
+		memory_heap heap;
+		resource_usage usage;
+		resource_flags flags;
+	};
+
+	struct resource_view_desc
+	{
+		resource_view_desc() : type(resource_view_type::unknown), format(format::unknown), texture() {}
+		explicit resource_view_desc(api::format format) : type(resource_view_type::texture_2d), format(format), texture({ 0, 1, 0, 1 }) {}
+		resource_view_desc(resource_view_type type, api::format format, uint32_t first_level, uint32_t levels, uint32_t first_layer, uint32_t layers) :
+			type(type), format(format), texture({ first_level, levels, first_layer, layers }) {}
+
+		resource_view_type type;
+		api::format format;
+
+		union
+		{
+			struct
+			{
+				uint64_t offset;
+				uint64_t size;
+			} buffer;
+			struct
+			{
+				uint32_t first_level;
+				uint32_t level_count;
+				uint32_t first_layer;
+				uint32_t layer_count;
+			} texture;
+		};
+	};
+
+	struct render_pass_render_target_desc
+	{
+		resource_view view = { 0 };
+		render_pass_load_op load_op = render_pass_load_op::load;
+		render_pass_store_op store_op = render_pass_store_op::store;
+		float clear_color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	};
+	struct render_pass_depth_stencil_desc
+	{
+		resource_view view = { 0 };
+		render_pass_load_op depth_load_op = render_pass_load_op::load;
+		render_pass_store_op depth_store_op = render_pass_store_op::store;
+		render_pass_load_op stencil_load_op = render_pass_load_op::load;
+		render_pass_store_op stencil_store_op = render_pass_store_op::store;
+		float clear_depth = 0.0f;
+		uint8_t clear_stencil = 0;
+	};
+
+	// Private data is looked up by type instead of by the UUID attached with '__declspec(uuid)' (which only MSVC supports), see 'CITRA_UUID' in 'citra.cpp'
+	struct api_object
+	{
+		virtual ~api_object() {}
+
+		virtual uint64_t get_native() const = 0;
+
+		virtual void *get_private_data_pointer(const void *key) const = 0;
+		virtual void set_private_data_pointer(const void *key, void *data) = 0;
+
+		template <typename T>
+		T &get_private_data() const
+		{
+			return *static_cast<T *>(get_private_data_pointer(private_data_key<T>()));
+		}
+		template <typename T>
+		T &create_private_data()
+		{
+			T *const data = new T();
+			set_private_data_pointer(private_data_key<T>(), data);
+			return *data;
+		}
+		template <typename T>
+		void destroy_private_data()
+		{
+			delete static_cast<T *>(get_private_data_pointer(private_data_key<T>()));
+			set_private_data_pointer(private_data_key<T>(), nullptr);
+		}
+
+	private:
+		template <typename T>
+		static const void *private_data_key()
+		{
+			static const char key = 0;
+			return &key;
+		}
+	};
+
+	struct device : public api_object
+	{
+		virtual device_api get_api() = 0;
+
+		virtual bool create_resource(const resource_desc &desc, const subresource_data *initial_data, resource_usage initial_state, resource *out_handle) = 0;
+		virtual void destroy_resource(resource handle) = 0;
+		virtual resource_desc get_resource_desc(resource resource) const = 0;
+
+		virtual bool create_resource_view(resource resource, resource_usage usage_type, const resource_view_desc &desc, resource_view *out_handle) = 0;
+		virtual void destroy_resource_view(resource_view handle) = 0;
+		virtual resource get_resource_from_view(resource_view view) const = 0;
+		virtual resource_view_desc get_resource_view_desc(resource_view view) const = 0;
+
+		virtual bool map_texture_region(resource resource, uint32_t subresource, const subresource_box *box, map_access access, subresource_data *out_data) = 0;
+		virtual void unmap_texture_region(resource resource, uint32_t subresource) = 0;
+
+		virtual bool create_query_heap(query_type type, uint32_t size, query_heap *out_handle) = 0;
+		virtual void destroy_query_heap(query_heap handle) = 0;
+		virtual bool get_query_heap_results(query_heap heap, uint32_t first, uint32_t count, void *results, uint32_t stride) = 0;
+
+		virtual void set_resource_name(resource resource, const char *name) = 0;
+	};
+
+	struct device_object : public api_object
+	{
+		virtual device *get_device() = 0;
+	};
+
+	struct command_list : public device_object
+	{
+		virtual void barrier(uint32_t count, const resource *resources, const resource_usage *old_states, const resource_usage *new_states) = 0;
+		inline  void barrier(resource resource, resource_usage old_state, resource_usage new_state) { barrier(1, &resource, &old_state, &new_state); }
+
+		virtual void bind_render_targets_and_depth_stencil(uint32_t count, const resource_view *rtvs, resource_view dsv = { 0 }) = 0;
+
+		virtual void copy_resource(resource source, resource dest) = 0;
+		virtual void copy_texture_region(resource source, uint32_t source_subresource, const subresource_box *source_box, resource dest, uint32_t dest_subresource, const subresource_box *dest_box, filter_mode filter = filter_mode::min_mag_mip_point) = 0;
+
+		virtual void end_query(query_heap heap, query_type type, uint32_t index) = 0;
+	};
+
+	struct command_queue : public device_object
+	{
+		virtual command_queue_type get_type() const = 0;
+
+		virtual void wait_idle() const = 0;
+
+		virtual uint64_t get_timestamp_frequency() const = 0;
+
+		virtual void flush_immediate_command_list() const = 0;
+		virtual command_list *get_immediate_command_list() = 0;
+	};
+
+	struct swapchain : public device_object
+	{
+		virtual void *get_hwnd() const = 0;
+
+		virtual resource get_current_back_buffer() = 0;
+	};
+
+	struct effect_runtime : public swapchain
+	{
+		virtual command_queue *get_command_queue() = 0;
+
+		virtual void get_screenshot_width_and_height(uint32_t *out_width, uint32_t *out_height) const = 0;
+
+		virtual void update_texture_bindings(const char *semantic, resource_view srv, resource_view srv_srgb = { 0 }) = 0;
+
+		virtual void enumerate_uniform_variables(const char *effect_name, void(*callback)(effect_runtime *runtime, effect_uniform_variable variable, void *user_data), void *user_data) = 0;
+		template <typename F>
+		void enumerate_uniform_variables(const char *effect_name, F lambda)
+		{
+			enumerate_uniform_variables(effect_name, [](effect_runtime *runtime, effect_uniform_variable variable, void *user_data) { static_cast<F *>(user_data)->operator()(runtime, variable); }, &lambda);
+		}
+
+		virtual effect_uniform_variable find_uniform_variable(const char *effect_name, const char *variable_name) const = 0;
+
+		virtual bool get_annotation_string_from_uniform_variable(effect_uniform_variable variable, const char *name, char *value, size_t *size) const = 0;
+		template <size_t SIZE>
+		bool get_annotation_string_from_uniform_variable(effect_uniform_variable variable, const char *name, char(&value)[SIZE]) const
+		{
+			size_t size = SIZE;
+			return get_annotation_string_from_uniform_variable(variable, name, value, &size);
+		}
+
+		virtual void get_uniform_value_float(effect_uniform_variable variable, float *values, size_t count, size_t array_index = 0) const = 0;
+		virtual void get_uniform_value_int(effect_uniform_variable variable, int32_t *values, size_t count, size_t array_index = 0) const = 0;
+		virtual void set_uniform_value_bool(effect_uniform_variable variable, const bool *values, size_t count, size_t array_index = 0) = 0;
+		inline  void set_uniform_value_bool(effect_uniform_variable variable, bool x) { set_uniform_value_bool(variable, &x, 1); }
+		virtual void set_uniform_value_float(effect_uniform_variable variable, const float *values, size_t count, size_t array_index = 0) = 0;
+		virtual void set_uniform_value_int(effect_uniform_variable variable, const int32_t *values, size_t count, size_t array_index = 0) = 0;
+
+		virtual effect_texture_variable find_texture_variable(const char *effect_name, const char *variable_name) const = 0;
+		virtual void get_texture_binding(effect_texture_variable variable, resource_view *out_srv, resource_view *out_srv_srgb) const = 0;
+
+		virtual void set_preprocessor_definition(const char *name, const char *value) = 0;
+	};
+} }
+
+namespace reshade
+{
+	enum class addon_event : uint32_t
+	{
+		init_device,
+		destroy_device,
+		init_command_list,
+		destroy_command_list,
+		init_command_queue,
+		destroy_command_queue,
+		init_effect_runtime,
+		destroy_effect_runtime,
+		create_resource,
+		init_resource,
+		destroy_resource,
+		create_resource_view,
+		draw,
+		draw_indexed,
+		draw_or_dispatch_indirect,
+		bind_viewports,
+		begin_render_pass,
+		end_render_pass,
+		bind_render_targets_and_depth_stencil,
+		clear_depth_stencil_view,
+		barrier,
+		reset_command_list,
+		close_command_list,
+		execute_command_list,
+		execute_secondary_command_list,
+		present,
+		reshade_begin_effects,
+		reshade_finish_effects,
+		reshade_reloaded_effects,
+		max
+	};
+
+	template <addon_event ev>
+	struct addon_event_traits;
+
+	#define RESHADE_DEFINE_ADDON_EVENT_TRAITS(ev, ret, ...) \
+		template <> \
+		struct addon_event_traits<ev> { \
+			using decl = ret(*)(__VA_ARGS__); \
+			using type = ret; \
+		}
+
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::init_device, void, api::device *device);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::destroy_device, void, api::device *device);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::init_command_list, void, api::command_list *cmd_list);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::destroy_command_list, void, api::command_list *cmd_list);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::init_command_queue, void, api::command_queue *queue);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::destroy_command_queue, void, api::command_queue *queue);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::init_effect_runtime, void, api::effect_runtime *runtime);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::destroy_effect_runtime, void, api::effect_runtime *runtime);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::create_resource, bool, api::device *device, api::resource_desc &desc, api::subresource_data *initial_data, api::resource_usage initial_state);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::init_resource, void, api::device *device, const api::resource_desc &desc, const api::subresource_data *initial_data, api::resource_usage initial_state, api::resource resource);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::destroy_resource, void, api::device *device, api::resource resource);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::create_resource_view, bool, api::device *device, api::resource resource, api::resource_usage usage_type, api::resource_view_desc &desc);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::draw, bool, api::command_list *cmd_list, uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::draw_indexed, bool, api::command_list *cmd_list, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::draw_or_dispatch_indirect, bool, api::command_list *cmd_list, api::indirect_command type, api::resource buffer, uint64_t offset, uint32_t draw_count, uint32_t stride);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::bind_viewports, void, api::command_list *cmd_list, uint32_t first, uint32_t count, const api::viewport *viewports);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::begin_render_pass, void, api::command_list *cmd_list, uint32_t count, const api::render_pass_render_target_desc *rts, const api::render_pass_depth_stencil_desc *ds);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::end_render_pass, void, api::command_list *cmd_list);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::bind_render_targets_and_depth_stencil, void, api::command_list *cmd_list, uint32_t count, const api::resource_view *rtvs, api::resource_view dsv);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::clear_depth_stencil_view, bool, api::command_list *cmd_list, api::resource_view dsv, const float *depth, const uint8_t *stencil, uint32_t rect_count, const api::rect *rects);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::barrier, void, api::command_list *cmd_list, uint32_t count, const api::resource *resources, const api::resource_usage *old_states, const api::resource_usage *new_states);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::reset_command_list, void, api::command_list *cmd_list);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::close_command_list, void, api::command_list *cmd_list);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::execute_command_list, void, api::command_queue *queue, api::command_list *cmd_list);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::execute_secondary_command_list, void, api::command_list *cmd_list, api::command_list *secondary_cmd_list);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::present, void, api::command_queue *queue, api::swapchain *swapchain, const api::rect *source_rect, const api::rect *dest_rect, uint32_t dirty_rect_count, const api::rect *dirty_rects);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::reshade_begin_effects, void, api::effect_runtime *runtime, api::command_list *cmd_list, api::resource_view rtv, api::resource_view rtv_srgb);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::reshade_finish_effects, void, api::effect_runtime *runtime, api::command_list *cmd_list, api::resource_view rtv, api::resource_view rtv_srgb);
+	RESHADE_DEFINE_ADDON_EVENT_TRAITS(addon_event::reshade_reloaded_effects, void, api::effect_runtime *runtime);
+
+	namespace internal
+	{
+		void register_event(addon_event ev, void *callback);
+		void unregister_event(addon_event ev, void *callback);
+
+		bool config_get_value(const char *section, const char *key, std::string &value);
+		void config_set_value(const char *section, const char *key, const std::string &value);
+	}
+
+	template <addon_event ev>
+	inline void register_event(typename addon_event_traits<ev>::decl callback)
+	{
+		internal::register_event(ev, reinterpret_cast<void *>(callback));
+	}
+	template <addon_event ev>
+	inline void unregister_event(typename addon_event_traits<ev>::decl callback)
+	{
+		internal::unregister_event(ev, reinterpret_cast<void *>(callback));
+	}
+
+	void register_overlay(const char *title, void(*callback)(api::effect_runtime *runtime));
+	void unregister_overlay(const char *title, void(*callback)(api::effect_runtime *runtime));
+
+	bool register_addon(HMODULE module);
+	void unregister_addon(HMODULE module);
+
+	void log_message(int level, const char *message);
+
+	// Configuration is kept in memory, tests fill it in with 'config_set_value' before creating a device
+	template <typename T>
+	inline bool config_get_value(api::effect_runtime *, const char *section, const char *key, T &value)
+	{
+		std::string string;
+		if (!internal::config_get_value(section, key, string))
+			return false;
+		std::istringstream stream(string);
+		if constexpr (std::is_same_v<T, bool>)
+		{
+			int integer = 0;
+			stream >> integer;
+			value = integer != 0;
+		}
+		else
+		{
+			stream >> value;
+		}
+		return !stream.fail();
+	}
+	inline bool config_get_value(api::effect_runtime *, const char *section, const char *key, char *value, size_t *size)
+	{
+		std::string string;
+		if (!internal::config_get_value(section, key, string))
+			return false;
+		if (value != nullptr && *size != 0)
+		{
+			const size_t length = std::min(string.size(), *size - 1);
+			std::memcpy(value, string.c_str(), length);
+			value[length] = '\0';
+		}
+		*size = string.size() + 1;
+		return true;
+	}
+	template <typename T>
+	inline void config_set_value(api::effect_runtime *, const char *section, const char *key, const T &value)
+	{
+		std::ostringstream stream;
+		if constexpr (std::is_same_v<T, bool>)
+			stream << (value ? 1 : 0);
+		else
+			stream << value;
+		internal::config_set_value(section, key, stream.str());
+	}
+}
@@ -0,0 +1,108 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Frame-time-driven choice of how much depth processing the add-on does
+ * Only depends on the standard library, so it can be driven with simulated frame times (see 'test/governor.cpp')
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+// Lowers the cost of depth processing step by step while frames take longer than the target, and raises it again once there is plenty of headroom
+struct quality_governor
+{
+	// 0 = full quality
+	// 1 = copy only the area of the last viewport into backup textures (skipped where that is not possible, see 'region_copies')
+	// 2 = normalize depth at half resolution
+	// 3 = normalize depth at quarter resolution
+	static constexpr unsigned int max_level = 3;
+	// Frames whose times are ignored after the level changed or effects were reloaded, since those frames are not representative of either level
+	static constexpr unsigned int settle_frames = 30;
+
+	// Read without a lock when copying depth-stencils, only written by 'update' and 'reset'
+	std::atomic<unsigned int> level = 0;
+	// Whether the device can copy only part of a depth-stencil (D3D9-12 always copy all of it, so level 1 would save nothing there)
+	bool region_copies = true;
+	// Exponential moving average of the frame time, in milliseconds
+	float average_frame_time = 0.0f;
+	// Consecutive frames the average was above or well below the target
+	unsigned int frames_over_target = 0;
+	unsigned int frames_under_target = 0;
+	// Frames left to ignore (see 'settle_frames')
+	unsigned int frames_to_ignore = 0;
+	std::chrono::steady_clock::time_point last_present;
+
+	// Feeds the time the last frame took and returns whether the level changed
+	// Stepping down reacts within a second, while stepping up waits several seconds, so that the level does not oscillate around the target
+	bool update(float frame_time, float target_frame_time)
+	{
+		if (frames_to_ignore != 0)
+		{
+			frames_to_ignore--;
+			return false;
+		}
+
+		average_frame_time = average_frame_time == 0.0f ? frame_time : average_frame_time + (frame_time - average_frame_time) * 0.05f;
+
+		if (average_frame_time > target_frame_time * 1.05f)
+		{
+			frames_under_target = 0;
+			if (++frames_over_target >= 60 && level < max_level)
+			{
+				change_level(level == 0 && !region_copies ? 2 : level + 1);
+				return true;
+			}
+		}
+		else if (average_frame_time < target_frame_time * 0.8f)
+		{
+			frames_over_target = 0;
+			if (++frames_under_target >= 300 && level > 0)
+			{
+				change_level(level == 2 && !region_copies ? 0 : level - 1);
+				return true;
+			}
+		}
+		else
+		{
+			frames_over_target = 0;
+			frames_under_target = 0;
+		}
+		return false;
+	}
+
+	// Ignores the next frames, e.g. because effects were just reloaded
+	void settle()
+	{
+		frames_to_ignore = settle_frames;
+	}
+
+	// Goes back to full quality, e.g. because the governor was turned off
+	void reset()
+	{
+		level = 0;
+		average_frame_time = 0.0f;
+		frames_over_target = 0;
+		frames_under_target = 0;
+		frames_to_ignore = 0;
+	}
+
+	// Divisor of the resolution 'Citra.fx' normalizes depth at
+	unsigned int depth_resolution_divisor() const
+	{
+		const unsigned int current_level = level;
+		return current_level >= 3 ? 4 : current_level >= 2 ? 2 : 1;
+	}
+
+private:
+	void change_level(unsigned int new_level)
+	{
+		level = new_level;
+		frames_over_target = 0;
+		frames_under_target = 0;
+		// Frame times of the old level are still in the average, so start over from the frames after the change
+		average_frame_time = 0.0f;
+		settle();
+	}
+};
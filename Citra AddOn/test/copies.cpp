@@ -0,0 +1,210 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Tests of when depth-stencils are copied into their backup textures
+ */
+
+#include "test.hpp"
+#include "../citra_capture.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+using namespace reshade::api;
+
+namespace
+{
+	// Renders a frame of two passes with the same workload, followed by a pass with little workload, each ending with a clear
+	// Returns the content of the depth-stencil at the end of the second pass, which is the one effects should see
+	uint64_t render_frame(mock::context &context, resource scene, resource_view scene_dsv, uint32_t second_pass_draws = 50)
+	{
+		mock::command_list &cmd_list = context.immediate();
+
+		scene::render(cmd_list, scene_dsv, 1200, 720, 50);
+		cmd_list.clear_depth(scene_dsv);
+		scene::render(cmd_list, scene_dsv, 1200, 720, second_pass_draws);
+		const uint64_t second_pass_content = context.device->content(scene);
+		cmd_list.clear_depth(scene_dsv);
+		scene::render(cmd_list, scene_dsv, 1200, 720, 10, 6);
+		cmd_list.clear_depth(scene_dsv);
+
+		context.runtime->present();
+		return second_pass_content;
+	}
+}
+
+TEST(copies_once_per_frame_when_predicted)
+{
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+
+	mock::context context(device_api::d3d11);
+	mock::command_list &cmd_list = context.immediate();
+
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	for (int frame = 0; frame < 10; ++frame)
+	{
+		cmd_list.clear_commands();
+		const uint64_t expected_content = render_frame(context, scene, scene_dsv);
+
+		// The first frame only selects the depth-stencil, so its backup is made at the end of it
+		if (frame >= 1)
+			CHECK(context.device->content(scene::bound_depth(context)) == expected_content);
+
+		// Both equal passes are copied while the prediction is learned
+		if (frame >= 7)
+			CHECK(cmd_list.count(mock::command_list::command_type::copy_resource) == 1);
+	}
+}
+
+TEST(copies_at_next_suitable_clear_on_prediction_miss)
+{
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+
+	mock::context context(device_api::d3d11);
+	mock::command_list &cmd_list = context.immediate();
+
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	for (int frame = 0; frame < 10; ++frame)
+		render_frame(context, scene, scene_dsv);
+
+	// The predicted pass has far more workload than expected, so the default heuristic takes over there and copies it
+	cmd_list.clear_commands();
+	const uint64_t expected_content = render_frame(context, scene, scene_dsv, 200);
+	CHECK(context.device->content(scene::bound_depth(context)) == expected_content);
+	CHECK(cmd_list.count(mock::command_list::command_type::copy_resource) == 1);
+}
+
+TEST(loses_one_frame_when_predicted_clear_was_skipped)
+{
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+
+	mock::context context(device_api::d3d11);
+	mock::command_list &cmd_list = context.immediate();
+
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	for (int frame = 0; frame < 10; ++frame)
+		render_frame(context, scene, scene_dsv);
+
+	// The predicted pass has far less workload than the one before it, which was already skipped
+	// No clear operation after it is suitable, so the backup is only made at the end of the frame, with what the depth-stencil holds then
+	scene::render(cmd_list, scene_dsv, 1200, 720, 50);
+	const uint64_t first_pass_content = context.device->content(scene);
+	cmd_list.clear_depth(scene_dsv);
+	scene::render(cmd_list, scene_dsv, 1200, 720, 5);
+	cmd_list.clear_depth(scene_dsv);
+	context.runtime->present();
+	CHECK(context.device->content(scene::bound_depth(context)) != first_pass_content);
+
+	// The prediction is learned again from scratch, so the next frame copies at every suitable clear operation and gets the right depth again
+	scene::render(cmd_list, scene_dsv, 1200, 720, 50);
+	const uint64_t expected_content = context.device->content(scene);
+	cmd_list.clear_depth(scene_dsv);
+	scene::render(cmd_list, scene_dsv, 1200, 720, 5);
+	cmd_list.clear_depth(scene_dsv);
+	context.runtime->present();
+	CHECK(context.device->content(scene::bound_depth(context)) == expected_content);
+}
+
+TEST(skips_copies_on_duplicate_frames)
+{
+	mock::context context(device_api::d3d12);
+	mock::command_list &cmd_list = context.immediate();
+
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	for (int frame = 0; frame < 6; ++frame)
+	{
+		cmd_list.clear_commands();
+		scene::render(cmd_list, scene_dsv, 1200, 720, 50);
+		context.runtime->present();
+		CHECK(cmd_list.count(mock::command_list::command_type::copy_resource) == 1);
+		CHECK(cmd_list.count(mock::command_list::command_type::end_query) == 2);
+	}
+
+	const resource backup = scene::bound_depth(context);
+	CHECK(backup != 0 && backup != scene);
+
+	// Presents without rendering anything keep the backup of the last frame bound, without copying into it again
+	for (int frame = 0; frame < 10; ++frame)
+	{
+		cmd_list.clear_commands();
+		context.runtime->present();
+		CHECK(cmd_list.count(mock::command_list::command_type::copy_resource) == 0);
+		CHECK(scene::bound_depth(context) == backup);
+	}
+
+	// The fake GPU copies 10 bytes per nanosecond, so copying 1200x720 with 4 bytes per pixel takes 0.346 ms
+	const std::vector<std::string> lines = mock::draw_overlay(context.runtime.get());
+	CHECK(mock::overlay_contains(lines, "10 skipped"));
+	CHECK(mock::overlay_contains(lines, "depth copy takes 0.346 ms"));
+	CHECK(mock::overlay_contains(lines, "3.5 ms of GPU time saved"));
+}
+
+TEST(waits_for_gpu_before_reading_back_last_captured_frames)
+{
+	mock::context context(device_api::vulkan);
+	mock::command_list &cmd_list = context.immediate();
+
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	mock::draw_overlay(context.runtime.get(), "Start capturing color and depth");
+	std::string path;
+	for (const std::string &line : mock::draw_overlay(context.runtime.get()))
+		if (line.rfind("Capturing to ", 0) == 0)
+			path = line.substr(13, line.find(':') - 13);
+	CHECK(!path.empty());
+
+	for (int frame = 0; frame < 5; ++frame)
+	{
+		cmd_list.clear_commands();
+		scene::render(cmd_list, scene_dsv, 1200, 720, 50);
+		context.runtime->present();
+	}
+
+	// The last frames are still in their staging textures, which mapping alone does not wait for
+	const size_t wait_idle_calls = context.queue->wait_idle_calls;
+	mock::draw_overlay(context.runtime.get(), "Stop capture");
+	CHECK(context.queue->wait_idle_calls == wait_idle_calls + 1);
+
+	citra_capture::reader reader;
+	CHECK(reader.open(path.c_str()));
+	citra_capture::frame frame;
+	int frames_read = 0;
+	while (reader.read(frame))
+		frames_read++;
+	reader.close();
+	std::remove(path.c_str());
+	CHECK(frames_read == 5);
+}
+
+TEST(capture_writer_stops_at_first_failed_write)
+{
+	// Every write to this file fails once it goes past the buffer of the C library, like on a full disk
+	citra_capture::writer writer;
+	if (!writer.open("/dev/full"))
+		return;
+
+	// Noise does not compress, so the frame is larger than that buffer and has to go to the file right away
+	citra_capture::frame frame;
+	frame.info.color_width = 400;
+	frame.info.color_height = 240;
+	uint32_t noise = 1;
+	for (int i = 0; i < 400 * 240 * 4; ++i)
+		frame.color.push_back(static_cast<uint8_t>((noise = noise * 1664525u + 1013904223u) >> 24));
+	CHECK(writer.submit(citra_capture::frame(frame)));
+
+	// Nothing is accepted anymore once the writer thread failed to write the frame
+	const auto start = std::chrono::steady_clock::now();
+	while (!writer.failed() && std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+		std::this_thread::yield();
+	CHECK(writer.failed());
+	CHECK(!writer.submit(citra_capture::frame(frame)));
+
+	writer.close();
+	CHECK(writer.frames_written() == 0);
+	CHECK(writer.frames_dropped() == 1);
+}
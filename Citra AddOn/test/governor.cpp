@@ -0,0 +1,124 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Tests of the quality governor, with simulated frame times and through the add-on
+ */
+
+#include "test.hpp"
+#include "../quality_governor.hpp"
+
+using namespace reshade::api;
+
+namespace
+{
+	const float s_target_frame_time = 1000.0f / 60.0f;
+
+	// Feeds the same frame time until the level changes, and returns the number of frames that took (zero if it did not change within 'max_frames')
+	unsigned int frames_until_level_change(quality_governor &governor, float frame_time, unsigned int max_frames = 1000)
+	{
+		for (unsigned int frame = 1; frame <= max_frames; ++frame)
+			if (governor.update(frame_time, s_target_frame_time))
+				return frame;
+		return 0;
+	}
+}
+
+TEST(governor_steps_down_and_back_up)
+{
+	quality_governor governor;
+
+	// Slow frames step down a level after a second, and again after the frames following the change settled
+	CHECK(frames_until_level_change(governor, 20.0f) == 60);
+	CHECK(governor.level == 1);
+	CHECK(frames_until_level_change(governor, 20.0f) == quality_governor::settle_frames + 60);
+	CHECK(governor.level == 2);
+	CHECK(governor.depth_resolution_divisor() == 2);
+	CHECK(frames_until_level_change(governor, 20.0f) == quality_governor::settle_frames + 60);
+	CHECK(governor.level == 3);
+	CHECK(governor.depth_resolution_divisor() == 4);
+	CHECK(frames_until_level_change(governor, 20.0f) == 0);
+
+	// Frames close to the target keep the level
+	CHECK(frames_until_level_change(governor, s_target_frame_time * 0.9f) == 0);
+	CHECK(governor.level == 3);
+
+	// Fast frames step up again, but only after five seconds (plus the frames it takes the average to fall)
+	CHECK(frames_until_level_change(governor, 10.0f) >= 300);
+	CHECK(governor.level == 2);
+
+	governor.reset();
+	CHECK(governor.level == 0);
+	CHECK(governor.depth_resolution_divisor() == 1);
+}
+
+TEST(governor_skips_region_copies_where_unsupported)
+{
+	quality_governor governor;
+	governor.region_copies = false;
+
+	// Copying only a region saves nothing without partial copies, so the first step already lowers the resolution
+	CHECK(frames_until_level_change(governor, 20.0f) == 60);
+	CHECK(governor.level == 2);
+	CHECK(frames_until_level_change(governor, 10.0f) == quality_governor::settle_frames + 300);
+	CHECK(governor.level == 0);
+}
+
+TEST(governor_ignores_frames_after_reload)
+{
+	quality_governor governor;
+	governor.update(s_target_frame_time, s_target_frame_time);
+
+	// A reload is one very slow frame, which must not count towards stepping down
+	governor.settle();
+	for (unsigned int frame = 0; frame < quality_governor::settle_frames; ++frame)
+		CHECK(!governor.update(500.0f, s_target_frame_time));
+	CHECK(governor.average_frame_time == s_target_frame_time);
+
+	CHECK(frames_until_level_change(governor, s_target_frame_time) == 0);
+	CHECK(governor.level == 0);
+}
+
+TEST(lowers_depth_resolution_without_recompiling)
+{
+	// Every frame takes longer than this
+	mock::set_config("DEPTH", "GovernorTargetFrameRate", "1000000");
+
+	mock::context context(device_api::d3d11);
+	mock::command_list &cmd_list = context.immediate();
+
+	const auto [depth_stencil, dsv] = context.device->create_depth_stencil(1200, 720);
+
+	resource_view full_srv = { 0 }, half_srv = { 0 }, quarter_srv = { 0 }, unused_srv = { 0 };
+	context.runtime->get_texture_binding(context.runtime->find_texture_variable("Citra.fx", "ModifiedDepthTex"), &full_srv, &unused_srv);
+	context.runtime->get_texture_binding(context.runtime->find_texture_variable("Citra.fx", "ModifiedDepthHalfTex"), &half_srv, &unused_srv);
+	context.runtime->get_texture_binding(context.runtime->find_texture_variable("Citra.fx", "ModifiedDepthQuarterTex"), &quarter_srv, &unused_srv);
+
+	const auto render_frames = [&](unsigned int count) {
+		for (unsigned int frame = 0; frame < count; ++frame)
+		{
+			cmd_list.clear_commands();
+			scene::render(cmd_list, dsv, 1200, 720, 10);
+			context.runtime->present();
+		}
+	};
+
+	render_frames(2);
+	CHECK(context.runtime->uniform_value("Citra.fx", "iCitraDepthResolutionDivisor") == 1.0f);
+	CHECK(context.runtime->binding("DEPTH") == full_srv);
+
+	// D3D11 cannot copy only a region, so the first step lowers the resolution (after the frames following the initial reload of effects were ignored)
+	render_frames(quality_governor::settle_frames + 60);
+	CHECK(context.runtime->uniform_value("Citra.fx", "iCitraDepthResolutionDivisor") == 2.0f);
+	CHECK(context.runtime->binding("DEPTH") == half_srv);
+
+	render_frames(quality_governor::settle_frames + 60);
+	CHECK(context.runtime->uniform_value("Citra.fx", "iCitraDepthResolutionDivisor") == 4.0f);
+	CHECK(context.runtime->binding("DEPTH") == quarter_srv);
+
+	// Reloading keeps the resolution
+	context.runtime->reload_effects();
+	CHECK(context.runtime->uniform_value("Citra.fx", "iCitraDepthResolutionDivisor") == 4.0f);
+	CHECK(context.runtime->binding("DEPTH") == quarter_srv);
+
+	CHECK(context.runtime->definition_changes == 0);
+}
@@ -0,0 +1,40 @@
+/*
+ * 2022 Jake Downs
+ */
+
+#include "test.hpp"
+#include <cstring>
+
+const test_case *test_case::first = nullptr;
+
+test_case::test_case(const char *name, void(*function)()) :
+	name(name), function(function), next(first)
+{
+	first = this;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		std::fprintf(stderr, "usage: %s <test>\n\ntests:\n", argv[0]);
+		for (const test_case *test = test_case::first; test != nullptr; test = test->next)
+			std::fprintf(stderr, "  %s\n", test->name);
+		return 2;
+	}
+
+	for (const test_case *test = test_case::first; test != nullptr; test = test->next)
+	{
+		if (std::strcmp(test->name, argv[1]) != 0)
+			continue;
+
+		mock::reset_config();
+		register_addon_depth();
+		test->function();
+		unregister_addon_depth();
+		return 0;
+	}
+
+	std::fprintf(stderr, "unknown test '%s'\n", argv[1]);
+	return 2;
+}
@@ -0,0 +1,83 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Tests of the depth profiles remembered per game
+ */
+
+#include "test.hpp"
+#include <string>
+
+using namespace reshade::api;
+
+TEST(prewarms_one_backup_per_profile)
+{
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+	mock::set_config("DEPTH", "GameTitle", "Pokemon Y");
+	mock::set_config("DEPTH_PROFILE_Pokemon_Y", "Width", "1200");
+	mock::set_config("DEPTH_PROFILE_Pokemon_Y", "Height", "720");
+	mock::set_config("DEPTH_PROFILE_Pokemon_Y", "Format", std::to_string(static_cast<uint32_t>(format::r24_g8_typeless)));
+
+	mock::context context(device_api::d3d11);
+	mock::command_list &cmd_list = context.immediate();
+
+	// The profile is loaded when effects are rendered the first time (D3D11 depth-stencils are made typeless at creation, which is the format that is saved)
+	context.runtime->present();
+
+	// Both eyes and the bottom screen match the profile
+	const size_t resources_before = context.device->resources_created;
+	const auto [left_eye, left_eye_dsv] = context.device->create_depth_stencil(1200, 720);
+	const auto [right_eye, right_eye_dsv] = context.device->create_depth_stencil(1200, 720);
+	const auto [bottom_screen, bottom_screen_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	for (int frame = 0; frame < 3; ++frame)
+	{
+		cmd_list.clear_commands();
+		for (const auto &[dsv, draws] : { std::make_pair(left_eye_dsv, 60u), std::make_pair(right_eye_dsv, 50u), std::make_pair(bottom_screen_dsv, 40u) })
+		{
+			scene::render(cmd_list, dsv, 1200, 720, draws);
+			cmd_list.clear_depth(dsv);
+		}
+		context.runtime->present();
+
+		// Only a single backup was prepared, which the depth-stencil that was selected then took over
+		CHECK(context.device->resources_created == resources_before + 3 + 1);
+		CHECK(scene::bound_depth(context) != 0 && scene::bound_depth(context) != left_eye);
+
+		// Only the backup of the selected depth-stencil is copied to
+		if (frame != 0)
+			CHECK(cmd_list.count(mock::command_list::command_type::copy_resource) == 1);
+	}
+}
+
+TEST(skips_copies_into_unselected_prewarmed_backup)
+{
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+	// Switch away from the depth-stencil the profile remembers as soon as another one has more workload
+	mock::set_config("DEPTH", "DepthSelectionHysteresisFrames", "0");
+	mock::set_config("DEPTH", "GameTitle", "Pokemon Y");
+	mock::set_config("DEPTH_PROFILE_Pokemon_Y", "Width", "960");
+	mock::set_config("DEPTH_PROFILE_Pokemon_Y", "Height", "720");
+	mock::set_config("DEPTH_PROFILE_Pokemon_Y", "Format", std::to_string(static_cast<uint32_t>(format::r24_g8_typeless)));
+
+	mock::context context(device_api::d3d11);
+	mock::command_list &cmd_list = context.immediate();
+
+	context.runtime->present();
+
+	// Only the bottom screen matches the profile, but this time the top screen has more workload
+	const auto [top_screen, top_screen_dsv] = context.device->create_depth_stencil(1200, 720);
+	const auto [bottom_screen, bottom_screen_dsv] = context.device->create_depth_stencil(960, 720);
+
+	for (int frame = 0; frame < 3; ++frame)
+	{
+		cmd_list.clear_commands();
+		scene::render(cmd_list, bottom_screen_dsv, 960, 720, 40);
+		cmd_list.clear_depth(bottom_screen_dsv);
+		scene::render(cmd_list, top_screen_dsv, 1200, 720, 60);
+		cmd_list.clear_depth(top_screen_dsv);
+		context.runtime->present();
+
+		for (const mock::command_list::command &command : cmd_list.commands())
+			CHECK(command.type != mock::command_list::command_type::copy_resource || command.source == top_screen);
+	}
+}
@@ -0,0 +1,134 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Replays of Vulkan-style command buffers, where depth-stencils are cleared inside render passes and copies have to wait until a render pass ended
+ */
+
+#include "test.hpp"
+#include <string>
+
+using namespace reshade::api;
+
+namespace
+{
+	// Renders a render pass that clears its depth-stencil in the middle (like 'vkCmdClearAttachments' does), with the main scene before the clear and little workload after it
+	// Returns the content of the depth-stencil at the end of the render pass, which is what can be copied the earliest
+	uint64_t render_pass_with_clear(mock::context &context, mock::command_list &cmd_list, resource scene, resource_view scene_dsv)
+	{
+		cmd_list.begin_render_pass(scene_dsv, render_pass_load_op::clear);
+		cmd_list.bind_viewport({ 0.0f, 0.0f, 1200.0f, 720.0f, 0.0f, 1.0f });
+		for (int i = 0; i < 50; ++i)
+			cmd_list.draw(300);
+		cmd_list.clear_depth(scene_dsv);
+		for (int i = 0; i < 5; ++i)
+			cmd_list.draw(300);
+		cmd_list.end_render_pass();
+		return context.device->content(scene);
+	}
+
+	size_t count_overlay_lines(mock::context &context, const char *text)
+	{
+		size_t count = 0;
+		for (const std::string &line : mock::draw_overlay(context.runtime.get()))
+			if (line.find(text) != std::string::npos)
+				count++;
+		return count;
+	}
+}
+
+TEST(copies_after_render_pass_when_cleared_inside)
+{
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+
+	mock::context context(device_api::vulkan);
+	const auto cmd_list = context.create_command_list();
+
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	for (int frame = 0; frame < 5; ++frame)
+	{
+		cmd_list->reset();
+		cmd_list->clear_commands();
+		const uint64_t expected_content = render_pass_with_clear(context, *cmd_list, scene, scene_dsv);
+		cmd_list->close();
+		context.queue->execute(*cmd_list);
+		context.runtime->present();
+
+		// The first frame only selects the depth-stencil, so its backup is made at the end of it
+		if (frame == 0)
+			continue;
+
+		// The clear was chosen by the workload before it, and copied exactly once, after the render pass ended
+		CHECK(cmd_list->count(mock::command_list::command_type::copy_resource) == 1);
+		for (const mock::command_list::command &command : cmd_list->commands())
+			CHECK(!command.inside_render_pass);
+		CHECK(context.device->content(scene::bound_depth(context)) == expected_content);
+
+		// Nothing was rendered before the render pass loaded the depth-stencil, so only the clear inside it is listed below the depth-stencil, and only once
+		CHECK(count_overlay_lines(context, "draw calls") == 1 + 1);
+		CHECK(count_overlay_lines(context, "Copied after render pass") == 1);
+	}
+}
+
+TEST(copies_deferred_from_previous_render_pass_before_next_one)
+{
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+
+	mock::context context(device_api::vulkan);
+	const auto cmd_list = context.create_command_list();
+
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	for (int frame = 0; frame < 5; ++frame)
+	{
+		cmd_list->reset();
+		cmd_list->clear_commands();
+		const uint64_t first_pass_content = render_pass_with_clear(context, *cmd_list, scene, scene_dsv);
+		// Nothing between the render passes, so the deferred copy is made when the next one begins, before it clears the depth-stencil
+		cmd_list->begin_render_pass(scene_dsv, render_pass_load_op::clear);
+		for (int i = 0; i < 60; ++i)
+			cmd_list->draw(300);
+		cmd_list->end_render_pass();
+		cmd_list->close();
+		context.queue->execute(*cmd_list);
+		context.runtime->present();
+
+		if (frame == 0)
+			continue;
+
+		CHECK(cmd_list->count(mock::command_list::command_type::copy_resource) == 1);
+		for (const mock::command_list::command &command : cmd_list->commands())
+			CHECK(!command.inside_render_pass);
+		CHECK(context.device->content(scene::bound_depth(context)) == first_pass_content);
+	}
+}
+
+TEST(counts_deferred_copies_lost_at_submission)
+{
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+
+	mock::context context(device_api::vulkan);
+	const auto cmd_list = context.create_command_list();
+
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	for (int frame = 0; frame < 3; ++frame)
+	{
+		cmd_list->reset();
+		cmd_list->clear_commands();
+		// The render pass never ends in this command list, so the copy cannot be made in it
+		cmd_list->begin_render_pass(scene_dsv, render_pass_load_op::clear);
+		cmd_list->bind_viewport({ 0.0f, 0.0f, 1200.0f, 720.0f, 0.0f, 1.0f });
+		for (int i = 0; i < 50; ++i)
+			cmd_list->draw(300);
+		cmd_list->clear_depth(scene_dsv);
+		cmd_list->draw(300);
+		cmd_list->close();
+		context.queue->execute(*cmd_list);
+		context.runtime->present();
+
+		CHECK(cmd_list->count(mock::command_list::command_type::copy_resource) == 0);
+	}
+
+	CHECK(count_overlay_lines(context, "copies requested inside a render pass were lost") == 1);
+}
@@ -0,0 +1,152 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Replays of recorded workloads, checking how often the selected depth-stencil changes and that bundles are tracked like the same commands recorded inline
+ */
+
+#include "test.hpp"
+#include <string>
+
+using namespace reshade::api;
+
+namespace
+{
+	// Workload of a frame per depth-stencil, as draw calls of 300 vertices each
+	// These are the top and bottom screen of a game where both have about the same workload and take turns having more (like the map screen of Pokemon X/Y)
+	const uint32_t similar_screens[][2] = {
+		{ 60, 50 }, { 48, 62 }, { 61, 47 }, { 45, 66 }, { 58, 51 }, { 50, 60 }, { 63, 46 }, { 47, 64 },
+		{ 59, 52 }, { 49, 61 }, { 62, 48 }, { 46, 65 }, { 60, 49 }, { 51, 59 }, { 64, 45 }, { 48, 63 },
+	};
+
+	size_t reselections_shown(mock::context &context)
+	{
+		for (const std::string &line : mock::draw_overlay(context.runtime.get()))
+			if (const size_t offset = line.find("re-selections in the last minute: "); offset != std::string::npos)
+				return std::stoul(line.substr(offset + 34));
+		return SIZE_MAX;
+	}
+
+	size_t replay_similar_screens(mock::context &context, int repetitions)
+	{
+		const auto [top_screen, top_screen_dsv] = context.device->create_depth_stencil(1200, 720);
+		const auto [bottom_screen, bottom_screen_dsv] = context.device->create_depth_stencil(1200, 720);
+
+		for (int repetition = 0; repetition < repetitions; ++repetition)
+		{
+			for (const auto &frame : similar_screens)
+			{
+				scene::render(context.immediate(), top_screen_dsv, 1200, 720, frame[0]);
+				scene::render(context.immediate(), bottom_screen_dsv, 1200, 720, frame[1]);
+				context.runtime->present();
+			}
+		}
+
+		return reselections_shown(context);
+	}
+}
+
+TEST(replay_similar_screens_without_hysteresis)
+{
+	mock::set_config("DEPTH", "DepthSelectionHysteresisFrames", "0");
+
+	mock::context context(device_api::d3d11);
+
+	// Every frame picks the one with more workload, so the selection flips almost every frame
+	CHECK(replay_similar_screens(context, 4) > 50);
+}
+
+TEST(replay_similar_screens_with_hysteresis)
+{
+	mock::context context(device_api::d3d11);
+
+	const size_t wait_idle_calls = context.queue->wait_idle_calls;
+
+	CHECK(replay_similar_screens(context, 4) == 0);
+	// Nothing was torn down either
+	CHECK(context.queue->wait_idle_calls == wait_idle_calls);
+}
+
+TEST(replay_recreated_depth_stencil)
+{
+	mock::context context(device_api::d3d11);
+
+	auto [top_screen, top_screen_dsv] = context.device->create_depth_stencil(1200, 720);
+	const auto [bottom_screen, bottom_screen_dsv] = context.device->create_depth_stencil(960, 720);
+
+	for (int frame = 0; frame < 10; ++frame)
+	{
+		scene::render(context.immediate(), top_screen_dsv, 1200, 720, 60);
+		scene::render(context.immediate(), bottom_screen_dsv, 960, 720, 40);
+		context.runtime->present();
+	}
+	CHECK(scene::bound_depth(context) == top_screen);
+
+	// Citra recreates surfaces of its rasterizer cache, after which the new one is still preferred over the other screen, even though that briefly has more workload (e.g. during a transition)
+	context.device->destroy_application_resource(top_screen);
+	std::tie(top_screen, top_screen_dsv) = context.device->create_depth_stencil(1200, 720);
+
+	for (int frame = 0; frame < 10; ++frame)
+	{
+		scene::render(context.immediate(), top_screen_dsv, 1200, 720, frame < 5 ? 20 : 60);
+		scene::render(context.immediate(), bottom_screen_dsv, 960, 720, 40);
+		context.runtime->present();
+		CHECK(scene::bound_depth(context) == top_screen);
+	}
+}
+
+TEST(replay_bundle_like_inline_commands)
+{
+	mock::set_config("DEPTH", "DepthSelectionHysteresisFrames", "0");
+
+	mock::context context(device_api::d3d12);
+	mock::command_list &cmd_list = context.immediate();
+	const auto bundle = context.create_command_list();
+
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+	const auto [shadow, shadow_dsv] = context.device->create_depth_stencil(1024, 1024);
+
+	const int executions = 4;
+	const auto record_shadow_pass = [&shadow_dsv = shadow_dsv](mock::command_list &target, uint32_t draws) {
+		scene::render(target, shadow_dsv, 1024, 1024, draws, 120);
+		target.draw_indexed(900);
+		target.draw_indirect(2);
+	};
+
+	// Lines of the depth-stencil list after a frame with the shadow pass executed from the bundle, or recorded inline as often
+	const auto frame_lines = [&](bool from_bundle, uint32_t shadow_draws) {
+		scene::render(cmd_list, scene_dsv, 1200, 720, 60);
+		for (int execution = 0; execution < executions; ++execution)
+		{
+			if (from_bundle)
+				cmd_list.execute_secondary(*bundle);
+			else
+				record_shadow_pass(cmd_list, shadow_draws);
+		}
+		context.runtime->present();
+
+		std::vector<std::string> lines;
+		for (const std::string &line : mock::draw_overlay(context.runtime.get()))
+			if (line.find("draw calls") != std::string::npos)
+				lines.push_back(line);
+		return std::make_pair(lines, scene::bound_depth(context));
+	};
+
+	for (const uint32_t shadow_draws : { 20u, 5u })
+	{
+		// Re-recording the bundle has to drop what was summarized of the previous recording
+		bundle->reset();
+		record_shadow_pass(*bundle, shadow_draws);
+		bundle->close();
+
+		const auto inline_frame = frame_lines(false, shadow_draws);
+		CHECK(inline_frame.first.size() == 2);
+
+		// The summary is built the first time the bundle is executed and reused after that, also in later frames
+		for (int frame = 0; frame < 3; ++frame)
+		{
+			const auto bundle_frame = frame_lines(true, shadow_draws);
+			CHECK(bundle_frame.first == inline_frame.first);
+			CHECK(bundle_frame.second == inline_frame.second);
+		}
+	}
+}
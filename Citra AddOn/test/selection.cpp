@@ -0,0 +1,182 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Tests of which depth-stencil effects get to see
+ */
+
+#include "test.hpp"
+
+using namespace reshade::api;
+
+TEST(selects_depth_stencil_with_most_draws)
+{
+	mock::context context(device_api::d3d11);
+
+	const auto [shadow_map, shadow_map_dsv] = context.device->create_depth_stencil(1024, 1024);
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	scene::render(context.immediate(), shadow_map_dsv, 1024, 1024, 20, 100);
+	scene::render(context.immediate(), scene_dsv, 1200, 720, 50);
+	context.runtime->present();
+
+	// Depth-stencils in D3D11 are made shader readable at creation, so no backup is needed
+	CHECK(scene::bound_depth(context) == scene);
+	CHECK(context.runtime->uniform_value("Citra.fx", "bHasDepth") == 1.0f);
+}
+
+TEST(selects_citra_surface_shape)
+{
+	mock::set_config("DEPTH", "CitraSurfacesOnly", "1");
+
+	mock::context context(device_api::d3d11);
+
+	// Surfaces that cannot be a 3DS screen are not tracked even though they have more workload
+	const auto [other, other_dsv] = context.device->create_depth_stencil(1024, 1024);
+	const auto [top_screen, top_screen_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	const size_t queries_before = context.device->get_resource_desc_calls;
+
+	scene::render(context.immediate(), other_dsv, 1024, 1024, 200);
+	scene::render(context.immediate(), top_screen_dsv, 1200, 720, 50);
+	context.runtime->present();
+
+	CHECK(scene::bound_depth(context) == top_screen);
+	// Descriptions of admitted surfaces were captured at creation
+	CHECK(context.device->get_resource_desc_calls == queries_before);
+}
+
+TEST(considers_surfaces_rejected_before_filter_was_turned_off)
+{
+	mock::set_config("DEPTH", "CitraSurfacesOnly", "1");
+
+	mock::context context(device_api::d3d11);
+
+	const auto [other, other_dsv] = context.device->create_depth_stencil(1024, 1024);
+	const auto [top_screen, top_screen_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	mock::draw_overlay(context.runtime.get(), "Only consider depth buffers");
+	CHECK(mock::get_config("DEPTH", "CitraSurfacesOnly") == "0");
+
+	const size_t queries_before = context.device->get_resource_desc_calls;
+
+	// The rejected depth-stencil is a candidate again once the filter is off (and selected, since it has more draw calls), its description is queried from the device the first time it is
+	for (int frame = 0; frame < 2; ++frame)
+	{
+		scene::render(context.immediate(), other_dsv, 1024, 1024, 200);
+		scene::render(context.immediate(), top_screen_dsv, 1200, 720, 50);
+		context.runtime->present();
+	}
+
+	// It kept its format since it was rejected at creation, so is not shader readable and effects get a backup of it
+	const resource bound = scene::bound_depth(context);
+	CHECK(bound != 0 && bound != top_screen && bound != other);
+	CHECK(context.device->get_resource_desc_calls == queries_before + 1);
+}
+
+TEST(selects_depth_stencil_created_before_addon)
+{
+	mock::context context(device_api::d3d11);
+
+	// Created without going through the events, like depth-stencils that already existed when the add-on was loaded
+	resource scene = { 0 };
+	context.device->create_resource(resource_desc(1200, 720, 1, 1, format::r24_g8_typeless, 1, memory_heap::gpu_only, resource_usage::depth_stencil | resource_usage::shader_resource), nullptr, resource_usage::depth_stencil_write, &scene);
+	const resource_view scene_dsv = context.device->create_application_view(scene, resource_usage::depth_stencil, resource_view_desc(format::d24_unorm_s8_uint));
+
+	scene::render(context.immediate(), scene_dsv, 1200, 720, 50);
+	context.runtime->present();
+	CHECK(scene::bound_depth(context) == scene);
+
+	// Selecting it added it to the description cache, so destroying it is noticed like for any other depth-stencil
+	context.device->destroy_application_resource(scene);
+	context.runtime->present();
+	CHECK(scene::bound_depth(context) == 0);
+}
+
+TEST(binds_backup_when_copying_before_clears)
+{
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+
+	mock::context context(device_api::d3d11);
+
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	uint64_t main_pass_content = 0;
+	for (int frame = 0; frame < 2; ++frame)
+	{
+		// Main pass, followed by a pass with little workload that overwrites it before the frame is presented
+		scene::render(context.immediate(), scene_dsv, 1200, 720, 50);
+		main_pass_content = context.device->content(scene);
+		context.immediate().clear_depth(scene_dsv);
+		scene::render(context.immediate(), scene_dsv, 1200, 720, 10, 6);
+		context.runtime->present();
+	}
+
+	const resource backup = scene::bound_depth(context);
+	CHECK(backup != 0 && backup != scene);
+	CHECK(context.device->content(backup) == main_pass_content);
+}
+
+TEST(keeps_selection_within_hysteresis)
+{
+	mock::set_config("DEPTH", "DepthSelectionHysteresisFrames", "5");
+
+	mock::context context(device_api::d3d11);
+
+	const auto [first, first_dsv] = context.device->create_depth_stencil(1200, 720);
+	const auto [second, second_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	scene::render(context.immediate(), first_dsv, 1200, 720, 50);
+	scene::render(context.immediate(), second_dsv, 1200, 720, 20);
+	context.runtime->present();
+	CHECK(scene::bound_depth(context) == first);
+
+	// The other depth-stencil has to clearly beat the selected one for the configured number of frames in a row
+	for (int frame = 1; frame <= 5; ++frame)
+	{
+		scene::render(context.immediate(), first_dsv, 1200, 720, 50);
+		scene::render(context.immediate(), second_dsv, 1200, 720, 100);
+		context.runtime->present();
+		CHECK(scene::bound_depth(context) == (frame < 5 ? first : second));
+	}
+}
+
+TEST(forgets_destroyed_depth_stencil)
+{
+	mock::context context(device_api::d3d11);
+
+	const auto [first, first_dsv] = context.device->create_depth_stencil(1200, 720);
+	const auto [second, second_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	scene::render(context.immediate(), first_dsv, 1200, 720, 50);
+	scene::render(context.immediate(), second_dsv, 1200, 720, 20);
+	context.runtime->present();
+	CHECK(scene::bound_depth(context) == first);
+
+	context.device->destroy_application_resource(first);
+
+	scene::render(context.immediate(), second_dsv, 1200, 720, 20);
+	context.runtime->present();
+	CHECK(scene::bound_depth(context) == second);
+}
+
+TEST(forgets_depth_stencil_destroyed_before_duplicate_frame)
+{
+	mock::context context(device_api::d3d12);
+
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	scene::render(context.immediate(), scene_dsv, 1200, 720, 50);
+	context.runtime->present();
+	const resource backup = scene::bound_depth(context);
+	CHECK(backup != 0 && backup != scene);
+
+	// Nothing is rendered after the depth-stencil was destroyed, so the next present is a duplicate, which must not keep the destroyed depth-stencil selected
+	context.device->destroy_application_resource(scene);
+	context.runtime->present();
+	CHECK(scene::bound_depth(context) == 0);
+
+	// The backup is destroyed after 50 frames, which have to count even though they are all duplicates
+	for (int frame = 0; frame < 50; ++frame)
+		context.runtime->present();
+	CHECK(!context.device->exists(backup));
+}
@@ -0,0 +1,58 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Minimal test framework for the add-on core, which runs a single test per process (see 'main.cpp')
+ */
+
+#pragma once
+
+#include <mock_host.hpp>
+#include <cstdio>
+#include <cstdlib>
+
+// Aborts the test with the location of the failed check
+#define CHECK(expression) \
+	do { \
+		if (!(expression)) \
+		{ \
+			std::fprintf(stderr, "%s(%d): check failed: %s\n", __FILE__, __LINE__, #expression); \
+			std::exit(1); \
+		} \
+	} while (false)
+
+struct test_case
+{
+	const char *name;
+	void(*function)();
+	const test_case *next;
+
+	test_case(const char *name, void(*function)());
+
+	static const test_case *first;
+};
+
+#define TEST(name) \
+	static void test_##name(); \
+	static const test_case test_case_##name(#name, test_##name); \
+	static void test_##name()
+
+namespace scene
+{
+	using namespace reshade::api;
+
+	// Renders 'draws' draw calls with 'vertices' vertices each to a depth-stencil, in a viewport covering all of it
+	inline void render(mock::command_list &cmd_list, resource_view dsv, uint32_t width, uint32_t height, uint32_t draws, uint32_t vertices = 300)
+	{
+		cmd_list.bind_depth_stencil(dsv);
+		cmd_list.bind_viewport({ 0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height), 0.0f, 1.0f });
+		for (uint32_t i = 0; i < draws; ++i)
+			cmd_list.draw(vertices);
+	}
+
+	// Returns the resource effects currently see as 'ORIG_DEPTH' (the depth-stencil itself or its backup texture)
+	inline resource bound_depth(const mock::context &context)
+	{
+		const resource_view view = context.runtime->binding("ORIG_DEPTH");
+		return view != 0 ? context.device->get_resource_from_view(view) : resource { 0 };
+	}
+}
@@ -0,0 +1,207 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Command lists submitted from several threads, like D3D12 and Vulkan applications do
+ * These are also built with the thread sanitizer where it is available (see 'citra-test-tsan' in the CMake build)
+ */
+
+#include "test.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+
+using namespace reshade::api;
+
+namespace
+{
+	// Thread that runs tasks one at a time and outlives them, like the render threads of an application (which keeps its submission shard in the add-on alive)
+	class worker
+	{
+	public:
+		worker() : _thread([this]() { loop(); }) {}
+		~worker()
+		{
+			run(nullptr);
+			_thread.join();
+		}
+
+		// Runs a task on the thread and waits for it to finish (an empty task stops the thread)
+		void run(std::function<void()> task)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_task = std::move(task);
+			_pending = true;
+			_condition.notify_all();
+			_condition.wait(lock, [this]() { return !_pending; });
+		}
+
+	private:
+		void loop()
+		{
+			for (bool running = true; running;)
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_condition.wait(lock, [this]() { return _pending; });
+				running = static_cast<bool>(_task);
+				if (running)
+					_task();
+				_pending = false;
+				_condition.notify_all();
+			}
+		}
+
+		std::mutex _mutex;
+		std::condition_variable _condition;
+		std::function<void()> _task;
+		bool _pending = false;
+		std::thread _thread;
+	};
+
+	// Records a command list that clears the depth-stencil after 'draws' draw calls, and submits it
+	void submit_clear_after(mock::context &context, mock::command_list &cmd_list, resource_view dsv, uint32_t draws)
+	{
+		cmd_list.reset();
+		cmd_list.clear_commands();
+		scene::render(cmd_list, dsv, 1200, 720, draws);
+		cmd_list.clear_depth(dsv);
+		scene::render(cmd_list, dsv, 1200, 720, 5);
+		cmd_list.close();
+		context.queue->execute(cmd_list);
+	}
+
+	// Returns the overlay rows of the clear operations of the selected depth-stencil, in the order they are listed
+	std::vector<std::string> clear_rows(mock::context &context)
+	{
+		std::vector<std::string> rows;
+		for (const std::string &line : mock::draw_overlay(context.runtime.get()))
+			if (line.find("|           |       |") != std::string::npos)
+				rows.push_back(line);
+		return rows;
+	}
+}
+
+TEST(orders_clears_by_submission)
+{
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+
+	mock::context context(device_api::d3d12);
+	const auto first_cmd_list = context.create_command_list();
+	const auto second_cmd_list = context.create_command_list();
+
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	worker first_thread, second_thread;
+
+	for (int frame = 0; frame < 6; ++frame)
+	{
+		// The first thread always submitted first in the add-on, so without ordering by submission its clears would always be listed first
+		const bool first_thread_submits_first = frame % 2 == 0;
+		const auto submit_first = [&]() { submit_clear_after(context, *first_cmd_list, scene_dsv, 60); };
+		const auto submit_second = [&]() { submit_clear_after(context, *second_cmd_list, scene_dsv, 20); };
+		if (first_thread_submits_first)
+		{
+			first_thread.run(submit_first);
+			second_thread.run(submit_second);
+		}
+		else
+		{
+			second_thread.run(submit_second);
+			first_thread.run(submit_first);
+		}
+		context.runtime->present();
+
+		// The first frame only selects the depth-stencil, clear operations are listed once it has a backup
+		if (frame == 0)
+			continue;
+
+		const std::vector<std::string> rows = clear_rows(context);
+		CHECK(rows.size() == 2);
+		CHECK(rows[0].find(first_thread_submits_first ? "   60 draw calls" : "   20 draw calls") != std::string::npos);
+		CHECK(rows[1].find(first_thread_submits_first ? "   20 draw calls" : "   60 draw calls") != std::string::npos);
+	}
+}
+
+TEST(submits_from_many_threads)
+{
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+
+	mock::context context(device_api::d3d12);
+	const auto [scene, scene_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	// Command lists are created up front, since creating them goes through events too
+	const unsigned int thread_count = 4;
+	std::vector<std::unique_ptr<mock::command_list, void(*)(mock::command_list *)>> cmd_lists;
+	for (unsigned int i = 0; i < thread_count; ++i)
+		cmd_lists.push_back(context.create_command_list());
+
+	// Submissions and presents are not synchronized with each other at all, like in an application with a render thread per pass
+	std::atomic<bool> stop = false;
+	std::atomic<uint64_t> submissions = 0;
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < thread_count; ++i)
+	{
+		threads.emplace_back([&, i]() {
+			while (!stop.load())
+			{
+				submit_clear_after(context, *cmd_lists[i], scene_dsv, 20 + i * 10);
+				submissions++;
+			}
+		});
+	}
+
+	for (int frame = 0; frame < 200 || submissions.load() < 100; ++frame)
+	{
+		context.runtime->present();
+		std::this_thread::yield();
+	}
+
+	stop = true;
+	for (std::thread &thread : threads)
+		thread.join();
+
+	// Take what the threads submitted after the last present, so that the last frame only contains one submission per thread
+	context.runtime->present();
+	for (unsigned int i = 0; i < thread_count; ++i)
+		submit_clear_after(context, *cmd_lists[i], scene_dsv, 20 + i * 10);
+	context.runtime->present();
+
+	CHECK(scene::bound_depth(context) != 0);
+	CHECK(clear_rows(context).size() == thread_count);
+}
+
+TEST(records_while_waiting_for_gpu_after_reselection)
+{
+	mock::set_config("DEPTH", "DepthCopyBeforeClears", "1");
+	mock::set_config("DEPTH", "DepthSelectionHysteresisFrames", "0");
+
+	mock::context context(device_api::d3d12);
+	const auto first_cmd_list = context.create_command_list();
+	const auto second_cmd_list = context.create_command_list();
+
+	const auto [first, first_dsv] = context.device->create_depth_stencil(1200, 720);
+	const auto [second, second_dsv] = context.device->create_depth_stencil(1200, 720);
+
+	submit_clear_after(context, *first_cmd_list, first_dsv, 50);
+	context.runtime->present();
+	CHECK(scene::bound_depth(context) != 0);
+
+	// Switching to the other depth-stencil waits for the GPU before the old view is destroyed, during which another thread records clears (which look up backups)
+	std::future<void> recording;
+	bool recorded_during_wait = false;
+	context.queue->on_wait_idle = [&]() {
+		recording = std::async(std::launch::async, [&]() { submit_clear_after(context, *second_cmd_list, first_dsv, 10); });
+		recorded_during_wait = recording.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+	};
+
+	submit_clear_after(context, *first_cmd_list, second_dsv, 100);
+	context.runtime->present();
+	context.queue->on_wait_idle = nullptr;
+
+	CHECK(recording.valid());
+	recording.wait();
+	CHECK(recorded_during_wait);
+	CHECK(scene::bound_depth(context) != 0);
+}
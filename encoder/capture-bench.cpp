@@ -0,0 +1,145 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Measures how fast captures of the Citra add-on can be compressed, written and read back, using generated frames
+ * Build with: g++ -std=c++17 -O2 -pthread capture-bench.cpp -o capture-bench
+ */
+
+#include "../Citra AddOn/citra_capture.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <thread>
+
+// Smooth gradients with some noise and a flat background, which is roughly what a 3DS frame at a higher internal resolution looks like
+static citra_capture::frame generate_frame(uint64_t index, uint32_t width, uint32_t height, std::mt19937 &random)
+{
+	citra_capture::frame frame;
+	frame.info.frame_index = index;
+	frame.info.color_width = frame.info.depth_width = width;
+	frame.info.color_height = frame.info.depth_height = height;
+	frame.info.color_format = citra_capture::color_order::bgra8;
+	frame.color.resize(static_cast<size_t>(width) * height * 4);
+	frame.depth.resize(static_cast<size_t>(width) * height);
+
+	std::uniform_int_distribution<int> noise(-2, 2);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			const size_t i = static_cast<size_t>(y) * width + x;
+			const bool background = y < height / 3;
+			const float shift = static_cast<float>(index % 64);
+			frame.color[i * 4 + 0] = background ? 200 : static_cast<uint8_t>(std::clamp(static_cast<int>((x + shift) * 255 / width) + noise(random), 0, 255));
+			frame.color[i * 4 + 1] = background ? 160 : static_cast<uint8_t>(std::clamp(static_cast<int>(y * 255 / height) + noise(random), 0, 255));
+			frame.color[i * 4 + 2] = background ? 90 : static_cast<uint8_t>(128 + noise(random));
+			frame.color[i * 4 + 3] = 255;
+			frame.depth[i] = background ? 1.0f : 0.2f + 0.5f * y / height + 0.05f * std::sin((x + shift) * 0.05f);
+		}
+	}
+
+	return frame;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *const path = argc > 1 ? argv[1] : "capture-bench.ccap";
+	const int frame_count = argc > 2 ? std::max(1, std::atoi(argv[2])) : 120;
+	// Top screen at 3x internal resolution
+	const uint32_t width = 1200, height = 720;
+
+	std::mt19937 random(42);
+	std::vector<citra_capture::frame> frames;
+	for (int i = 0; i < 8; ++i)
+		frames.push_back(generate_frame(i, width, height, random));
+	const double raw_size = static_cast<double>(frames[0].color.size() + frames[0].depth.size() * sizeof(float));
+
+	// Compression alone, on the calling thread
+	std::vector<uint8_t> encoded;
+	size_t encoded_size = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < frame_count; ++i)
+	{
+		encoded.clear();
+		citra_capture::encode_frame(frames[i % frames.size()], encoded);
+		encoded_size += encoded.size();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::printf("encode: %.1f frames per second, %.1f MB/s, ratio %.2f\n", frame_count / seconds, frame_count * raw_size / seconds / 1e6, frame_count * raw_size / encoded_size);
+
+	// Writer thread, submitting as fast as possible and retrying dropped frames, which shows the sustained rate and how long submitting takes
+	citra_capture::writer writer;
+	if (!writer.open(path))
+	{
+		std::fprintf(stderr, "Failed to open \"%s\" for writing.\n", path);
+		return 1;
+	}
+	std::chrono::steady_clock::duration submit_time = {};
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < frame_count; ++i)
+	{
+		for (;;)
+		{
+			citra_capture::frame frame = frames[i % frames.size()];
+			frame.info.frame_index = i;
+
+			const auto submit_start = std::chrono::steady_clock::now();
+			const bool submitted = writer.submit(std::move(frame));
+			submit_time += std::chrono::steady_clock::now() - submit_start;
+			if (submitted)
+				break;
+			if (writer.failed())
+			{
+				std::fprintf(stderr, "Failed to write \"%s\".\n", path);
+				return 1;
+			}
+			std::this_thread::yield();
+		}
+	}
+	writer.close();
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::printf("write:  %.1f frames per second, %.1f MB/s, %.3f ms per submit, %llu bytes\n", frame_count / seconds, frame_count * raw_size / seconds / 1e6,
+		1000.0 * std::chrono::duration<double>(submit_time).count() / frame_count, static_cast<unsigned long long>(writer.bytes_written()));
+
+	// Reading back, which also checks that every frame round-trips
+	citra_capture::reader reader;
+	if (!reader.open(path))
+	{
+		std::fprintf(stderr, "Failed to open \"%s\" for reading.\n", path);
+		return 1;
+	}
+	int frames_read = 0;
+	citra_capture::frame frame;
+	start = std::chrono::steady_clock::now();
+	while (reader.read(frame))
+	{
+		const citra_capture::frame &expected = frames[frames_read % frames.size()];
+		for (size_t i = 0; i < frame.color.size(); i += 4)
+		{
+			// The reader converts to RGBA, so red and blue are swapped compared to what was written
+			if (frame.color[i] != expected.color[i + 2] || frame.color[i + 1] != expected.color[i + 1] || frame.color[i + 2] != expected.color[i] || frame.color[i + 3] != expected.color[i + 3])
+			{
+				std::fprintf(stderr, "Frame %d does not match what was written.\n", frames_read);
+				return 1;
+			}
+		}
+		if (frame.depth != expected.depth)
+		{
+			std::fprintf(stderr, "Frame %d does not match what was written.\n", frames_read);
+			return 1;
+		}
+		frames_read++;
+	}
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::printf("read:   %.1f frames per second, %.1f MB/s\n", frames_read / seconds, frames_read * raw_size / seconds / 1e6);
+
+	if (frames_read != frame_count)
+	{
+		std::fprintf(stderr, "Read %d of %d frames.\n", frames_read, frame_count);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Measures how much work rendering only the changed tiles saves over rendering every frame completely, on generated sequences, and checks that both give the same panel frames
+ * Build with: g++ -std=c++17 -O2 -pthread interlace-bench.cpp -o interlace-bench
+ */
+
+#include "lkg-views.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+namespace
+{
+	enum class motion
+	{
+		none, // A paused game or a static menu
+		cursor, // A menu where only a cursor moves
+		pan, // The camera moves, so every pixel changes
+	};
+
+	// Smooth gradients with a flat background, and a small square for the cursor (depth is already normalized)
+	void generate_frame(const options &options, motion motion, uint64_t index, frame &frame)
+	{
+		frame.index = index;
+		frame.color.resize(static_cast<size_t>(options.width) * options.height * 4);
+		frame.depth.resize(static_cast<size_t>(options.width) * options.height);
+
+		const int pan = motion == motion::pan ? static_cast<int>(index) : 0;
+		const int cursor_x = 40 + (motion == motion::cursor ? static_cast<int>(index % 32) * 8 : 0), cursor_y = 100;
+
+		for (int y = 0; y < options.height; ++y)
+		{
+			for (int x = 0; x < options.width; ++x)
+			{
+				const size_t i = static_cast<size_t>(y) * options.width + x;
+				const bool background = y < options.height / 3;
+				const bool cursor = x >= cursor_x && x < cursor_x + 16 && y >= cursor_y && y < cursor_y + 16;
+				frame.color[i * 4 + 0] = cursor ? 255 : background ? 200 : static_cast<uint8_t>((x + pan) * 255 / (options.width + pan));
+				frame.color[i * 4 + 1] = cursor ? 255 : background ? 160 : static_cast<uint8_t>(y * 255 / options.height);
+				frame.color[i * 4 + 2] = cursor ? 0 : background ? 90 : static_cast<uint8_t>(((x + pan) ^ y) & 0xFF);
+				frame.color[i * 4 + 3] = 255;
+				frame.depth[i] = cursor ? 0.0f : background ? 1.0f : 0.2f + 0.5f * y / options.height + 0.05f * std::sin((x + pan) * 0.05f);
+			}
+		}
+	}
+
+	double milliseconds_since(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const int frame_count = argc > 1 ? std::max(2, std::atoi(argv[1])) : 60;
+
+	options options;
+	const quilt_atlas atlas = pack_quilt(options, options.quilt_budget);
+
+	const unsigned int thread_count = std::max(1u, std::thread::hardware_concurrency());
+	thread_pool pool(thread_count > 1 ? thread_count - 1 : 0);
+
+	for (const auto &[motion, name] : { std::make_pair(motion::none, "static"), std::make_pair(motion::cursor, "cursor"), std::make_pair(motion::pan, "pan") })
+	{
+		change_detector detector;
+		std::vector<uint8_t> quilt, output, full_quilt, full_output(static_cast<size_t>(s_panel_width) * s_panel_height * 3);
+		double full_time = 0.0, incremental_time = 0.0;
+		uint64_t synthesized_pixels = 0, interlaced_pixels = 0;
+
+		frame frame;
+		for (int index = 0; index < frame_count; ++index)
+		{
+			generate_frame(options, motion, index, frame);
+
+			auto start = std::chrono::steady_clock::now();
+			synthesize_quilt(options, pool, frame, atlas, full_quilt);
+			pool.parallel_for(s_panel_height, [&](int y) {
+				interlace_row(options, atlas, full_quilt, full_output, y);
+			});
+			full_time += milliseconds_since(start);
+
+			start = std::chrono::steady_clock::now();
+			const dirty_tiles dirty = detector.update(options, frame);
+			synthesized_pixels += update_quilt(options, pool, frame, dirty, atlas, quilt);
+			interlaced_pixels += update_panel(options, pool, dirty, atlas, quilt, output);
+			incremental_time += milliseconds_since(start);
+
+			if (output != full_output)
+			{
+				std::fprintf(stderr, "Frame %d of the %s sequence differs from rendering it completely.\n", index, name);
+				return 1;
+			}
+		}
+
+		std::printf("%-7s complete %7.2f ms, changed tiles only %7.2f ms per frame | rendered %5.1f%% of the quilt, interlaced %5.1f%% of the panel\n", name,
+			full_time / frame_count, incremental_time / frame_count,
+			100.0 * synthesized_pixels / (static_cast<double>(quilt_pixels(atlas)) * frame_count),
+			100.0 * interlaced_pixels / (static_cast<double>(s_panel_width) * s_panel_height * frame_count));
+	}
+
+	return 0;
+}
@@ -0,0 +1,472 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Offline encoder that turns recorded color + depth frames of a Citra game into frames for the Looking Glass Portrait
+ * Build with: g++ -std=c++17 -O2 -pthread lkg-encode.cpp -o lkg-encode
+ */
+
+#include "lkg-views.hpp"
+#include "../Citra AddOn/citra_capture.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Queue between two stages, which blocks the producer when full so that memory stays flat on long clips
+template <typename T>
+class bounded_queue
+{
+public:
+	explicit bounded_queue(size_t capacity) : _capacity(capacity) {}
+
+	bool push(T value)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_not_full.wait(lock, [this]() { return _items.size() < _capacity || _closed; });
+		if (_closed)
+			return false;
+		_items.push_back(std::move(value));
+		_not_empty.notify_one();
+		return true;
+	}
+	bool pop(T &value)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_not_empty.wait(lock, [this]() { return !_items.empty() || _closed; });
+		if (_items.empty())
+			return false;
+		value = std::move(_items.front());
+		_items.pop_front();
+		_not_full.notify_one();
+		return true;
+	}
+
+	// Lets consumers drain the remaining items and then stop
+	void close()
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
+		_closed = true;
+		_not_empty.notify_all();
+		_not_full.notify_all();
+	}
+
+private:
+	const size_t _capacity;
+	std::mutex _mutex;
+	std::condition_variable _not_empty, _not_full;
+	std::deque<T> _items;
+	bool _closed = false;
+};
+
+// Hands the result a stage keeps updating from frame to frame to the next stage, without copying all of it every frame
+// The next stage gives buffers back in the order of the frames they were sent with, and they still hold those frames, so only what changed since then is copied into them
+class buffer_recycler
+{
+public:
+	// Returns a buffer with the contents of 'current' as of frame 'index', calling 'copy_changed(changes, buffer)' to bring a recycled buffer up to date with the changes since the frame it holds
+	template <typename F>
+	std::vector<uint8_t> snapshot(uint64_t index, const std::vector<uint8_t> &current, const dirty_tiles &dirty, F copy_changed)
+	{
+		_changes.emplace_back(index, dirty);
+
+		uint64_t buffer_index = 0;
+		std::vector<uint8_t> buffer;
+		if (!take(buffer_index, buffer))
+			return current;
+
+		// Later buffers hold later frames, so the changes up to this one are not needed anymore
+		while (_changes.front().first <= buffer_index)
+			_changes.pop_front();
+		dirty_tiles changes = _changes.front().second;
+		for (auto it = std::next(_changes.begin()); it != _changes.end(); ++it)
+			changes.merge(it->second);
+
+		if (changes.all() || buffer.size() != current.size())
+			buffer = current;
+		else
+			copy_changed(changes, buffer);
+		return buffer;
+	}
+
+	// Returns a buffer with undefined contents, for a stage that renders every frame completely
+	std::vector<uint8_t> take()
+	{
+		uint64_t buffer_index = 0;
+		std::vector<uint8_t> buffer;
+		take(buffer_index, buffer);
+		return buffer;
+	}
+
+	// Called by the next stage once it is done with the buffer of frame 'index'
+	void recycle(uint64_t index, std::vector<uint8_t> &&buffer)
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
+		_free.emplace_back(index, std::move(buffer));
+	}
+
+private:
+	bool take(uint64_t &index, std::vector<uint8_t> &buffer)
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
+		if (_free.empty())
+			return false;
+		index = _free.front().first;
+		buffer = std::move(_free.front().second);
+		_free.pop_front();
+		return true;
+	}
+
+	std::mutex _mutex;
+	std::deque<std::pair<uint64_t, std::vector<uint8_t>>> _free;
+	// Changes of the frames after the oldest one a buffer was sent with, only used by the stage that sends the buffers
+	std::deque<std::pair<uint64_t, dirty_tiles>> _changes;
+};
+
+
+// Time a stage spent working (as opposed to waiting on its queues)
+struct stage_stats
+{
+	const char *name;
+	std::chrono::steady_clock::duration busy = {};
+};
+
+template <typename F>
+static void run_stage(stage_stats &stats, bounded_queue<std::unique_ptr<frame>> &input, bounded_queue<std::unique_ptr<frame>> *output, F process)
+{
+	std::unique_ptr<frame> current;
+	while (input.pop(current))
+	{
+		const auto start = std::chrono::steady_clock::now();
+		process(*current);
+		stats.busy += std::chrono::steady_clock::now() - start;
+
+		if (output != nullptr && !output->push(std::move(current)))
+			break;
+	}
+	if (output != nullptr)
+		output->close();
+}
+
+
+// Takes color and depth of a capture frame, scaling depth up to the color size when the add-on normalized it at a lower resolution
+static bool read_capture_frame(const options &options, citra_capture::frame &capture_frame, frame &frame)
+{
+	const citra_capture::frame_info &info = capture_frame.info;
+	if (static_cast<int>(info.color_width) != options.width || static_cast<int>(info.color_height) != options.height || info.depth_width == 0 || info.depth_height == 0)
+		return false;
+
+	frame.color = std::move(capture_frame.color);
+	frame.depth.resize(static_cast<size_t>(options.width) * options.height);
+	for (int y = 0; y < options.height; ++y)
+	{
+		const size_t source_row = static_cast<size_t>(y) * info.depth_height / options.height * info.depth_width;
+		for (int x = 0; x < options.width; ++x)
+			frame.depth[static_cast<size_t>(y) * options.width + x] = capture_frame.depth[source_row + static_cast<size_t>(x) * info.depth_width / options.width];
+	}
+	return true;
+}
+
+static void print_usage()
+{
+	std::fprintf(stderr,
+		"usage: lkg-encode --color <file> --depth <file> [--output <file>] [options]\n"
+		"       lkg-encode --capture <file> [--output <file>] [options]\n"
+		"  --color <file>        raw RGBA8 frames, one after another\n"
+		"  --depth <file>        raw 32-bit float depth frames (linear, 0 = near), one after another\n"
+		"  --capture <file>      capture recorded by the Citra add-on (sets the size of the input frames)\n"
+		"  --output <file>       raw RGB8 frames at 1536x2048 (default: standard output)\n"
+		"  --size <w>x<h>        size of the input frames (default: 400x240)\n"
+		"  --views <n>           number of synthesized views (default: 45)\n"
+		"  --calibration <slope>,<center>,<pitch>\n"
+		"  --strength <f>        shift between the outermost views, as fraction of the width (default: 0.04)\n"
+		"  --focus <f>           normalized depth that stays at the display plane (default: 0.5)\n"
+		"  --quilt-budget <f>    quilt pixels relative to full resolution views, lowering steep views first (default: 1)\n"
+		"  --quality-report      also render from a full resolution quilt and report the difference (PSNR)\n"
+		"  --no-dirty-tiles      render and interlace every frame completely, even where the input did not change\n"
+		"  --queue <n>           frames buffered between stages (default: 4)\n"
+		"  --threads <n>         worker threads (default: number of cores)\n");
+}
+
+static bool parse_options(int argc, char *argv[], options &options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char *const arg = argv[i];
+		if (std::strcmp(arg, "--quality-report") == 0)
+		{
+			options.quality_report = true;
+			continue;
+		}
+		if (std::strcmp(arg, "--no-dirty-tiles") == 0)
+		{
+			options.dirty_tiles = false;
+			continue;
+		}
+
+		const char *const value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (value == nullptr)
+			return false;
+		++i;
+
+		if (std::strcmp(arg, "--color") == 0)
+			options.color_path = value;
+		else if (std::strcmp(arg, "--depth") == 0)
+			options.depth_path = value;
+		else if (std::strcmp(arg, "--capture") == 0)
+			options.capture_path = value;
+		else if (std::strcmp(arg, "--output") == 0)
+			options.output_path = value;
+		else if (std::strcmp(arg, "--size") == 0 && std::sscanf(value, "%dx%d", &options.width, &options.height) == 2)
+			continue;
+		else if (std::strcmp(arg, "--views") == 0)
+			options.views = std::atoi(value);
+		else if (std::strcmp(arg, "--calibration") == 0 && std::sscanf(value, "%f,%f,%f", &options.slope, &options.center, &options.pitch) == 3)
+			continue;
+		else if (std::strcmp(arg, "--strength") == 0)
+			options.strength = static_cast<float>(std::atof(value));
+		else if (std::strcmp(arg, "--focus") == 0)
+			options.focus = static_cast<float>(std::atof(value));
+		else if (std::strcmp(arg, "--quilt-budget") == 0)
+			options.quilt_budget = std::clamp(static_cast<float>(std::atof(value)), 0.0625f, 1.0f);
+		else if (std::strcmp(arg, "--queue") == 0)
+			options.queue_size = static_cast<size_t>(std::max(1, std::atoi(value)));
+		else if (std::strcmp(arg, "--threads") == 0)
+			options.threads = static_cast<unsigned int>(std::max(0, std::atoi(value)));
+		else
+			return false;
+	}
+
+	return (options.capture_path != nullptr || (options.color_path != nullptr && options.depth_path != nullptr)) && options.width > 0 && options.height > 0 && options.views > 0;
+}
+
+int main(int argc, char *argv[])
+{
+	options options;
+	if (!parse_options(argc, argv, options))
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::ifstream color_file, depth_file;
+	citra_capture::reader capture;
+	citra_capture::frame capture_frame;
+	if (options.capture_path != nullptr)
+	{
+		// The first frame decides the size of the input frames
+		if (!capture.open(options.capture_path) || !capture.read(capture_frame))
+		{
+			std::fprintf(stderr, "Failed to read capture \"%s\".\n", options.capture_path);
+			return 1;
+		}
+		options.width = static_cast<int>(capture_frame.info.color_width);
+		options.height = static_cast<int>(capture_frame.info.color_height);
+	}
+	else
+	{
+		color_file.open(options.color_path, std::ios::binary);
+		depth_file.open(options.depth_path, std::ios::binary);
+		if (!color_file || !depth_file)
+		{
+			std::fprintf(stderr, "Failed to open input files.\n");
+			return 1;
+		}
+	}
+
+	FILE *const output_file = options.output_path != nullptr ? std::fopen(options.output_path, "wb") : stdout;
+	if (output_file == nullptr)
+	{
+		std::fprintf(stderr, "Failed to open \"%s\" for writing.\n", options.output_path);
+		return 1;
+	}
+
+	const unsigned int thread_count = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+	thread_pool pool(thread_count > 1 ? thread_count - 1 : 0);
+
+	bounded_queue<std::unique_ptr<frame>> normalize_queue(options.queue_size), synthesize_queue(options.queue_size), interlace_queue(options.queue_size), write_queue(options.queue_size);
+	stage_stats read_stats { "read" }, normalize_stats { "normalize" }, synthesize_stats { "synthesize" }, interlace_stats { "interlace" }, write_stats { "write" };
+
+	const size_t pixel_count = static_cast<size_t>(options.width) * options.height;
+	const quilt_atlas atlas = pack_quilt(options, options.quilt_budget);
+	const quilt_atlas reference_atlas = pack_quilt(options, 1.0f);
+	const bool compare_to_reference = options.quality_report && options.quilt_budget < 1.0f;
+	const auto start = std::chrono::steady_clock::now();
+
+	std::thread reader([&]() {
+		for (uint64_t index = 0;; ++index)
+		{
+			const auto read_start = std::chrono::steady_clock::now();
+
+			auto next = std::make_unique<frame>();
+			next->index = index;
+			if (options.capture_path != nullptr)
+			{
+				if (index != 0 && !capture.read(capture_frame))
+					break;
+				if (!read_capture_frame(options, capture_frame, *next))
+				{
+					if (capture_frame.info.depth_width == 0 || capture_frame.info.depth_height == 0)
+						std::fprintf(stderr, "Frame %llu of the capture has no depth (no depth buffer was selected while recording it), stopping there.\n", static_cast<unsigned long long>(index));
+					else
+						std::fprintf(stderr, "Frame %llu of the capture changes size, stopping there.\n", static_cast<unsigned long long>(index));
+					break;
+				}
+			}
+			else
+			{
+				next->color.resize(pixel_count * 4);
+				next->depth.resize(pixel_count);
+				if (!color_file.read(reinterpret_cast<char *>(next->color.data()), next->color.size()) ||
+					!depth_file.read(reinterpret_cast<char *>(next->depth.data()), next->depth.size() * sizeof(float)))
+					break;
+			}
+
+			read_stats.busy += std::chrono::steady_clock::now() - read_start;
+
+			if (!normalize_queue.push(std::move(next)))
+				break;
+		}
+		normalize_queue.close();
+	});
+
+	std::thread normalizer([&]() {
+		float smoothed_min = 0.0f, smoothed_max = 1.0f;
+		change_detector detector;
+		run_stage(normalize_stats, normalize_queue, &synthesize_queue, [&](frame &frame) {
+			normalize_depth(frame, smoothed_min, smoothed_max);
+			// Normalized depth is compared, so a change of the depth range renders everything again
+			if (options.dirty_tiles)
+				frame.dirty = detector.update(options, frame);
+		});
+	});
+
+	// Each stage keeps its result of the previous frame, of which only the parts the input changed are rendered again
+	std::atomic<uint64_t> synthesized_pixels = 0, interlaced_pixels = 0;
+
+	// Quilts and panel frames go back to the stage that rendered them once the next stage is done with them, so they are neither allocated nor copied completely for every frame
+	buffer_recycler quilt_buffers, output_buffers;
+
+	std::thread synthesizer([&]() {
+		std::vector<uint8_t> quilt;
+		run_stage(synthesize_stats, synthesize_queue, &interlace_queue, [&](frame &frame) {
+			if (options.dirty_tiles)
+			{
+				synthesized_pixels += update_quilt(options, pool, frame, frame.dirty, atlas, quilt);
+				frame.views = quilt_buffers.snapshot(frame.index, quilt, frame.dirty, [&](const dirty_tiles &changes, std::vector<uint8_t> &buffer) {
+					copy_changed_quilt(options, pool, changes, atlas, quilt, buffer);
+				});
+			}
+			else
+			{
+				// Every frame is rendered completely, so there is nothing to keep from the previous one
+				frame.views = quilt_buffers.take();
+				synthesized_pixels += update_quilt(options, pool, frame, frame.dirty, atlas, frame.views);
+			}
+			if (compare_to_reference)
+				synthesize_quilt(options, pool, frame, reference_atlas, frame.reference_views);
+			// Color and depth are not needed anymore, so free them before the frame sits in the next queue
+			frame.color = {};
+			frame.depth = {};
+		});
+	});
+
+	double squared_error = 0.0;
+	uint64_t compared_values = 0;
+	std::thread interlacer([&]() {
+		std::vector<uint8_t> output, reference_output;
+		run_stage(interlace_stats, interlace_queue, &write_queue, [&](frame &frame) {
+			if (options.dirty_tiles)
+			{
+				interlaced_pixels += update_panel(options, pool, frame.dirty, atlas, frame.views, output);
+				frame.output = output_buffers.snapshot(frame.index, output, frame.dirty, [&](const dirty_tiles &changes, std::vector<uint8_t> &buffer) {
+					copy_changed_panel(options, pool, changes, atlas, output, buffer);
+				});
+			}
+			else
+			{
+				frame.output = output_buffers.take();
+				interlaced_pixels += update_panel(options, pool, frame.dirty, atlas, frame.views, frame.output);
+			}
+			quilt_buffers.recycle(frame.index, std::move(frame.views));
+
+			if (compare_to_reference)
+			{
+				reference_output.resize(frame.output.size());
+				pool.parallel_for(s_panel_height, [&](int y) {
+					interlace_row(options, reference_atlas, frame.reference_views, reference_output, y);
+				});
+				frame.reference_views = {};
+
+				for (size_t i = 0; i < frame.output.size(); ++i)
+				{
+					const double difference = static_cast<double>(frame.output[i]) - reference_output[i];
+					squared_error += difference * difference;
+				}
+				compared_values += frame.output.size();
+			}
+		});
+	});
+
+	uint64_t frames_written = 0;
+	bool write_failed = false;
+	run_stage(write_stats, write_queue, nullptr, [&](frame &frame) {
+		if (write_failed)
+			return;
+		if (std::fwrite(frame.output.data(), 1, frame.output.size(), output_file) != frame.output.size())
+		{
+			// Nothing after this frame can be written either, so stop every stage instead of processing the rest of the input
+			write_failed = true;
+			for (auto *const queue : { &normalize_queue, &synthesize_queue, &interlace_queue, &write_queue })
+				queue->close();
+			return;
+		}
+		frames_written++;
+		output_buffers.recycle(frame.index, std::move(frame.output));
+	});
+
+	reader.join();
+	normalizer.join();
+	synthesizer.join();
+	interlacer.join();
+
+	if (output_file != stdout)
+		std::fclose(output_file);
+	else
+		std::fflush(stdout);
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::fprintf(stderr, "%llu frames in %.2f s (%.2f frames per second, %u threads)\n", static_cast<unsigned long long>(frames_written), seconds, seconds > 0.0 ? frames_written / seconds : 0.0, thread_count);
+	for (const stage_stats *stats : { &read_stats, &normalize_stats, &synthesize_stats, &interlace_stats, &write_stats })
+		std::fprintf(stderr, "  %-10s busy %5.1f%%\n", stats->name, seconds > 0.0 ? 100.0 * std::chrono::duration<double>(stats->busy).count() / seconds : 0.0);
+
+	std::fprintf(stderr, "quilt %dx%d, %.1f%% of the pixels of full resolution views\n", atlas.width, atlas.height, 100.0 * quilt_pixels(atlas) / quilt_pixels(reference_atlas));
+	if (options.dirty_tiles && frames_written != 0)
+		std::fprintf(stderr, "rendered %.1f%% of the quilt pixels and interlaced %.1f%% of the panel pixels (only where the input changed)\n",
+			100.0 * synthesized_pixels / (static_cast<double>(quilt_pixels(atlas)) * frames_written), 100.0 * interlaced_pixels / (static_cast<double>(s_panel_width) * s_panel_height * frames_written));
+	if (compare_to_reference && compared_values != 0)
+	{
+		const double mse = squared_error / compared_values;
+		std::fprintf(stderr, "difference to full resolution views: PSNR %.2f dB (mean squared error %.3f)\n", mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.99, mse);
+	}
+
+	if (write_failed)
+	{
+		std::fprintf(stderr, "Failed to write output.\n");
+		return 1;
+	}
+
+	return 0;
+}
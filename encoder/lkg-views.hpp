@@ -0,0 +1,572 @@
+/*
+ * 2022 Jake Downs
+ *
+ * View synthesis and interlacing for the Looking Glass Portrait, shared by the offline encoder and its benchmarks (see 'lkg-encode.cpp')
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// this is especially made for looking glass portrait (same as 'lookingglass.glsl')
+static const int s_panel_width = 1536;
+static const int s_panel_height = 2048;
+static const float s_panel_dpi = 324.0f;
+
+// Changes between frames are tracked in tiles of this many input pixels per side, and the panel is interlaced again in tiles of this many panel pixels per side
+static const int s_input_tile_size = 16;
+static const int s_panel_tile_size = 64;
+
+struct options
+{
+	const char *color_path = nullptr;
+	const char *depth_path = nullptr;
+	// Capture recorded by the add-on, used instead of the color and depth files
+	const char *capture_path = nullptr;
+	const char *output_path = nullptr;
+	int width = 400;
+	int height = 240;
+	int views = 45;
+	// Calibration values, via: https://jakedowns.github.io/looking-glass-calibration.html
+	float slope = -7.083540916442871f;
+	float center = 0.8167931437492371f;
+	float pitch = 52.59267044067383f;
+	// Largest horizontal shift between the outermost views, as a fraction of the frame width
+	float strength = 0.04f;
+	// Normalized depth that stays at the plane of the display
+	float focus = 0.5f;
+	// Pixels of the quilt relative to a quilt where every view has the input resolution, taken from the views at steep angles first
+	float quilt_budget = 1.0f;
+	// Also render every frame from a full resolution quilt and report how much the output differs from it
+	bool quality_report = false;
+	// Only render the views and interlace the panel again where the input changed since the previous frame
+	bool dirty_tiles = true;
+	size_t queue_size = 4;
+	unsigned int threads = 0;
+};
+
+// Input tiles in which color or depth changed since the previous frame
+struct dirty_tiles
+{
+	int columns = 0, rows = 0;
+	// Empty when everything has to be rendered again (e.g. for the first frame)
+	std::vector<uint8_t> tiles;
+
+	bool all() const { return tiles.empty(); }
+	bool is_dirty(int column, int row) const { return all() || tiles[static_cast<size_t>(row) * columns + column] != 0; }
+
+	// Whether any tile overlapping the input pixels from (x0, y0) to (x1, y1) (inclusive) changed
+	bool any(int x0, int y0, int x1, int y1) const
+	{
+		if (all())
+			return true;
+		for (int row = y0 / s_input_tile_size; row <= y1 / s_input_tile_size; ++row)
+			for (int column = x0 / s_input_tile_size; column <= x1 / s_input_tile_size; ++column)
+				if (tiles[static_cast<size_t>(row) * columns + column] != 0)
+					return true;
+		return false;
+	}
+
+	// Adds the changes of another frame, e.g. to know everything that changed over several frames
+	void merge(const dirty_tiles &other)
+	{
+		if (all())
+			return;
+		if (other.all() || other.tiles.size() != tiles.size())
+		{
+			tiles.clear();
+			return;
+		}
+		for (size_t i = 0; i < tiles.size(); ++i)
+			tiles[i] |= other.tiles[i];
+	}
+};
+
+struct frame
+{
+	uint64_t index = 0;
+	std::vector<uint8_t> color; // RGBA8, width x height
+	std::vector<float> depth; // One float per pixel, normalized to [0, 1] (0 = near) by the normalization stage
+	std::vector<uint8_t> views; // RGB8, quilt with the layout of 'quilt_atlas'
+	std::vector<uint8_t> reference_views; // RGB8, full resolution quilt for '--quality-report'
+	std::vector<uint8_t> output; // RGB8, panel resolution
+	dirty_tiles dirty; // Set by the normalization stage, in the target columns of view synthesis (see 'change_detector')
+};
+
+// Where a view is stored in the quilt
+struct quilt_view
+{
+	int x = 0, y = 0;
+	int width = 0, height = 0;
+};
+
+// Quilt in which every view can have its own resolution, so that views at steep angles (which are seen through fewer lenticules and at the edge of the viewing cone) can take fewer pixels than the ones in the middle
+struct quilt_atlas
+{
+	int width = 0, height = 0;
+	std::vector<quilt_view> views;
+	// First row of every view when the rows of all views are numbered one after another, plus the total at the end
+	std::vector<int> first_rows;
+};
+
+// Assigns every view a scale from its viewing angle, so that the sum of all view areas stays within the budget, and packs them into rows
+inline quilt_atlas pack_quilt(const options &options, float budget)
+{
+	// Views at the edge of the viewing cone get a quarter of the weight of the center view
+	std::vector<float> weights(options.views);
+	for (int view = 0; view < options.views; ++view)
+	{
+		const float position = options.views > 1 ? 2.0f * view / (options.views - 1) - 1.0f : 0.0f;
+		weights[view] = 1.0f - 0.75f * position * position;
+	}
+
+	// Area of a view is proportional to its weight times a factor, found by bisection so that the total matches the budget (no view is larger than the input or smaller than 1/16 of it)
+	const auto scale_of = [](float weight, float factor) { return std::clamp(std::sqrt(weight * factor), 0.25f, 1.0f); };
+	float low = 0.0f, high = 16.0f;
+	for (int iteration = 0; iteration < 32; ++iteration)
+	{
+		const float factor = (low + high) * 0.5f;
+		float area = 0.0f;
+		for (const float weight : weights)
+			area += scale_of(weight, factor) * scale_of(weight, factor);
+		if (area > budget * options.views)
+			high = factor;
+		else
+			low = factor;
+	}
+
+	quilt_atlas atlas;
+	atlas.views.resize(options.views);
+	for (int view = 0; view < options.views; ++view)
+	{
+		const float scale = budget >= 1.0f ? 1.0f : scale_of(weights[view], low);
+		atlas.views[view].width = std::max(1, static_cast<int>(std::lround(options.width * scale)));
+		atlas.views[view].height = std::max(1, static_cast<int>(std::lround(options.height * scale)));
+	}
+
+	// Shelf packing, from the largest to the smallest view, in rows about as wide as a square quilt of full resolution views would be
+	std::vector<int> order(options.views);
+	for (int view = 0; view < options.views; ++view)
+		order[view] = view;
+	std::stable_sort(order.begin(), order.end(), [&atlas](int a, int b) { return atlas.views[a].height > atlas.views[b].height; });
+
+	atlas.width = options.width * static_cast<int>(std::ceil(std::sqrt(static_cast<float>(options.views))));
+	int x = 0, y = 0, shelf_height = 0;
+	for (const int view : order)
+	{
+		quilt_view &region = atlas.views[view];
+		if (x + region.width > atlas.width)
+		{
+			x = 0;
+			y += shelf_height;
+			shelf_height = 0;
+		}
+		region.x = x;
+		region.y = y;
+		x += region.width;
+		shelf_height = std::max(shelf_height, region.height);
+	}
+	atlas.height = y + shelf_height;
+
+	atlas.first_rows.push_back(0);
+	for (const quilt_view &region : atlas.views)
+		atlas.first_rows.push_back(atlas.first_rows.back() + region.height);
+
+	return atlas;
+}
+
+// Pool of workers that the stages share for their data-parallel loops, so that whichever stage is the bottleneck gets all idle cores
+class thread_pool
+{
+public:
+	explicit thread_pool(unsigned int count)
+	{
+		for (unsigned int i = 0; i < count; ++i)
+			_workers.emplace_back([this]() { run(); });
+	}
+	~thread_pool()
+	{
+		{
+			const std::lock_guard<std::mutex> lock(_mutex);
+			_stopping = true;
+		}
+		_wake.notify_all();
+		for (std::thread &worker : _workers)
+			worker.join();
+	}
+
+	// Calls 'body' for every index in [0, count), with idle workers taking indices from a shared counter
+	void parallel_for(int count, const std::function<void(int)> &body)
+	{
+		struct job
+		{
+			std::atomic<int> next = 0;
+			std::mutex mutex;
+			std::condition_variable done;
+			// Helpers that took part in the loop and have not finished yet, and whether the calling thread finished it (after which helpers that start late do nothing)
+			int active_helpers = 0;
+			bool finished = false;
+		};
+
+		const auto shared_job = std::make_shared<job>();
+		const auto work = [shared_job, count, &body]() {
+			for (int i; (i = shared_job->next++) < count;)
+				body(i);
+		};
+
+		const int helpers = static_cast<int>(std::min<size_t>(_workers.size(), count > 1 ? count - 1 : 0));
+		{
+			const std::lock_guard<std::mutex> lock(_mutex);
+			for (int i = 0; i < helpers; ++i)
+			{
+				_tasks.push_back([shared_job, work]() {
+					{
+						const std::lock_guard<std::mutex> job_lock(shared_job->mutex);
+						if (shared_job->finished)
+							return;
+						shared_job->active_helpers++;
+					}
+					work();
+					const std::lock_guard<std::mutex> job_lock(shared_job->mutex);
+					if (--shared_job->active_helpers == 0)
+						shared_job->done.notify_all();
+				});
+			}
+		}
+		_wake.notify_all();
+
+		// The calling stage works on its own loop too, so the loop finishes even when all workers are busy with other stages
+		work();
+
+		// Only wait for helpers that are still working on an index of this loop, the ones that did not start yet are skipped when a worker gets to them
+		std::unique_lock<std::mutex> job_lock(shared_job->mutex);
+		shared_job->finished = true;
+		shared_job->done.wait(job_lock, [&shared_job]() { return shared_job->active_helpers == 0; });
+	}
+
+private:
+	void run()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_wake.wait(lock, [this]() { return !_tasks.empty() || _stopping; });
+				if (_tasks.empty())
+					return;
+				task = std::move(_tasks.front());
+				_tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread> _workers;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::deque<std::function<void()>> _tasks;
+	bool _stopping = false;
+};
+
+// Maps depth to [0, 1] using the range of the current frame, smoothed over time so that the scene does not pump when objects enter or leave
+inline void normalize_depth(frame &frame, float &smoothed_min, float &smoothed_max)
+{
+	float min_depth = 1.0f, max_depth = 0.0f;
+	for (const float depth : frame.depth)
+	{
+		// Skip the far plane (sky and cleared areas), which would otherwise compress the interesting range
+		if (depth >= 1.0f)
+			continue;
+		min_depth = std::min(min_depth, depth);
+		max_depth = std::max(max_depth, depth);
+	}
+	if (min_depth > max_depth)
+	{
+		min_depth = 0.0f;
+		max_depth = 1.0f;
+	}
+
+	if (frame.index == 0)
+	{
+		smoothed_min = min_depth;
+		smoothed_max = max_depth;
+	}
+	smoothed_min += (min_depth - smoothed_min) * 0.1f;
+	smoothed_max += (max_depth - smoothed_max) * 0.1f;
+
+	const float scale = 1.0f / std::max(smoothed_max - smoothed_min, 1e-6f);
+	for (float &depth : frame.depth)
+		depth = std::clamp((depth - smoothed_min) * scale, 0.0f, 1.0f);
+}
+
+// Renders pixels 'x_begin' to 'x_end' of row 'row' of view 'view' out of 'options.views' (from left to right) into their place in the quilt, by shifting every pixel horizontally according to its depth
+inline void synthesize_view(const options &options, const frame &frame, const quilt_atlas &atlas, std::vector<uint8_t> &quilt, int view, int row, int x_begin, int x_end)
+{
+	const quilt_view &region = atlas.views[view];
+	const float position = options.views > 1 ? static_cast<float>(view) / (options.views - 1) - 0.5f : 0.0f;
+	// Shift is in input pixels, so it stays the same for views of lower resolution
+	const float shift = position * options.strength * options.width;
+
+	const int source_y = std::min(row * options.height / region.height, options.height - 1);
+	const uint8_t *const color_row = frame.color.data() + static_cast<size_t>(source_y) * options.width * 4;
+	const float *const depth_row = frame.depth.data() + static_cast<size_t>(source_y) * options.width;
+	uint8_t *const view_row = quilt.data() + (static_cast<size_t>(region.y + row) * atlas.width + region.x) * 3;
+
+	for (int x = x_begin; x < x_end; ++x)
+	{
+		// Backward warp using the depth at the target pixel, which leaves no holes (at the cost of slightly stretched edges)
+		const int target_x = std::min(x * options.width / region.width, options.width - 1);
+		const int source_x = std::clamp(static_cast<int>(std::lround(target_x - shift * (options.focus - depth_row[target_x]))), 0, options.width - 1);
+		std::memcpy(view_row + x * 3, color_row + source_x * 4, 3);
+	}
+}
+
+inline size_t quilt_pixels(const quilt_atlas &atlas)
+{
+	size_t pixels = 0;
+	for (const quilt_view &region : atlas.views)
+		pixels += static_cast<size_t>(region.width) * region.height;
+	return pixels;
+}
+
+// Renders all views of the quilt, spread over the pool by row
+inline void synthesize_quilt(const options &options, thread_pool &pool, const frame &frame, const quilt_atlas &atlas, std::vector<uint8_t> &quilt)
+{
+	quilt.assign(static_cast<size_t>(atlas.width) * atlas.height * 3, 0);
+	pool.parallel_for(atlas.first_rows.back(), [&](int i) {
+		const int view = static_cast<int>(std::upper_bound(atlas.first_rows.begin(), atlas.first_rows.end(), i) - atlas.first_rows.begin()) - 1;
+		synthesize_view(options, frame, atlas, quilt, view, i - atlas.first_rows[view], 0, atlas.views[view].width);
+	});
+}
+
+// Interlaces pixels 'x_begin' to 'x_end' of panel row 'y'
+// Same math as 'lookingglass.glsl', except that the input is upright here (Citra keeps the rotation of the 3DS screens, the add-on captures do not)
+inline void interlace_row(const options &options, const quilt_atlas &atlas, const std::vector<uint8_t> &quilt, std::vector<uint8_t> &output, int y, int x_begin = 0, int x_end = s_panel_width)
+{
+	const float tilt = static_cast<float>(s_panel_height) / (s_panel_width * options.slope);
+	const float pitch_adjusted = options.pitch * s_panel_width / s_panel_dpi * std::cos(std::atan2(1.0f, options.slope));
+	const float subp = 1.0f / (3.0f * s_panel_width) * pitch_adjusted;
+
+	const float v = (y + 0.5f) / s_panel_height;
+	uint8_t *const output_row = output.data() + static_cast<size_t>(y) * s_panel_width * 3;
+
+	for (int x = x_begin; x < x_end; ++x)
+	{
+		const float u = (x + 0.5f) / s_panel_width;
+		const float alpha = (u + v * tilt) * pitch_adjusted - options.center;
+
+		// The r,g,b subpixels are each shifted by one extra "subpixel" amount to match the sub-pixel layout of the panel
+		for (int channel = 0; channel < 3; ++channel)
+		{
+			const float phase = alpha + channel * subp;
+			const int view = std::min(static_cast<int>((phase - std::floor(phase)) * options.views), options.views - 1);
+
+			// Every view covers the whole frame, at its own resolution
+			const quilt_view &region = atlas.views[view];
+			const int source_x = region.x + std::min(static_cast<int>(u * region.width), region.width - 1);
+			const int source_y = region.y + std::min(static_cast<int>(v * region.height), region.height - 1);
+			output_row[x * 3 + channel] = quilt[(static_cast<size_t>(source_y) * atlas.width + source_x) * 3 + channel];
+		}
+	}
+}
+
+// Keeps a hash of color and normalized depth of every input tile, to find the tiles that changed in the next frame
+class change_detector
+{
+public:
+	// Returns the changed tiles, widened by the farthest view synthesis moves a pixel, so that they contain the target column of every quilt pixel that reads from a changed input pixel
+	dirty_tiles update(const options &options, const frame &frame)
+	{
+		dirty_tiles dirty;
+		dirty.columns = (options.width + s_input_tile_size - 1) / s_input_tile_size;
+		dirty.rows = (options.height + s_input_tile_size - 1) / s_input_tile_size;
+
+		std::vector<uint64_t> hashes(static_cast<size_t>(dirty.columns) * dirty.rows, 14695981039346656037ull);
+		for (int y = 0; y < options.height; ++y)
+		{
+			uint64_t *const row_hashes = hashes.data() + static_cast<size_t>(y / s_input_tile_size) * dirty.columns;
+			for (int x = 0; x < options.width; ++x)
+			{
+				const size_t i = static_cast<size_t>(y) * options.width + x;
+				uint32_t color, depth;
+				std::memcpy(&color, frame.color.data() + i * 4, 4);
+				std::memcpy(&depth, frame.depth.data() + i, 4);
+				uint64_t &hash = row_hashes[x / s_input_tile_size];
+				hash = (hash ^ (static_cast<uint64_t>(color) << 32 | depth)) * 1099511628211ull;
+			}
+		}
+
+		// The first frame, or one of a different size, is rendered completely
+		if (hashes.size() == _hashes.size())
+		{
+			// Shift of the outermost views at the depth farthest from the focus, plus rounding
+			const float max_shift = 0.5f * std::abs(options.strength) * options.width * std::max(std::abs(options.focus), std::abs(1.0f - options.focus)) + 1.0f;
+			const int reach = static_cast<int>(std::ceil(max_shift / s_input_tile_size));
+
+			dirty.tiles.assign(hashes.size(), 0);
+			for (int row = 0; row < dirty.rows; ++row)
+			{
+				for (int column = 0; column < dirty.columns; ++column)
+				{
+					const size_t i = static_cast<size_t>(row) * dirty.columns + column;
+					if (hashes[i] == _hashes[i])
+						continue;
+					for (int neighbor = std::max(0, column - reach); neighbor <= std::min(dirty.columns - 1, column + reach); ++neighbor)
+						dirty.tiles[static_cast<size_t>(row) * dirty.columns + neighbor] = 1;
+				}
+			}
+		}
+
+		_hashes = std::move(hashes);
+		return dirty;
+	}
+
+private:
+	std::vector<uint64_t> _hashes;
+};
+
+// Calls 'callback(view, row, x_begin, x_end)' for the spans of quilt rows whose target columns are in changed tiles, spread over the pool by row
+template <typename F>
+inline void for_each_changed_quilt_span(const options &options, thread_pool &pool, const dirty_tiles &dirty, const quilt_atlas &atlas, F &&callback)
+{
+	pool.parallel_for(atlas.first_rows.back(), [&](int i) {
+		const int view = static_cast<int>(std::upper_bound(atlas.first_rows.begin(), atlas.first_rows.end(), i) - atlas.first_rows.begin()) - 1;
+		const int row = i - atlas.first_rows[view];
+		const quilt_view &region = atlas.views[view];
+
+		// Same source row and target columns as in 'synthesize_view'
+		const int tile_row = std::min(row * options.height / region.height, options.height - 1) / s_input_tile_size;
+		const auto first_x_in_column = [&](int column) {
+			return std::min(region.width, static_cast<int>((static_cast<int64_t>(column) * s_input_tile_size * region.width + options.width - 1) / options.width));
+		};
+
+		for (int column = 0; column < dirty.columns; ++column)
+		{
+			if (!dirty.is_dirty(column, tile_row))
+				continue;
+			// Take neighboring changed tiles in one go
+			const int first_column = column;
+			while (column + 1 < dirty.columns && dirty.is_dirty(column + 1, tile_row))
+				++column;
+
+			callback(view, row, first_x_in_column(first_column), first_x_in_column(column + 1));
+		}
+	});
+}
+
+// Renders the views again where their target columns are in changed tiles, keeping the rest of 'quilt' from the previous frame, and returns the number of pixels rendered
+inline size_t update_quilt(const options &options, thread_pool &pool, const frame &frame, const dirty_tiles &dirty, const quilt_atlas &atlas, std::vector<uint8_t> &quilt)
+{
+	if (dirty.all() || quilt.size() != static_cast<size_t>(atlas.width) * atlas.height * 3)
+	{
+		synthesize_quilt(options, pool, frame, atlas, quilt);
+		return quilt_pixels(atlas);
+	}
+
+	std::atomic<size_t> pixels = 0;
+	for_each_changed_quilt_span(options, pool, dirty, atlas, [&](int view, int row, int x_begin, int x_end) {
+		synthesize_view(options, frame, atlas, quilt, view, row, x_begin, x_end);
+		pixels += x_end - x_begin;
+	});
+	return pixels;
+}
+
+// Copies the pixels 'update_quilt' renders for the changed tiles from one quilt to another
+inline void copy_changed_quilt(const options &options, thread_pool &pool, const dirty_tiles &dirty, const quilt_atlas &atlas, const std::vector<uint8_t> &source, std::vector<uint8_t> &target)
+{
+	for_each_changed_quilt_span(options, pool, dirty, atlas, [&](int view, int row, int x_begin, int x_end) {
+		const quilt_view &region = atlas.views[view];
+		const size_t offset = (static_cast<size_t>(region.y + row) * atlas.width + region.x + x_begin) * 3;
+		std::memcpy(target.data() + offset, source.data() + offset, static_cast<size_t>(x_end - x_begin) * 3);
+	});
+}
+
+// Calls 'callback(y, x_begin, x_end)' for the spans of panel rows that show quilt pixels with a target column in a changed tile, spread over the pool by row
+template <typename F>
+inline void for_each_changed_panel_span(const options &options, thread_pool &pool, const dirty_tiles &dirty, const quilt_atlas &atlas, F &&callback)
+{
+	// A panel tile is changed if any view it shows reads a quilt pixel with a target column in a changed tile
+	// The quilt position grows with the panel position, so the corners of the tile bound the input pixels it reads (with the same math as in 'interlace_row' and 'synthesize_view')
+	const int panel_columns = (s_panel_width + s_panel_tile_size - 1) / s_panel_tile_size;
+	const int panel_rows = (s_panel_height + s_panel_tile_size - 1) / s_panel_tile_size;
+	std::vector<uint8_t> panel_tiles(static_cast<size_t>(panel_columns) * panel_rows);
+	pool.parallel_for(panel_rows, [&](int panel_row) {
+		const float v0 = (panel_row * s_panel_tile_size + 0.5f) / s_panel_height;
+		const float v1 = (std::min((panel_row + 1) * s_panel_tile_size, s_panel_height) - 0.5f) / s_panel_height;
+
+		for (int panel_column = 0; panel_column < panel_columns; ++panel_column)
+		{
+			const float u0 = (panel_column * s_panel_tile_size + 0.5f) / s_panel_width;
+			const float u1 = (std::min((panel_column + 1) * s_panel_tile_size, s_panel_width) - 0.5f) / s_panel_width;
+
+			int x0 = options.width, y0 = options.height, x1 = 0, y1 = 0;
+			for (const quilt_view &region : atlas.views)
+			{
+				const auto target_x = [&](float u) { return std::min(std::min(static_cast<int>(u * region.width), region.width - 1) * options.width / region.width, options.width - 1); };
+				const auto source_y = [&](float v) { return std::min(std::min(static_cast<int>(v * region.height), region.height - 1) * options.height / region.height, options.height - 1); };
+				x0 = std::min(x0, target_x(u0));
+				x1 = std::max(x1, target_x(u1));
+				y0 = std::min(y0, source_y(v0));
+				y1 = std::max(y1, source_y(v1));
+			}
+
+			panel_tiles[static_cast<size_t>(panel_row) * panel_columns + panel_column] = dirty.any(x0, y0, x1, y1);
+		}
+	});
+
+	pool.parallel_for(s_panel_height, [&](int y) {
+		const uint8_t *const row_tiles = panel_tiles.data() + static_cast<size_t>(y / s_panel_tile_size) * panel_columns;
+
+		for (int panel_column = 0; panel_column < panel_columns; ++panel_column)
+		{
+			if (!row_tiles[panel_column])
+				continue;
+			const int first_column = panel_column;
+			while (panel_column + 1 < panel_columns && row_tiles[panel_column + 1])
+				++panel_column;
+
+			callback(y, first_column * s_panel_tile_size, std::min((panel_column + 1) * s_panel_tile_size, s_panel_width));
+		}
+	});
+}
+
+// Interlaces the panel again where it shows quilt pixels that 'update_quilt' rendered again, keeping the rest of 'output' from the previous frame, and returns the number of pixels interlaced
+inline size_t update_panel(const options &options, thread_pool &pool, const dirty_tiles &dirty, const quilt_atlas &atlas, const std::vector<uint8_t> &quilt, std::vector<uint8_t> &output)
+{
+	if (dirty.all() || output.size() != static_cast<size_t>(s_panel_width) * s_panel_height * 3)
+	{
+		output.resize(static_cast<size_t>(s_panel_width) * s_panel_height * 3);
+		pool.parallel_for(s_panel_height, [&](int y) {
+			interlace_row(options, atlas, quilt, output, y);
+		});
+		return static_cast<size_t>(s_panel_width) * s_panel_height;
+	}
+
+	std::atomic<size_t> pixels = 0;
+	for_each_changed_panel_span(options, pool, dirty, atlas, [&](int y, int x_begin, int x_end) {
+		interlace_row(options, atlas, quilt, output, y, x_begin, x_end);
+		pixels += x_end - x_begin;
+	});
+	return pixels;
+}
+
+// Copies the pixels 'update_panel' interlaces for the changed tiles from one panel frame to another
+inline void copy_changed_panel(const options &options, thread_pool &pool, const dirty_tiles &dirty, const quilt_atlas &atlas, const std::vector<uint8_t> &source, std::vector<uint8_t> &target)
+{
+	for_each_changed_panel_span(options, pool, dirty, atlas, [&](int y, int x_begin, int x_end) {
+		const size_t offset = (static_cast<size_t>(y) * s_panel_width + x_begin) * 3;
+		std::memcpy(target.data() + offset, source.data() + offset, static_cast<size_t>(x_end - x_begin) * 3);
+	});
+}
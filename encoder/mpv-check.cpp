@@ -0,0 +1,95 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Checks that the color + depth mode of 'looking-glass-mpv.glsl' shows the same views as 'lkg-encode', by porting the hook to C++ and comparing the panel frames of both
+ * Build with: g++ -std=c++17 -O2 -pthread mpv-check.cpp -o mpv-check
+ */
+
+#include "lkg-views.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+	// Color is a ramp along x in all channels, so that the difference of two panel subpixels is how far apart the input pixels they show are
+	// Depth has a slope and a box in front, so that the views differ
+	void generate_frame(const options &options, frame &frame)
+	{
+		frame.color.resize(static_cast<size_t>(options.width) * options.height * 4);
+		frame.depth.resize(static_cast<size_t>(options.width) * options.height);
+		for (int y = 0; y < options.height; ++y)
+		{
+			for (int x = 0; x < options.width; ++x)
+			{
+				const size_t i = static_cast<size_t>(y) * options.width + x;
+				const uint8_t ramp = static_cast<uint8_t>(x * 255 / (options.width - 1));
+				frame.color[i * 4 + 0] = frame.color[i * 4 + 1] = frame.color[i * 4 + 2] = ramp;
+				frame.color[i * 4 + 3] = 255;
+				const bool box = x >= options.width / 3 && x < options.width / 2 && y >= options.height / 4 && y < options.height * 3 / 4;
+				frame.depth[i] = box ? 0.1f : static_cast<float>(y) / options.height;
+			}
+		}
+	}
+
+	// The hook with 'INPUT_LAYOUT' 1, for panel pixel 'x', 'y' (where 'HOOKED_pos' is the center of the pixel, starting at the top left)
+	// Texture lookups are nearest instead of bilinear, which is what the comparison allows for
+	void mpv_hook(const options &options, const frame &frame, int x, int y, uint8_t *output)
+	{
+		const float tilt = static_cast<float>(s_panel_height) / (s_panel_width * options.slope);
+		const float pitch_adjusted = options.pitch * s_panel_width / s_panel_dpi * std::cos(std::atan2(1.0f, options.slope));
+		const float subp = 1.0f / (3.0f * s_panel_width) * pitch_adjusted;
+
+		const float pos_x = (x + 0.5f) / s_panel_width, pos_y = (y + 0.5f) / s_panel_height;
+		const float alpha = (pos_x + pos_y * tilt) * pitch_adjusted - options.center;
+
+		const int source_y = std::min(static_cast<int>(pos_y * options.height), options.height - 1);
+		const float depth = frame.depth[static_cast<size_t>(source_y) * options.width + std::min(static_cast<int>(pos_x * options.width), options.width - 1)];
+
+		for (int channel = 0; channel < 3; ++channel)
+		{
+			const float phase = alpha + channel * subp;
+			const float view_pos = phase - std::floor(phase);
+			// 'synthesize_view' in the shader, in uv of the color half
+			const float shift = (view_pos - 0.5f) * options.strength * (options.focus - depth);
+			const float u = std::clamp(pos_x - shift, 0.0f, 1.0f);
+			const int source_x = std::min(static_cast<int>(u * options.width), options.width - 1);
+			output[channel] = frame.color[(static_cast<size_t>(source_y) * options.width + source_x) * 4 + channel];
+		}
+	}
+}
+
+int main()
+{
+	options options;
+	const quilt_atlas atlas = pack_quilt(options, 1.0f);
+
+	const unsigned int thread_count = std::max(1u, std::thread::hardware_concurrency());
+	thread_pool pool(thread_count > 1 ? thread_count - 1 : 0);
+
+	frame frame;
+	generate_frame(options, frame);
+
+	std::vector<uint8_t> quilt, encoder_output(static_cast<size_t>(s_panel_width) * s_panel_height * 3), mpv_output(encoder_output.size());
+	synthesize_quilt(options, pool, frame, atlas, quilt);
+	pool.parallel_for(s_panel_height, [&](int y) {
+		interlace_row(options, atlas, quilt, encoder_output, y);
+		for (int x = 0; x < s_panel_width; ++x)
+			mpv_hook(options, frame, x, y, mpv_output.data() + (static_cast<size_t>(y) * s_panel_width + x) * 3);
+	});
+
+	// The encoder rounds to one of its views and to whole input pixels, the shader does not, so allow one input pixel of difference (plus the rounding of the ramp)
+	const int tolerance = 255 / (options.width - 1) + 1;
+	int max_difference = 0;
+	size_t differing = 0;
+	for (size_t i = 0; i < encoder_output.size(); ++i)
+	{
+		const int difference = std::abs(encoder_output[i] - mpv_output[i]);
+		max_difference = std::max(max_difference, difference);
+		differing += difference > tolerance ? 1 : 0;
+	}
+
+	std::printf("largest difference %d (%.2f input pixels), %zu of %zu subpixels further apart than one input pixel\n",
+		max_difference, max_difference * (options.width - 1) / 255.0f, differing, encoder_output.size());
+
+	return differing == 0 ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Checks the normals 'Citra.fx' reconstructs from normalized depth (with CITRA_NORMALS set), by porting its normal pass to C++ and running it on depth of known geometry
+ * Build with: g++ -std=c++17 -O2 normals-check.cpp -o normals-check
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+	struct float3
+	{
+		float x, y, z;
+
+		float3 operator+(const float3 &other) const { return { x + other.x, y + other.y, z + other.z }; }
+		float3 operator-(const float3 &other) const { return { x - other.x, y - other.y, z - other.z }; }
+		float3 operator*(float scale) const { return { x * scale, y * scale, z * scale }; }
+	};
+
+	float dot(const float3 &a, const float3 &b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+	float3 cross(const float3 &a, const float3 &b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+	float3 normalize(const float3 &v)
+	{
+		return v * (1.0f / std::sqrt(dot(v, v)));
+	}
+
+	// Size of the top screen at 3x internal resolution
+	const int s_width = 1200, s_height = 720;
+	const float s_aspect_ratio = static_cast<float>(s_width) / s_height;
+
+	// 'GetPosition' in the shader
+	float3 position(float u, float v, float depth)
+	{
+		return { (u * 2.0f - 1.0f) * s_aspect_ratio * depth, (v * 2.0f - 1.0f) * depth, depth };
+	}
+
+	// 'GetNormal' in the shader, for the texel at 'x', 'y' of the depth texture, returned encoded like in the RGBA8 texture
+	// Fetches outside of the texture are clamped to the edge, like with the default address mode of the sampler
+	void normal_pass(const std::vector<float> &depth, int x, int y, uint8_t *output)
+	{
+		const auto fetch = [&depth](int x, int y) {
+			return depth[static_cast<size_t>(std::clamp(y, 0, s_height - 1)) * s_width + std::clamp(x, 0, s_width - 1)];
+		};
+		const auto neighbor = [&fetch](int x, int y) {
+			return position((x + 0.5f) / s_width, (y + 0.5f) / s_height, fetch(x, y));
+		};
+
+		const float3 center = neighbor(x, y);
+		const float3 left = neighbor(x - 1, y), right = neighbor(x + 1, y);
+		const float3 up = neighbor(x, y - 1), down = neighbor(x, y + 1);
+
+		const bool use_right = x + 1 < s_width && (x == 0 || std::abs(right.z - center.z) < std::abs(center.z - left.z));
+		const bool use_down = y + 1 < s_height && (y == 0 || std::abs(down.z - center.z) < std::abs(center.z - up.z));
+		const float3 dx = use_right ? right - center : center - left;
+		const float3 dy = use_down ? down - center : center - up;
+
+		const float3 normal = normalize(cross(dy, dx));
+		output[0] = static_cast<uint8_t>(std::lround((normal.x * 0.5f + 0.5f) * 255.0f));
+		output[1] = static_cast<uint8_t>(std::lround((normal.y * 0.5f + 0.5f) * 255.0f));
+		output[2] = static_cast<uint8_t>(std::lround((normal.z * 0.5f + 0.5f) * 255.0f));
+	}
+
+	// Plane of the points 'p' with dot(normal, p) == distance, facing the camera (so the normal points towards negative z)
+	struct plane
+	{
+		float3 normal;
+		float distance;
+
+		// Depth where the ray through the pixel center hits the plane
+		float depth(int x, int y) const
+		{
+			return distance / dot(normal, position((x + 0.5f) / s_width, (y + 0.5f) / s_height, 1.0f));
+		}
+	};
+}
+
+int main()
+{
+	// A tilted wall, with a box in front of it that faces the camera
+	const plane wall = { normalize({ 0.2f, -0.3f, -0.93f }), -0.7f };
+	const plane box = { { 0.0f, 0.0f, -1.0f }, -0.2f };
+	const auto in_box = [](int x, int y) { return x >= s_width / 3 && x < s_width * 2 / 3 && y >= s_height / 4 && y < s_height * 3 / 4; };
+
+	std::vector<float> depth(static_cast<size_t>(s_width) * s_height);
+	for (int y = 0; y < s_height; ++y)
+		for (int x = 0; x < s_width; ++x)
+			depth[static_cast<size_t>(y) * s_width + x] = in_box(x, y) ? box.depth(x, y) : wall.depth(x, y);
+
+	// The texture has 8 bits per component, so allow for that rounding
+	const float min_dot = std::cos(2.0f * 3.14159265f / 180.0f);
+	float worst_dot = 1.0f;
+	size_t wrong = 0, wrong_at_edges = 0;
+	for (int y = 0; y < s_height; ++y)
+	{
+		for (int x = 0; x < s_width; ++x)
+		{
+			uint8_t encoded[3];
+			normal_pass(depth, x, y, encoded);
+			const float3 normal = normalize({ encoded[0] / 127.5f - 1.0f, encoded[1] / 127.5f - 1.0f, encoded[2] / 127.5f - 1.0f });
+
+			const float similarity = dot(normal, in_box(x, y) ? box.normal : wall.normal);
+			worst_dot = std::min(worst_dot, similarity);
+			if (similarity < min_dot)
+			{
+				wrong++;
+				const bool at_edge = in_box(x, y) != in_box(x - 1, y) || in_box(x, y) != in_box(x + 1, y) || in_box(x, y) != in_box(x, y - 1) || in_box(x, y) != in_box(x, y + 1);
+				wrong_at_edges += at_edge ? 1 : 0;
+			}
+		}
+	}
+
+	std::printf("largest error %.2f degrees, %zu of %zu normals off by more than 2 degrees (%zu of them next to the box)\n",
+		std::acos(std::min(worst_dot, 1.0f)) * 180.0f / 3.14159265f, wrong, depth.size(), wrong_at_edges);
+
+	return wrong == 0 ? 0 : 1;
+}
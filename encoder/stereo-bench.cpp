@@ -0,0 +1,223 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Measures how fast 'stereo-match.hpp' reconstructs disparity at the resolution of a 3DS eye, and checks it against the depth the stereo pair was rendered from
+ * The right eye is rendered from the left one and its depth with the same mapping from depth to shift that 'lkg-encode' uses, either for generated frames or for captures of the add-on
+ * Build with: g++ -std=c++17 -O2 -pthread stereo-bench.cpp -o stereo-bench
+ */
+
+#include "stereo-match.hpp"
+#include "../Citra AddOn/citra_capture.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+
+namespace
+{
+	// Size of one eye of the top screen at native resolution
+	const int s_width = 400, s_height = 240;
+	// Disparity of the nearest depth (normalized depth 0), the farthest (1) has none
+	const float s_near_disparity = s_stereo_disparities - 2.0f;
+
+	// Textured floor and back wall with a few boxes in front of them, moving with 'index' (depth is already normalized)
+	void generate_frame(uint64_t index, std::mt19937 &random, frame &frame)
+	{
+		frame.index = index;
+		frame.color.resize(static_cast<size_t>(s_width) * s_height * 4);
+		frame.depth.resize(static_cast<size_t>(s_width) * s_height);
+
+		struct box { int x, y, width, height; float depth; uint8_t r, g, b; };
+		const int offset = static_cast<int>(index % 64);
+		const box boxes[] = {
+			{ 40 + offset, 60, 90, 110, 0.15f, 200, 60, 50 },
+			{ 220 - offset, 100, 70, 60, 0.35f, 60, 180, 70 },
+			{ 300, 30 + offset, 60, 70, 0.05f, 70, 90, 210 },
+		};
+
+		std::uniform_int_distribution<int> noise(-24, 24);
+		for (int y = 0; y < s_height; ++y)
+		{
+			for (int x = 0; x < s_width; ++x)
+			{
+				const size_t i = static_cast<size_t>(y) * s_width + x;
+				// Back wall in the upper half, floor coming closer towards the bottom
+				float depth = y < s_height / 2 ? 0.95f : 0.95f - 0.8f * (y - s_height / 2) / (s_height / 2);
+				int r = 150, g = 140, b = 120;
+				for (const box &box : boxes)
+				{
+					if (x >= box.x && x < box.x + box.width && y >= box.y && y < box.y + box.height && box.depth < depth)
+					{
+						depth = box.depth;
+						r = box.r; g = box.g; b = box.b;
+					}
+				}
+
+				const int shade = noise(random);
+				frame.color[i * 4 + 0] = static_cast<uint8_t>(std::clamp(r + shade, 0, 255));
+				frame.color[i * 4 + 1] = static_cast<uint8_t>(std::clamp(g + shade, 0, 255));
+				frame.color[i * 4 + 2] = static_cast<uint8_t>(std::clamp(b + shade, 0, 255));
+				frame.color[i * 4 + 3] = 255;
+				frame.depth[i] = depth;
+			}
+		}
+	}
+
+	// Scales a capture of the add-on down to the size of one eye
+	bool read_capture_frame(citra_capture::reader &reader, frame &frame, float &smoothed_min, float &smoothed_max)
+	{
+		citra_capture::frame capture_frame;
+		while (reader.read(capture_frame))
+		{
+			const citra_capture::frame_info &info = capture_frame.info;
+			if (info.depth_width == 0 || info.depth_height == 0)
+				continue;
+
+			frame.color.resize(static_cast<size_t>(s_width) * s_height * 4);
+			frame.depth.resize(static_cast<size_t>(s_width) * s_height);
+			for (int y = 0; y < s_height; ++y)
+			{
+				for (int x = 0; x < s_width; ++x)
+				{
+					const size_t i = static_cast<size_t>(y) * s_width + x;
+					std::memcpy(frame.color.data() + i * 4, capture_frame.color.data() + (static_cast<size_t>(y) * info.color_height / s_height * info.color_width + static_cast<size_t>(x) * info.color_width / s_width) * 4, 4);
+					frame.depth[i] = capture_frame.depth[static_cast<size_t>(y) * info.depth_height / s_height * info.depth_width + static_cast<size_t>(x) * info.depth_width / s_width];
+				}
+			}
+			normalize_depth(frame, smoothed_min, smoothed_max);
+			frame.index++;
+			return true;
+		}
+		return false;
+	}
+
+	// Renders the right eye by moving every pixel of the left one by its disparity, nearer pixels winning, and returns the disparity of every left pixel, negative where it is hidden or outside of the right eye
+	std::vector<float> render_right_eye(const frame &frame, std::vector<uint8_t> &right)
+	{
+		std::vector<float> truth(static_cast<size_t>(s_width) * s_height);
+		right.assign(frame.color.size(), 0);
+
+		for (int y = 0; y < s_height; ++y)
+		{
+			std::vector<int> owner(s_width, -1);
+			for (int x = 0; x < s_width; ++x)
+			{
+				const float disparity = s_near_disparity * (1.0f - frame.depth[static_cast<size_t>(y) * s_width + x]);
+				truth[static_cast<size_t>(y) * s_width + x] = disparity;
+				const int target = x - static_cast<int>(std::lround(disparity));
+				if (target >= 0 && (owner[target] < 0 || disparity > truth[static_cast<size_t>(y) * s_width + owner[target]]))
+					owner[target] = x;
+			}
+
+			std::vector<bool> visible(s_width, false);
+			for (int target = 0; target < s_width; ++target)
+			{
+				// Holes are filled with the background next to them, like what the right eye would see there
+				int source = owner[target];
+				for (int neighbor = target + 1; source < 0 && neighbor < s_width; ++neighbor)
+					source = owner[neighbor];
+				if (source < 0)
+					source = s_width - 1;
+				if (owner[target] >= 0)
+					visible[owner[target]] = true;
+				std::memcpy(right.data() + (static_cast<size_t>(y) * s_width + target) * 4, frame.color.data() + (static_cast<size_t>(y) * s_width + source) * 4, 4);
+			}
+
+			for (int x = 0; x < s_width; ++x)
+				if (!visible[x])
+					truth[static_cast<size_t>(y) * s_width + x] = -1.0f;
+		}
+		return truth;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *capture_path = nullptr;
+	int frame_count = 30;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+			capture_path = argv[++i];
+		else
+			frame_count = std::max(1, std::atoi(argv[i]));
+	}
+
+	citra_capture::reader reader;
+	if (capture_path != nullptr && !reader.open(capture_path))
+	{
+		std::fprintf(stderr, "Failed to open \"%s\".\n", capture_path);
+		return 1;
+	}
+
+	const unsigned int thread_count = std::max(1u, std::thread::hardware_concurrency());
+	thread_pool pool(thread_count - 1);
+
+	stereo_matcher matcher;
+	const stereo_options options;
+	std::mt19937 random(42);
+	float smoothed_min = 0.0f, smoothed_max = 1.0f;
+
+	frame frame;
+	std::vector<uint8_t> right;
+	std::vector<float> disparity;
+	double match_time = 0.0;
+	size_t accepted = 0, compared = 0, within_one_pixel = 0;
+	double absolute_error = 0.0;
+	int frames = 0;
+	for (; frames < frame_count; ++frames)
+	{
+		if (capture_path != nullptr)
+		{
+			if (!read_capture_frame(reader, frame, smoothed_min, smoothed_max))
+				break;
+		}
+		else
+		{
+			generate_frame(frames, random, frame);
+		}
+
+		const std::vector<float> truth = render_right_eye(frame, right);
+
+		const auto start = std::chrono::steady_clock::now();
+		accepted += matcher.match(options, pool, frame.color.data(), right.data(), s_width, s_height, disparity);
+		match_time += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// Pixels that are hidden in the right eye have no true disparity, and the columns on the left edge cannot be matched at all
+		for (int y = 0; y < s_height; ++y)
+		{
+			for (int x = s_stereo_disparities; x < s_width; ++x)
+			{
+				const size_t i = static_cast<size_t>(y) * s_width + x;
+				if (truth[i] < 0.0f)
+					continue;
+				const float error = std::abs(disparity[i] - truth[i]);
+				absolute_error += error;
+				within_one_pixel += error <= 1.0f ? 1 : 0;
+				compared++;
+			}
+		}
+	}
+
+	if (frames == 0 || compared == 0)
+	{
+		std::fprintf(stderr, "No frames to match.\n");
+		return 1;
+	}
+
+	const double pixels = static_cast<double>(s_width) * s_height * frames;
+	const double good = 100.0 * within_one_pixel / compared;
+	std::printf("matching %dx%d, %d disparities, %u threads: %.2f ms per frame (%.0f frames per second)\n", s_width, s_height, s_stereo_disparities, thread_count, match_time / frames, 1000.0 * frames / match_time);
+	std::printf("passed the left-right check: %.1f%% of pixels\n", 100.0 * accepted / pixels);
+	std::printf("compared to the true disparity: %.1f%% within one pixel, mean error %.2f pixels\n", good, absolute_error / compared);
+
+	// Generated frames are textured everywhere, so nearly every visible pixel has to match
+	if (capture_path == nullptr && good < 90.0)
+	{
+		std::fprintf(stderr, "Only %.1f%% of the disparities are within one pixel of the truth.\n", good);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,315 @@
+/*
+ * 2022 Jake Downs
+ *
+ * Depth from the two eyes Citra renders, for the path without the add-on where only the stereo pair is available (see 'stereo-bench.cpp')
+ * Semi-global matching of census transforms, along the rows of the images (so the 3DS screens have to be upright, like in the add-on captures)
+ */
+
+#pragma once
+
+#include "lkg-views.hpp"
+
+// Number of disparities searched, from zero to this minus one pixels to the left in the right image
+// This is a constant so that the loops over it have a fixed length and get vectorized by the compiler
+static const int s_stereo_disparities = 32;
+
+struct stereo_options
+{
+	// Penalties for neighboring pixels whose disparity differs by one pixel, and by more than that
+	uint16_t small_penalty = 10;
+	uint16_t large_penalty = 120;
+	// Largest difference between the disparity matched from the left and from the right image for a pixel to be accepted
+	int consistency_tolerance = 1;
+};
+
+class stereo_matcher
+{
+public:
+	// Matches a pair of RGBA8 images and returns the disparity of every pixel of the left image in pixels (a point at 'x' in the left image is at 'x - disparity' in the right one)
+	// Pixels that fail the left-right check (mostly occlusions) take the farther disparity of their nearest accepted neighbors in the row
+	// Returns the number of pixels that passed the check
+	size_t match(const stereo_options &options, thread_pool &pool, const uint8_t *left, const uint8_t *right, int width, int height, std::vector<float> &disparity)
+	{
+		const size_t pixel_count = static_cast<size_t>(width) * height;
+		_width = width;
+		_height = height;
+		// Rows of luma have a border of two pixels for the census window, and are padded to full blocks
+		_luma_stride = (width + s_block_size - 1) / s_block_size * s_block_size + 4;
+		_luma_left.resize(static_cast<size_t>(_luma_stride) * (height + 4));
+		_luma_right.resize(static_cast<size_t>(_luma_stride) * (height + 4));
+		_census_left.resize(static_cast<size_t>(_luma_stride) * height);
+		_census_right.resize(static_cast<size_t>(_luma_stride) * height);
+		_costs.resize(pixel_count * s_stereo_disparities);
+		_aggregated.resize(pixel_count * s_stereo_disparities);
+		disparity.resize(pixel_count);
+
+		pool.parallel_for(height + 4, [&](int y) {
+			luma_row(left, _luma_left, y);
+			luma_row(right, _luma_right, y);
+		});
+		pool.parallel_for(height, [&](int y) {
+			census_row(_luma_left, _census_left, y);
+			census_row(_luma_right, _census_right, y);
+		});
+		pool.parallel_for(height, [&](int y) {
+			cost_row(y);
+			aggregate_row(options, y);
+		});
+		// Columns are aggregated in bands, so that every task walks along rows of memory
+		const int bands = (width + s_band_width - 1) / s_band_width;
+		pool.parallel_for(bands, [&](int band) {
+			aggregate_band(options, band * s_band_width, std::min(width, (band + 1) * s_band_width));
+		});
+
+		std::atomic<size_t> accepted = 0;
+		pool.parallel_for(height, [&](int y) {
+			accepted += select_row(options, y, disparity.data() + static_cast<size_t>(y) * width);
+		});
+		return accepted;
+	}
+
+private:
+	static const int s_band_width = 16;
+	// Pixels processed together by the loops over a row, so that these have a fixed length too
+	static const int s_block_size = 16;
+	// Costs are Hamming distances of 24-bit census values, so this is the largest one (used where the match would be outside of the right image)
+	static const uint16_t s_max_cost = 24;
+
+	// Only uses shifts and adds, which vectorize without the multiplication of 32-bit lanes that SSE2 lacks
+	static uint32_t bit_count(uint32_t value)
+	{
+		value = value - ((value >> 1) & 0x55555555u);
+		value = (value & 0x33333333u) + ((value >> 2) & 0x33333333u);
+		value = (value + (value >> 4)) & 0x0F0F0F0Fu;
+		value += value >> 8;
+		value += value >> 16;
+		return value & 0x3Fu;
+	}
+
+	// Row 'y' of the padded luma buffer, which is row 'y - 2' of the image with the edges repeated
+	void luma_row(const uint8_t *image, std::vector<uint16_t> &luma, int y) const
+	{
+		const uint8_t *const image_row = image + static_cast<size_t>(std::clamp(y - 2, 0, _height - 1)) * _width * 4;
+		uint16_t *const luma_row = luma.data() + static_cast<size_t>(y) * _luma_stride;
+		for (int x = 0; x < _luma_stride; ++x)
+		{
+			const uint8_t *const pixel = image_row + std::clamp(x - 2, 0, _width - 1) * 4;
+			luma_row[x] = static_cast<uint16_t>((pixel[0] * 77 + pixel[1] * 150 + pixel[2] * 29) >> 4);
+		}
+	}
+
+	// Bit per pixel of the 5x5 neighborhood (without the center) that is brighter than the center, which is robust to the exposure and color differences between the eyes
+	void census_row(const std::vector<uint16_t> &luma, std::vector<uint32_t> &census, int y) const
+	{
+		const uint16_t *const center_row = luma.data() + static_cast<size_t>(y + 2) * _luma_stride + 2;
+		uint32_t *const census_row = census.data() + static_cast<size_t>(y) * _luma_stride;
+
+		for (int x = 0; x < _width; x += s_block_size)
+		{
+			uint32_t values[s_block_size] = {};
+			for (int offset_y = -2; offset_y <= 2; ++offset_y)
+			{
+				for (int offset_x = -2; offset_x <= 2; ++offset_x)
+				{
+					if (offset_x == 0 && offset_y == 0)
+						continue;
+					const uint16_t *const neighbor_row = center_row + offset_y * _luma_stride + offset_x;
+					for (int i = 0; i < s_block_size; ++i)
+						values[i] = (values[i] << 1) | (neighbor_row[x + i] > center_row[x + i] ? 1u : 0u);
+				}
+			}
+			std::memcpy(census_row + x, values, sizeof(values));
+		}
+	}
+
+	void cost_row(int y)
+	{
+		const uint32_t *const census_left = _census_left.data() + static_cast<size_t>(y) * _luma_stride;
+		const uint32_t *const census_right = _census_right.data() + static_cast<size_t>(y) * _luma_stride;
+		uint8_t *const costs = _costs.data() + static_cast<size_t>(y) * _width * s_stereo_disparities;
+
+		// The first columns have disparities that would match outside of the right image
+		for (int x = 0; x < std::min(_width, s_stereo_disparities); ++x)
+			for (int d = 0; d < s_stereo_disparities; ++d)
+				costs[x * s_stereo_disparities + d] = static_cast<uint8_t>(x >= d ? bit_count(census_left[x] ^ census_right[x - d]) : s_max_cost);
+
+		// Computed for a block of pixels per disparity, which reads both census rows forwards, then stored per pixel
+		for (int x = s_stereo_disparities; x < _width; x += s_block_size)
+		{
+			uint8_t block_costs[s_stereo_disparities][s_block_size];
+			for (int d = 0; d < s_stereo_disparities; ++d)
+				for (int i = 0; i < s_block_size; ++i)
+					block_costs[d][i] = static_cast<uint8_t>(bit_count(census_left[x + i] ^ census_right[x + i - d]));
+			for (int i = 0; i < std::min(s_block_size, _width - x); ++i)
+				for (int d = 0; d < s_stereo_disparities; ++d)
+					costs[(x + i) * s_stereo_disparities + d] = block_costs[d][i];
+		}
+	}
+
+	// One step along a path: 'previous' is the path cost of the pixel before (with a large value on both ends, so that neighbors of the outermost disparities need no special case)
+	// The result goes through a local array, so that the compiler knows it does not overlap the inputs, and its lowest cost is returned for the next step
+	static uint16_t path_step(const stereo_options &options, const uint8_t *costs, const uint16_t *previous, uint16_t previous_min, uint16_t *current)
+	{
+		const uint16_t small_penalty = options.small_penalty;
+		const uint16_t large_jump = static_cast<uint16_t>(previous_min + options.large_penalty);
+
+		uint16_t result[s_stereo_disparities];
+		for (int d = 0; d < s_stereo_disparities; ++d)
+		{
+			const uint16_t neighbors = static_cast<uint16_t>(std::min(previous[d], previous[d + 2]) + small_penalty);
+			const uint16_t best = std::min(std::min(previous[d + 1], neighbors), large_jump);
+			result[d] = static_cast<uint16_t>(costs[d] + best - previous_min);
+		}
+		std::memcpy(current + 1, result, sizeof(result));
+
+		uint16_t lowest = 0xFFFF;
+		for (int d = 0; d < s_stereo_disparities; ++d)
+			lowest = std::min(lowest, result[d]);
+		return lowest;
+	}
+
+	// Aggregates along the row in both directions, which starts the sums of the row
+	void aggregate_row(const stereo_options &options, int y)
+	{
+		const size_t row_offset = static_cast<size_t>(y) * _width * s_stereo_disparities;
+		const uint8_t *const costs = _costs.data() + row_offset;
+		uint16_t *const sums = _aggregated.data() + row_offset;
+		std::fill(sums, sums + _width * s_stereo_disparities, static_cast<uint16_t>(0));
+
+		for (const int direction : { 1, -1 })
+		{
+			uint16_t paths[2][s_stereo_disparities + 2];
+			std::fill(std::begin(paths[0]), std::end(paths[0]), static_cast<uint16_t>(0x3FFF));
+			std::fill(std::begin(paths[1]), std::end(paths[1]), static_cast<uint16_t>(0x3FFF));
+			for (int d = 0; d < s_stereo_disparities; ++d)
+				paths[0][d + 1] = 0;
+			uint16_t previous_min = 0;
+
+			for (int i = 0; i < _width; ++i)
+			{
+				const int x = direction > 0 ? i : _width - 1 - i;
+				const uint16_t *const previous = paths[i & 1];
+				uint16_t *const current = paths[(i + 1) & 1];
+				previous_min = path_step(options, costs + x * s_stereo_disparities, previous, previous_min, current);
+
+				uint16_t *const pixel_sums = sums + x * s_stereo_disparities;
+				for (int d = 0; d < s_stereo_disparities; ++d)
+					pixel_sums[d] = static_cast<uint16_t>(pixel_sums[d] + current[d + 1]);
+			}
+		}
+	}
+
+	// Aggregates columns 'x_begin' to 'x_end' downwards and upwards, adding to the sums of the rows
+	void aggregate_band(const stereo_options &options, int x_begin, int x_end)
+	{
+		const int columns = x_end - x_begin;
+		for (const int direction : { 1, -1 })
+		{
+			uint16_t paths[2][s_band_width][s_stereo_disparities + 2];
+			uint16_t previous_min[s_band_width] = {};
+			for (int column = 0; column < s_band_width; ++column)
+			{
+				std::fill(std::begin(paths[0][column]), std::end(paths[0][column]), static_cast<uint16_t>(0x3FFF));
+				std::fill(std::begin(paths[1][column]), std::end(paths[1][column]), static_cast<uint16_t>(0x3FFF));
+				for (int d = 0; d < s_stereo_disparities; ++d)
+					paths[0][column][d + 1] = 0;
+			}
+
+			for (int i = 0; i < _height; ++i)
+			{
+				const int y = direction > 0 ? i : _height - 1 - i;
+				const size_t row_offset = (static_cast<size_t>(y) * _width + x_begin) * s_stereo_disparities;
+				for (int column = 0; column < columns; ++column)
+				{
+					const uint16_t *const previous = paths[i & 1][column];
+					uint16_t *const current = paths[(i + 1) & 1][column];
+					previous_min[column] = path_step(options, _costs.data() + row_offset + column * s_stereo_disparities, previous, previous_min[column], current);
+
+					uint16_t *const pixel_sums = _aggregated.data() + row_offset + column * s_stereo_disparities;
+					for (int d = 0; d < s_stereo_disparities; ++d)
+						pixel_sums[d] = static_cast<uint16_t>(pixel_sums[d] + current[d + 1]);
+				}
+			}
+		}
+	}
+
+	// Picks the disparity with the lowest aggregated cost for every pixel, refines it to subpixels and checks it against the match from the right image
+	size_t select_row(const stereo_options &options, int y, float *disparity) const
+	{
+		const uint16_t *const sums = _aggregated.data() + static_cast<size_t>(y) * _width * s_stereo_disparities;
+		// Finds the lowest sum first (which is vectorized) and then the first disparity with it
+		const auto best_of = [](const uint16_t *pixel_sums, int count) {
+			uint16_t lowest = 0xFFFF;
+			for (int d = 0; d < s_stereo_disparities; ++d)
+				lowest = std::min(lowest, pixel_sums[d]);
+			for (int d = 0; d < count; ++d)
+				if (pixel_sums[d] == lowest)
+					return d;
+			// The lowest sum is at a disparity that would match outside of the right image
+			int best = 0;
+			for (int d = 1; d < count; ++d)
+				if (pixel_sums[d] < pixel_sums[best])
+					best = d;
+			return best;
+		};
+
+		// Best disparity of every pixel of the right image, from the same sums (pixel 'x' of the right image at disparity 'd' is pixel 'x + d' of the left one)
+		std::vector<int> right_disparity(_width);
+		for (int x = 0; x < _width; ++x)
+		{
+			int best = 0;
+			for (int d = 1; d < s_stereo_disparities && x + d < _width; ++d)
+				if (sums[(x + d) * s_stereo_disparities + d] < sums[(x + best) * s_stereo_disparities + best])
+					best = d;
+			right_disparity[x] = best;
+		}
+
+		size_t accepted = 0;
+		for (int x = 0; x < _width; ++x)
+		{
+			const uint16_t *const pixel_sums = sums + x * s_stereo_disparities;
+			const int best = best_of(pixel_sums, std::min(s_stereo_disparities, x + 1));
+			if (std::abs(right_disparity[x - best] - best) > options.consistency_tolerance)
+			{
+				disparity[x] = -1.0f;
+				continue;
+			}
+
+			// Fit a parabola through the costs around the minimum
+			float refined = static_cast<float>(best);
+			if (best > 0 && best < s_stereo_disparities - 1)
+			{
+				const float before = pixel_sums[best - 1], center = pixel_sums[best], after = pixel_sums[best + 1];
+				const float curvature = before - 2.0f * center + after;
+				if (curvature > 0.0f)
+					refined += std::clamp(0.5f * (before - after) / curvature, -0.5f, 0.5f);
+			}
+			disparity[x] = refined;
+			accepted++;
+		}
+
+		// Rejected pixels are usually background that is hidden in the other eye, so they take the farther (smaller) disparity of the accepted pixels on both sides
+		for (int x = 0; x < _width; ++x)
+		{
+			if (disparity[x] >= 0.0f)
+				continue;
+			int end = x;
+			while (end < _width && disparity[end] < 0.0f)
+				end++;
+			const float before = x > 0 ? disparity[x - 1] : -1.0f;
+			const float after = end < _width ? disparity[end] : -1.0f;
+			const float fill = before < 0.0f ? std::max(after, 0.0f) : after < 0.0f ? before : std::min(before, after);
+			std::fill(disparity + x, disparity + end, fill);
+			x = end;
+		}
+
+		return accepted;
+	}
+
+	int _width = 0, _height = 0, _luma_stride = 0;
+	std::vector<uint16_t> _luma_left, _luma_right;
+	std::vector<uint32_t> _census_left, _census_right;
+	// Matching cost and the sum of the path costs of all four directions, for every pixel and disparity
+	std::vector<uint8_t> _costs;
+	std::vector<uint16_t> _aggregated;
+};
@@ -21,22 +21,61 @@ float pitch_adjusted = pitch * width / dpi * cos(atan(1.0, slope));
 float subp = 1.0 / (3.0f * width) * pitch_adjusted;
 float repeat = 100/2;
 
-vec4 my_sample(float alpha){
-    // sample right eye
-    
+// set to 1 to estimate disparity between the two eyes and synthesize in-between views across the viewing cone, instead of only showing left or right
+// this is a lot slower (about 30 texture reads per pixel instead of 1-2), so only try it on a decent GPU
+#define VIEW_SYNTHESIS 0
+// largest disparity searched for, in input texels (along the 3DS's horizontal axis, which is the texture's y axis)
+const float max_disparity = 16.0;
+// number of candidates tested between -max_disparity and max_disparity
+const int disparity_steps = 9;
+
+// returns true where the subpixel at this offset shows the right eye
+bool is_right_eye(float alpha){
     // one-shot mode
-    if(fract(alpha) > 0.145){
-    // if(alpha < -100){
+    return fract(alpha) > 0.145;
+    // return alpha < -100;
     // repeated mode
-    //if(mod(fract(alpha)*100,repeat) >= repeat*0.5){
-        // return vec4(1,0,0,1); // debug color
-        return texture(color_texture_r, frag_tex_coord);
+    // return mod(fract(alpha)*100,repeat) >= repeat*0.5;
+}
+
+#if VIEW_SYNTHESIS
+float luma(vec3 c){
+    return dot(c, vec3(0.299, 0.587, 0.114));
+}
+
+// block matching along the horizontal axis: returns the offset (in uv) from a point in the left eye to the same point in the right eye
+float estimate_disparity(vec2 uv, float texel){
+    // small cross-shaped window, so flat areas don't match everything equally well
+    vec2 window[3] = vec2[3](vec2(0.0), vec2(0.0, -2.0 * texel), vec2(0.0, 2.0 * texel));
+    float left_luma[3];
+    for (int i = 0; i < 3; i++)
+        left_luma[i] = luma(texture(color_texture, uv + window[i]).rgb);
+
+    float best_cost = 1e6;
+    float best_offset = 0.0;
+    for (int candidate = 0; candidate < disparity_steps; candidate++){
+        float offset = mix(-max_disparity, max_disparity, float(candidate) / float(disparity_steps - 1)) * texel;
+        float cost = 0.0;
+        for (int i = 0; i < 3; i++)
+            cost += abs(left_luma[i] - luma(texture(color_texture_r, uv + window[i] + vec2(0.0, offset)).rgb));
+        // prefer small disparities when costs are close, which keeps flat areas at screen depth
+        cost += abs(offset) * 0.001 / texel;
+        if (cost < best_cost){
+            best_cost = cost;
+            best_offset = offset;
+        }
     }
-    // sample left eye
-    // return vec4(0,0,1,1); // debug color
-    return texture(color_texture, frag_tex_coord);
+    return best_offset;
 }
 
+// color of the view at position t between the left (0) and right (1) eye, warping both eyes towards it
+vec3 synthesize_view(float t, float disparity){
+    vec3 left_color = texture(color_texture, frag_tex_coord - vec2(0.0, t * disparity)).rgb;
+    vec3 right_color = texture(color_texture_r, frag_tex_coord + vec2(0.0, (1.0 - t) * disparity)).rgb;
+    return mix(left_color, right_color, t);
+}
+#endif
+
 void main() {
     // if(screen == 1){
     //     // bottom screen
@@ -52,9 +91,25 @@ void main() {
         // generate using our normalized uv
         float alpha = ( frag_tex_coord.y + frag_tex_coord.x * tilt ) * pitch_adjusted - center;
 
-        // we sample 3 times since the r,g,b subpixels for each "original" pixel needs to be additionally shifted by one extra "subpixel" amount per channel to match the unique sub-pixel layout of the LKGP display
-        color.r = my_sample(alpha).r;
-        color.g = my_sample(alpha + subp).g;
-        color.b = my_sample(alpha + 2.0f * subp).b;
+#if VIEW_SYNTHESIS
+        // every subpixel sees the view at its position within the repeating viewing cone
+        float disparity = estimate_disparity(frag_tex_coord, 1.0 / i_resolution.y);
+        color.r = synthesize_view(fract(alpha), disparity).r;
+        color.g = synthesize_view(fract(alpha + subp), disparity).g;
+        color.b = synthesize_view(fract(alpha + 2.0f * subp), disparity).b;
+        return;
+#endif
+
+        // the r,g,b subpixels for each "original" pixel needs to be additionally shifted by one extra "subpixel" amount per channel to match the unique sub-pixel layout of the LKGP display
+        bvec3 right_eye = bvec3(is_right_eye(alpha), is_right_eye(alpha + subp), is_right_eye(alpha + 2.0f * subp));
+
+        // all three subpixels sample the same uv, so each eye only needs to be read once (and most pixels only need one of them)
+        // which eye is read differs between neighboring pixels, so use an explicit lod, since implicit derivatives are undefined there (the screens have no mipmaps anyway)
+        // vec3 right_color = vec3(1,0,0); // debug color
+        // vec3 left_color = vec3(0,0,1); // debug color
+        vec3 right_color = any(right_eye) ? textureLod(color_texture_r, frag_tex_coord, 0.0).rgb : vec3(0.0);
+        vec3 left_color = all(right_eye) ? vec3(0.0) : textureLod(color_texture, frag_tex_coord, 0.0).rgb;
+
+        color.rgb = mix(left_color, right_color, vec3(right_eye));
     // }
 }
@@ -24,40 +24,74 @@ const float pitch_adjusted = pitch * width / dpi * cos(atan(1.0f, slope));
 const float subp = 1.0f / (3.0f * width) * pitch_adjusted;
 const float repeat = 100.0f/3.0f;
 
-vec4 my_sample(float alpha){
-	const vec2 pos = vec2(HOOKED_pos);
-	const float halfX = pos.x / 2.0f;
-
-	// return HOOKED_texOff(vec2(-alpha,0.0));
-
-	if(fract(alpha) < .5){
-	// if(mod(fract(alpha)*100.0f,repeat) < repeat*0.5){
-	// if(pos.x < 0.5){
-		// right eye (right half of SBS);
-		// return vec4(0.0,0.0,1.0,1.0);
-		return HOOKED_tex(vec2(0.5 + halfX, pos.y));
-	}
-	// left eye (left half of SBS)
-	// return vec4(0.0);
-	// return vec4(0.0,0.0,1.0,1.0);
-	return HOOKED_tex(vec2(halfX, pos.y));
+// 0 = side-by-side stereo video (left eye in the left half, right eye in the right half)
+// 1 = color + depth video (color in the left half, grayscale depth in the right half), e.g. from captured Citra sessions
+#define INPUT_LAYOUT 0
+
+// color + depth only: set to false if near objects are black in the depth half instead of white
+const bool depth_white_is_near = true;
+// largest horizontal shift between the outermost views, as a fraction of the width (same as lkg-encode's --strength)
+const float strength = 0.04f;
+// depth (0 = near, 1 = far) that stays at the plane of the display (same as lkg-encode's --focus)
+const float focus = 0.5f;
+
+// returns true where the subpixel at this offset shows the right eye (right half of SBS)
+bool is_right_eye(float alpha){
+	return fract(alpha) < .5;
+	// return mod(fract(alpha)*100.0f,repeat) < repeat*0.5;
+	// return HOOKED_pos.x < 0.5;
+}
+
+#if INPUT_LAYOUT == 1
+// color of the view at 'view_pos' (0 = leftmost, 1 = rightmost view) for this pixel, by shifting the color half according to depth
+vec3 synthesize_view(float view_pos, float depth){
+	const float halfX = HOOKED_pos.x / 2.0f;
+
+	// backward warp using the depth at the target pixel (shift is in uv of the full frame, so halve it for the color half)
+	float shift = (view_pos - 0.5) * strength * (focus - depth);
+	return HOOKED_tex(vec2(clamp(halfX - shift * 0.5, 0.0, 0.5), HOOKED_pos.y)).rgb;
 }
+#endif
 
 vec4 hook(){
 
 	vec4 myColor = vec4(0.0,0.0,0.0,0.1);//HOOKED_tex(HOOKED_pos);
 	
 	// float alpha = (HOOKED_pos.x + (1.0-HOOKED_pos.y) * tilt) * pitch_adjusted - center;
+#if INPUT_LAYOUT == 1
+	// same mapping from panel position to view as 'interlace_row' in lkg-encode, so that both show the same views (checked by encoder/mpv-check.cpp)
+	float alpha = (HOOKED_pos.x + HOOKED_pos.y * tilt) * pitch_adjusted - center;
+#else
 	float alpha = (HOOKED_pos.x + (1.0-HOOKED_pos.y) * slope) * pitch_adjusted - center;
+#endif
 
 	// This makes a perfect red/cyan filter somehow
 	// float alpha = gl_FragCoord.x; // + gl_FragCoord.y;
 
-    // we sample 3 times since the r,g,b subpixels for each "original" pixel needs to be additionally shifted by one extra "subpixel" amount per channel to match the unique sub-pixel layout of the LKGP display
-    // myColor = my_sample(alpha);
-    myColor.r = my_sample(alpha).r;
-    myColor.g = my_sample(alpha + subp).g;
-    myColor.b = my_sample(alpha + 2.0f * subp).b;
+#if INPUT_LAYOUT == 1
+    // every subpixel shows the view at its position within the viewing cone, so this gives as many views as the panel can show instead of 2
+    // depth is read once at the target pixel and shared by all three subpixels
+    float depth = HOOKED_tex(vec2(0.5 + HOOKED_pos.x / 2.0f, HOOKED_pos.y)).r;
+    if (depth_white_is_near)
+        depth = 1.0 - depth;
+
+    myColor.r = synthesize_view(fract(alpha), depth).r;
+    myColor.g = synthesize_view(fract(alpha + subp), depth).g;
+    myColor.b = synthesize_view(fract(alpha + 2.0f * subp), depth).b;
+#else
+
+    // the r,g,b subpixels for each "original" pixel needs to be additionally shifted by one extra "subpixel" amount per channel to match the unique sub-pixel layout of the LKGP display
+    bvec3 rightEye = bvec3(is_right_eye(alpha), is_right_eye(alpha + subp), is_right_eye(alpha + 2.0f * subp));
+
+    // every channel reads the same spot of its eye, so fetch each half of the SBS frame at most once instead of once per channel
+    const float halfX = HOOKED_pos.x / 2.0f;
+    // return HOOKED_texOff(vec2(-alpha,0.0));
+    // which half is read differs between neighboring pixels, so use an explicit lod instead of HOOKED_tex, since implicit derivatives are undefined there
+    vec3 rightColor = any(rightEye) ? (HOOKED_mul * textureLod(HOOKED_raw, vec2(0.5 + halfX, HOOKED_pos.y), 0.0)).rgb : vec3(0.0);
+    vec3 leftColor = all(rightEye) ? vec3(0.0) : (HOOKED_mul * textureLod(HOOKED_raw, vec2(halfX, HOOKED_pos.y), 0.0)).rgb;
+
+    myColor.rgb = mix(leftColor, rightColor, vec3(rightEye));
+#endif
 
     return myColor;
 }